@@ -0,0 +1,116 @@
+// CSV loading and dumping throughput over a 500k-row file (about 22 MB).
+// BM_Import runs importFile() with 1-8 parser threads; BM_ShellImport is the
+// sqlite3 shell's ".import --csv" on the same file and settings, taken from
+// $SQLITE3 or PATH, and is skipped if the shell cannot be run. Both load
+// into a fresh file opened with the BulkLoad profile. Bytes/s is input
+// size over wall time.
+
+#include "bulk_io.h"
+#include "esqlite.h"
+#include "open_options.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace esqlite;
+
+namespace {
+
+constexpr int RowCount = 500000;
+constexpr char const *Input = "bulk_bench.csv";
+constexpr char const *Target = "bulk_bench.sqlite";
+
+auto inputSize() -> std::int64_t {
+  static std::int64_t const Size = [] {
+    std::ofstream Out(Input, std::ios::binary);
+    Out << "id,name,score,note\n";
+    for (int I = 0; I < RowCount; ++I)
+      Out << I << ",user" << I << "," << I * 0.25 << ","
+          << (I % 4 ? "\"quoted, with a comma\"" : "plain note text") << "\n";
+    Out.flush();
+    return std::int64_t(std::filesystem::file_size(Input));
+  }();
+  return Size;
+}
+
+void BM_Import(benchmark::State &State) {
+  auto Size = inputSize();
+  ImportOptions Options;
+  Options.ParserThreads = static_cast<std::size_t>(State.range(0));
+  for (auto _ : State) {
+    State.PauseTiming();
+    std::filesystem::remove(Target);
+    auto Conn = open(Target, BulkLoad);
+    State.ResumeTiming();
+    auto Stats = importFile(*Conn, Input, "T", Options);
+    if (!Stats) {
+      State.SkipWithError(std::string(Stats.error()).c_str());
+      break;
+    }
+  }
+  State.SetBytesProcessed(State.iterations() * Size);
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+void BM_ShellImport(benchmark::State &State) {
+  auto Size = inputSize();
+  auto const *Shell = std::getenv("SQLITE3");
+  // Same settings as the BulkLoad profile.
+  auto Command = std::string(Shell ? Shell : "sqlite3") + " " + Target +
+                 " -cmd 'PRAGMA journal_mode = OFF' -cmd 'PRAGMA synchronous "
+                 "= OFF' -cmd 'PRAGMA locking_mode = EXCLUSIVE' -cmd 'PRAGMA "
+                 "cache_size = -262144' '.import --csv " +
+                 Input + " T' > /dev/null 2>&1";
+  for (auto _ : State) {
+    State.PauseTiming();
+    std::filesystem::remove(Target);
+    State.ResumeTiming();
+    if (std::system(Command.c_str()) != 0) {
+      State.SkipWithError("sqlite3 shell not available");
+      break;
+    }
+  }
+  State.SetBytesProcessed(State.iterations() * Size);
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+void BM_Export(benchmark::State &State) {
+  std::filesystem::remove(Target);
+  auto Conn = open(Target, BulkLoad);
+  if (auto E = importFile(*Conn, Input, "T"); !E) {
+    State.SkipWithError(std::string(E.error()).c_str());
+    return;
+  }
+  ExportOptions Options;
+  Options.Format = State.range(0) ? BulkFormat::Ndjson : BulkFormat::Csv;
+  std::int64_t Bytes = 0;
+  for (auto _ : State) {
+    auto Stats = exportQuery(*Conn, "SELECT * FROM T", "bulk_bench.out",
+                             Options);
+    Bytes += std::int64_t(Stats->Bytes);
+  }
+  State.SetBytesProcessed(Bytes);
+  State.SetItemsProcessed(State.iterations() * RowCount);
+  std::filesystem::remove("bulk_bench.out");
+}
+
+} // namespace
+
+BENCHMARK(BM_Import)
+    ->ArgName("threads")
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_ShellImport)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Export)
+    ->ArgName("ndjson")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,60 @@
+// Writer cost of a change feed. mode: 0 = no feed, 1 = changes() with a
+// consumer that only counts; rows is the number of inserts per
+// transaction. The database is in memory, so the hooks, value copies and
+// queue hand-off are the whole difference.
+
+#include "esqlite.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+using namespace esqlite;
+
+namespace {
+
+void BM_Commit(benchmark::State &State) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  (void)Conn->run("CREATE TABLE T (id INTEGER PRIMARY KEY, v INT, s TEXT)");
+  std::atomic<std::uint64_t> Seen{0};
+  ChangeFeed Feed;
+  if (State.range(0)) {
+    auto Started = Conn->changes([&](ChangeBatch const &Batch) {
+      Seen.fetch_add(Batch.Events.size(), std::memory_order_relaxed);
+    });
+    if (!Started) {
+      State.SkipWithError(std::string(Started.error()).c_str());
+      return;
+    }
+    Feed = std::move(*Started);
+  }
+
+  auto Rows = State.range(1);
+  auto Insert = Conn->prepare("INSERT INTO T (v, s) VALUES (?, ?)");
+  auto Begin = Conn->prepare("BEGIN");
+  auto Commit = Conn->prepare("COMMIT");
+  std::int64_t I = 0;
+  for (auto _ : State) {
+    (void)Begin->step();
+    (void)Begin->reset();
+    for (std::int64_t R = 0; R < Rows; ++R, ++I) {
+      (void)Insert->bindParams(1, I, std::string_view("some payload text"));
+      (void)Insert->step();
+      (void)Insert->reset();
+    }
+    (void)Commit->step();
+    (void)Commit->reset();
+  }
+  Feed.stop();
+  State.SetItemsProcessed(State.iterations() * Rows);
+  State.counters["events"] = double(Seen.load());
+}
+
+} // namespace
+
+BENCHMARK(BM_Commit)
+    ->ArgNames({"mode", "rows"})
+    ->ArgsProduct({{0, 1}, {1, 100}})
+    ->UseRealTime();
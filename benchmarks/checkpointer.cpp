@@ -0,0 +1,88 @@
+// Commit latency under sustained writes. mode: 0 = SQLite's automatic
+// checkpoint on the writer (WriteHeavy's wal_autocheckpoint), 1 = a
+// Checkpointer with default options; rate: commits per second, 0 = as fast
+// as possible. Every commit inserts a 4 KiB row into a WAL database on
+// disk; the percentile counters are per commit, which is where an inline
+// checkpoint shows up.
+
+#include "checkpointer.h"
+#include "esqlite.h"
+#include "open_options.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace esqlite;
+
+namespace {
+
+void BM_Commit(benchmark::State &State) {
+  for (auto const *Suffix : {"", "-wal", "-shm"})
+    std::filesystem::remove(std::string("checkpointer_bench.sqlite") + Suffix);
+  auto Conn = open("checkpointer_bench.sqlite", WriteHeavy);
+  if (!Conn) {
+    State.SkipWithError(std::string(Conn.error()).c_str());
+    return;
+  }
+  (void)Conn->run("CREATE TABLE T (id INTEGER PRIMARY KEY, v BLOB)");
+  Checkpointer Checkpoints;
+  if (State.range(0)) {
+    auto Started = Checkpointer::start(*Conn);
+    if (!Started) {
+      State.SkipWithError(std::string(Started.error()).c_str());
+      return;
+    }
+    Checkpoints = std::move(*Started);
+  }
+
+  std::string Payload(4096, 'x');
+  auto Insert = Conn->prepare("INSERT INTO T (v) VALUES (?)");
+  std::vector<std::chrono::nanoseconds> Latencies;
+  Latencies.reserve(State.max_iterations);
+  auto Rate = State.range(1);
+  auto Period = Rate ? std::chrono::nanoseconds(1'000'000'000 / Rate)
+                     : std::chrono::nanoseconds(0);
+  auto Next = std::chrono::steady_clock::now();
+  for (auto _ : State) {
+    if (Rate) {
+      Next += Period;
+      std::this_thread::sleep_until(Next);
+    }
+    auto Start = std::chrono::steady_clock::now();
+    (void)Insert->bindParams(1, std::string_view(Payload));
+    (void)Insert->step();
+    (void)Insert->reset();
+    Latencies.push_back(std::chrono::steady_clock::now() - Start);
+  }
+  auto Stats = Checkpoints.stats();
+  Checkpoints.stop();
+
+  std::ranges::sort(Latencies);
+  auto At = [&](double Q) {
+    return double(Latencies[std::size_t(Q * (Latencies.size() - 1))].count());
+  };
+  State.counters["p50_ns"] = At(0.5);
+  State.counters["p99_ns"] = At(0.99);
+  State.counters["p999_ns"] = At(0.999);
+  State.counters["max_ns"] = At(1.0);
+  if (State.range(0)) {
+    State.counters["checkpoints"] =
+        double(Stats.Passive + Stats.Restart + Stats.Truncate);
+    State.counters["max_checkpoint_ns"] = double(Stats.MaxDuration.count());
+  }
+  State.SetItemsProcessed(State.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_Commit)
+    ->ArgNames({"mode", "rate"})
+    ->ArgsProduct({{0, 1}, {0, 5000}})
+    ->Iterations(50000)
+    ->UseRealTime();
@@ -0,0 +1,104 @@
+// Effect of esqlite::configure() memory settings on allocation count and
+// latency. Each benchmark reinitializes SQLite with the configuration under
+// test (pool:0 = system malloc, pool:1 = PoolAllocator) and restores the
+// default afterwards.
+
+#include "esqlite.h"
+#include "memory_config.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace esqlite;
+
+namespace {
+
+// Forwards to whichever allocator is configured and counts the calls.
+struct CountingAllocator {
+  static inline sqlite3_mem_methods Inner;
+  static inline std::atomic<std::uint64_t> Calls{0};
+
+  static auto xMalloc(int N) -> void * {
+    Calls.fetch_add(1, std::memory_order_relaxed);
+    return Inner.xMalloc(N);
+  }
+  static void xFree(void *P) { Inner.xFree(P); }
+  static auto xRealloc(void *P, int N) -> void * {
+    Calls.fetch_add(1, std::memory_order_relaxed);
+    return Inner.xRealloc(P, N);
+  }
+  static auto xSize(void *P) -> int { return Inner.xSize(P); }
+  static auto xRoundup(int N) -> int { return Inner.xRoundup(N); }
+  static auto xInit(void *) -> int { return Inner.xInit(Inner.pAppData); }
+  static void xShutdown(void *) { Inner.xShutdown(Inner.pAppData); }
+
+  static inline sqlite3_mem_methods Methods = {
+      &xMalloc, &xFree, &xRealloc, &xSize, &xRoundup, &xInit, &xShutdown,
+      nullptr};
+};
+
+sqlite3_mem_methods SystemMalloc;
+
+void reconfigure(benchmark::State const &State) {
+  sqlite3_shutdown();
+  static bool Saved = sqlite3_config(SQLITE_CONFIG_GETMALLOC,
+                                     &SystemMalloc) == SQLITE_OK;
+  (void)Saved;
+  sqlite3_config(SQLITE_CONFIG_MALLOC, &SystemMalloc);
+  (void)configure({.UsePoolAllocator = State.range(0) != 0,
+                   .PageCacheSlots = State.range(0) ? 512 : 0,
+                   .MemStatus = false});
+  sqlite3_config(SQLITE_CONFIG_GETMALLOC, &CountingAllocator::Inner);
+  sqlite3_config(SQLITE_CONFIG_MALLOC, &CountingAllocator::Methods);
+  sqlite3_initialize();
+}
+
+void restore(benchmark::State const &) {
+  sqlite3_shutdown();
+  sqlite3_config(SQLITE_CONFIG_MALLOC, &SystemMalloc);
+  (void)configure({});
+}
+
+// Insert and read back 1000 rows on a private in-memory database.
+void BM_InsertSelect(benchmark::State &State) {
+  std::vector<std::tuple<std::int64_t, std::string>> Rows;
+  for (int I = 0; I < 1000; ++I)
+    Rows.emplace_back(I, std::string(I % 64, 'x'));
+
+  auto Before = CountingAllocator::Calls.load();
+  for (auto _ : State) {
+    auto Conn =
+        open_v2(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                                SQLITE_OPEN_NOMUTEX);
+    if (State.range(0))
+      (void)Conn->setLookaside(256, 128);
+    (void)Conn->run("CREATE TABLE T (n INT, s TEXT)");
+    (void)Conn->insertMany("INSERT INTO T VALUES (?, ?)", Rows);
+    std::int64_t Sum = 0;
+    for (auto &&Row :
+         Conn->runReading<std::int64_t, std::string_view>("SELECT * FROM T"))
+      Sum += std::get<0>(*Row) + std::get<1>(*Row).size();
+    benchmark::DoNotOptimize(Sum);
+  }
+  // Calls is shared by all threads; average the per-thread estimates.
+  State.counters["allocs_per_iter"] = benchmark::Counter(
+      double(CountingAllocator::Calls.load() - Before) /
+          (State.iterations() * State.threads()),
+      benchmark::Counter::kAvgThreads);
+}
+
+} // namespace
+
+BENCHMARK(BM_InsertSelect)
+    ->ArgName("pool")
+    ->Arg(0)
+    ->Arg(1)
+    ->Setup(reconfigure)
+    ->Teardown(restore)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
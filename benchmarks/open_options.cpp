@@ -0,0 +1,67 @@
+// OpenOptions profiles compared on an on-disk database. profile: 0 = SQLite
+// defaults, 1 = ReadHeavy, 2 = WriteHeavy, 3 = Ephemeral, 4 = BulkLoad.
+
+#include "esqlite.h"
+#include "open_options.h"
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+using namespace esqlite;
+
+namespace {
+
+constexpr int RowCount = 10000;
+
+constexpr std::array<OpenOptions, 5> Profiles = {
+    OpenOptions{}, ReadHeavy, WriteHeavy, Ephemeral, BulkLoad};
+
+auto openProfile(benchmark::State &State) -> Connection {
+  for (auto const *Suffix : {"", "-wal", "-shm", "-journal"})
+    std::filesystem::remove(std::string("profiles.sqlite") + Suffix);
+  auto Conn = open("profiles.sqlite", Profiles[State.range(0)]);
+  if (!Conn) {
+    State.SkipWithError(std::string(Conn.error()).c_str());
+    return {};
+  }
+  (void)Conn->run("CREATE TABLE T (id INTEGER PRIMARY KEY, v TEXT)");
+  return std::move(*Conn);
+}
+
+// Point lookups by primary key.
+void BM_ProfileRead(benchmark::State &State) {
+  auto Conn = openProfile(State);
+  (void)Conn.run("WITH RECURSIVE Seq(n) AS (SELECT 1 UNION ALL SELECT n + 1 "
+                 "FROM Seq WHERE n < 10000) INSERT INTO T SELECT n, "
+                 "'value ' || n FROM Seq");
+  std::int64_t Id = 0;
+  for (auto _ : State) {
+    for (auto &&Row : Conn.runReading<std::string_view>(
+             "SELECT v FROM T WHERE id = ?", Id++ % RowCount + 1))
+      benchmark::DoNotOptimize(Row);
+  }
+  State.SetItemsProcessed(State.iterations());
+}
+
+// One autocommit transaction per insert.
+void BM_ProfileWrite(benchmark::State &State) {
+  auto Conn = openProfile(State);
+  std::int64_t Id = 0;
+  for (auto _ : State) {
+    auto E = Conn.run("INSERT INTO T VALUES (?, 'value')", ++Id);
+    benchmark::DoNotOptimize(E);
+  }
+  State.SetItemsProcessed(State.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_ProfileRead)->ArgName("profile")->DenseRange(0, 4);
+BENCHMARK(BM_ProfileWrite)
+    ->ArgName("profile")
+    ->DenseRange(0, 4)
+    ->UseRealTime();
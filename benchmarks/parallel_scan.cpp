@@ -0,0 +1,77 @@
+// Full-table aggregate over one million rows: a single runReading() scan
+// against parallelScan() on 1-8 threads.
+
+#include "esqlite.h"
+#include "open_options.h"
+#include "parallel_scan.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace esqlite;
+
+namespace {
+
+constexpr std::int64_t RowCount = 1000000;
+
+auto openFilled(benchmark::State &State) -> Connection {
+  static bool Filled = false;
+  auto Conn = open("scan_bench.sqlite", WriteHeavy);
+  if (!Conn) {
+    State.SkipWithError(std::string(Conn.error()).c_str());
+    return {};
+  }
+  if (!Filled) {
+    (void)Conn->run("DROP TABLE IF EXISTS T");
+    (void)Conn->run("CREATE TABLE T (id INTEGER PRIMARY KEY, v INT, s TEXT)");
+    (void)Conn->run("WITH RECURSIVE Seq(n) AS (SELECT 1 UNION ALL SELECT "
+                    "n + 1 FROM Seq WHERE n < 1000000) INSERT INTO T SELECT "
+                    "n, n % 100, 'row ' || n FROM Seq");
+    Filled = true;
+  }
+  return std::move(*Conn);
+}
+
+void BM_ScanSingle(benchmark::State &State) {
+  auto Conn = openFilled(State);
+  for (auto _ : State) {
+    std::int64_t Sum = 0;
+    for (auto &&Row : Conn.runReading<std::int64_t, std::string_view>(
+             "SELECT v, s FROM T WHERE v < 50"))
+      Sum += std::get<0>(*Row) + std::get<1>(*Row).size();
+    benchmark::DoNotOptimize(Sum);
+  }
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+void BM_ScanParallel(benchmark::State &State) {
+  auto Conn = openFilled(State);
+  auto Threads = static_cast<std::size_t>(State.range(0));
+  for (auto _ : State) {
+    std::vector<std::int64_t> Sums(Threads * 8);
+    auto Stats = parallelScan<std::int64_t, std::string_view>(
+        Conn, "T",
+        {.Columns = "v, s", .Predicate = "v < 50", .Threads = Threads},
+        [&](std::size_t Worker, auto &Row) {
+          // Spread accumulators a cache line apart.
+          Sums[Worker * 8] += std::get<0>(Row) + std::get<1>(Row).size();
+        });
+    benchmark::DoNotOptimize(Stats);
+    benchmark::DoNotOptimize(Sums);
+  }
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+} // namespace
+
+BENCHMARK(BM_ScanSingle)->UseRealTime();
+BENCHMARK(BM_ScanParallel)
+    ->ArgName("threads")
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->UseRealTime();
@@ -0,0 +1,80 @@
+// Cost of QueryLimits on queries that finish in time. mode: 0 = plain
+// runReading(), 1 = with a deadline, 2 = with a deadline and a
+// CancellationToken; check_every is the progress handler interval in VM
+// instructions. BM_DeadlineOvershoot reports how late a runaway query
+// stops after its deadline.
+
+#include "esqlite.h"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <tuple>
+
+using namespace esqlite;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr int RowCount = 100000;
+
+auto openFilled() -> Connection {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  (void)Conn->run("CREATE TABLE T (id INTEGER PRIMARY KEY, v INT, s TEXT)");
+  (void)Conn->run("WITH RECURSIVE Seq(n) AS (SELECT 1 UNION ALL SELECT n + 1 "
+                  "FROM Seq WHERE n < 100000) INSERT INTO T SELECT n, n % 7, "
+                  "'row ' || n FROM Seq");
+  return std::move(*Conn);
+}
+
+void BM_Scan(benchmark::State &State) {
+  auto Conn = openFilled();
+  CancellationToken Token;
+  auto Mode = State.range(0);
+  constexpr std::string_view Sql = "SELECT v, s FROM T WHERE v < 5";
+  for (auto _ : State) {
+    QueryLimits Limits = QueryLimits::after(1h);
+    Limits.CheckEvery = int(State.range(1));
+    if (Mode == 2)
+      Limits.Token = &Token;
+    std::int64_t Sum = 0;
+    auto Rows = Mode ? Conn.runReading<int, std::string_view>(Limits, Sql)
+                     : Conn.runReading<int, std::string_view>(Sql);
+    for (auto &&Row : Rows)
+      Sum += std::get<0>(*Row) + std::get<1>(*Row).size();
+    benchmark::DoNotOptimize(Sum);
+  }
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+void BM_DeadlineOvershoot(benchmark::State &State) {
+  auto Conn = openFilled();
+  double Late = 0;
+  for (auto _ : State) {
+    QueryLimits Limits = QueryLimits::after(2ms);
+    Limits.CheckEvery = int(State.range(0));
+    for (auto &&Row : Conn.runReading<int>(
+             Limits, "SELECT count(*) FROM T A, T B WHERE A.s < B.s"))
+      benchmark::DoNotOptimize(Row);
+    Late += std::chrono::duration<double, std::micro>(
+                QueryLimits::Clock::now() - Limits.Deadline)
+                .count();
+  }
+  State.counters["overshoot_us"] = Late / double(State.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_Scan)
+    ->ArgNames({"mode", "check_every"})
+    ->Args({0, 1000})
+    ->ArgsProduct({{1, 2}, {100, 1000, 10000}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DeadlineOvershoot)
+    ->ArgName("check_every")
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,83 @@
+// Connection::runReading() (generator) against runReadingRange() (RowRange)
+// on the same cached statement. rows:1 is a point lookup, where the
+// coroutine frames dominate; rows:1000 is a scan. allocs_per_iter counts
+// operator new calls made while iterating.
+
+#include "esqlite.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string_view>
+#include <tuple>
+
+using namespace esqlite;
+
+namespace {
+
+std::atomic<std::uint64_t> Allocations{0};
+
+auto openFilled() -> Connection {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  (void)Conn->run("CREATE TABLE T (id INTEGER PRIMARY KEY, n INT, s TEXT)");
+  (void)Conn->run("WITH RECURSIVE Seq(n) AS (SELECT 1 UNION ALL SELECT n + 1 "
+                  "FROM Seq WHERE n < 1000) INSERT INTO T SELECT n, n * 3, "
+                  "'text ' || n FROM Seq");
+  return std::move(*Conn);
+}
+
+template <bool UseRange> void BM_Rows(benchmark::State &State) {
+  auto Conn = openFilled();
+  std::int64_t const Limit = State.range(0);
+  auto Run = [&] {
+    std::int64_t Sum = 0;
+    auto Add = [&](auto &&Row) {
+      Sum += std::get<0>(*Row) + std::int64_t(std::get<1>(*Row).size());
+    };
+    constexpr std::string_view Sql = "SELECT n, s FROM T WHERE id <= ?";
+    if constexpr (UseRange)
+      for (auto &&Row :
+           Conn.runReadingRange<std::int64_t, std::string_view>(Sql, Limit))
+        Add(Row);
+    else
+      for (auto &&Row :
+           Conn.runReading<std::int64_t, std::string_view>(Sql, Limit))
+        Add(Row);
+    return Sum;
+  };
+
+  benchmark::DoNotOptimize(Run()); // Warms the statement cache.
+  auto Before = Allocations.load(std::memory_order_relaxed);
+  for (auto _ : State)
+    benchmark::DoNotOptimize(Run());
+  State.counters["allocs_per_iter"] =
+      double(Allocations.load(std::memory_order_relaxed) - Before) /
+      State.iterations();
+  State.SetItemsProcessed(State.iterations() * Limit);
+}
+
+} // namespace
+
+auto operator new(std::size_t Size) -> void * {
+  Allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto *P = std::malloc(Size ? Size : 1))
+    return P;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *P) noexcept { std::free(P); }
+void operator delete(void *P, std::size_t) noexcept { std::free(P); }
+
+BENCHMARK(BM_Rows<false>)
+    ->Name("BM_Generator")
+    ->ArgName("rows")
+    ->Arg(1)
+    ->Arg(1000);
+BENCHMARK(BM_Rows<true>)
+    ->Name("BM_RowRange")
+    ->ArgName("rows")
+    ->Arg(1)
+    ->Arg(1000);
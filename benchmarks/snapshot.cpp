@@ -0,0 +1,78 @@
+// In-memory snapshots against opening the file. mode: 0 = open_v2() on the
+// file, 1 = openInMemoryFrom() read-only (mapped in place), 2 =
+// openInMemoryFrom() writable (copied to the heap). The file stays in the OS
+// page cache between iterations, so these measure SQLite's own startup and
+// first-query cost rather than the disk.
+
+#include "esqlite.h"
+#include "snapshot.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+using namespace esqlite;
+
+namespace {
+
+constexpr int RowCount = 100000;
+constexpr char const *Path = "snapshot_bench.sqlite";
+
+void createDatabase(benchmark::State const &) {
+  std::filesystem::remove(Path);
+  auto Conn = open_v2(Path, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  (void)Conn->run("CREATE TABLE T (id INTEGER PRIMARY KEY, v TEXT)");
+  (void)Conn->run("WITH RECURSIVE Seq(n) AS (SELECT 1 UNION ALL SELECT n + 1 "
+                  "FROM Seq WHERE n < 100000) INSERT INTO T SELECT n, "
+                  "printf('%0100d', n) FROM Seq");
+}
+
+auto openMode(benchmark::State &State) -> Connection {
+  auto Conn = State.range(0) == 0
+                  ? open_v2(Path, SQLITE_OPEN_READONLY)
+                  : openInMemoryFrom(Path, State.range(0) == 1);
+  if (!Conn) {
+    State.SkipWithError(std::string(Conn.error()).c_str());
+    return {};
+  }
+  return std::move(*Conn);
+}
+
+// Open, then the first lookup: what a freshly started process pays.
+void BM_OpenFirstQuery(benchmark::State &State) {
+  std::int64_t Id = 0;
+  for (auto _ : State) {
+    auto Conn = openMode(State);
+    for (auto &&Row : Conn.runReading<std::string_view>(
+             "SELECT v FROM T WHERE id = ?", Id++ % RowCount + 1))
+      benchmark::DoNotOptimize(Row);
+  }
+  State.SetItemsProcessed(State.iterations());
+}
+
+// Steady-state point lookups once the connection is warm.
+void BM_PointRead(benchmark::State &State) {
+  auto Conn = openMode(State);
+  std::uint64_t Id = 0;
+  for (auto _ : State) {
+    // Stride through the table so lookups do not share pages.
+    Id = (Id + 7919) % RowCount;
+    for (auto &&Row : Conn.runReading<std::string_view>(
+             "SELECT v FROM T WHERE id = ?", std::int64_t(Id) + 1))
+      benchmark::DoNotOptimize(Row);
+  }
+  State.SetItemsProcessed(State.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_OpenFirstQuery)
+    ->ArgName("mode")
+    ->DenseRange(0, 2)
+    ->Setup(createDatabase);
+BENCHMARK(BM_PointRead)
+    ->ArgName("mode")
+    ->DenseRange(0, 2)
+    ->Setup(createDatabase);
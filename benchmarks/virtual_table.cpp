@@ -0,0 +1,61 @@
+// Joining an in-memory list of ids against a table. mode: 0 = load the ids
+// into a temp table first, 1 = read them in place through
+// VirtualTable<std::int64_t>. Each iteration is one load plus one join.
+
+#include "esqlite.h"
+#include "virtual_table.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <ranges>
+#include <span>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace esqlite;
+
+namespace {
+
+void BM_JoinIds(benchmark::State &State) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  (void)Conn->run("CREATE TABLE T (id INTEGER PRIMARY KEY, v INT)");
+  (void)Conn->run("WITH RECURSIVE Seq(n) AS (SELECT 1 UNION ALL SELECT n + 1 "
+                  "FROM Seq WHERE n < 100000) INSERT INTO T SELECT n, n % 7 "
+                  "FROM Seq");
+  (void)VirtualTable<std::int64_t>::create(*Conn, "ids", {},
+                                           {.Columns = {"value"}});
+
+  std::vector<std::int64_t> Ids;
+  for (std::int64_t I = 0; I < State.range(1); ++I)
+    Ids.push_back(I * 7919 % 100000 + 1);
+  std::span<std::int64_t const> IdRows = Ids;
+
+  for (auto _ : State) {
+    std::int64_t Sum = 0;
+    if (State.range(0) == 0) {
+      (void)Conn->run("CREATE TEMP TABLE Wanted (value INTEGER)");
+      (void)Conn->insertMany(
+          "INSERT INTO Wanted VALUES (?)",
+          Ids | std::views::transform([](auto Id) { return std::tuple(Id); }));
+      for (auto &&Row : Conn->runReading<std::int64_t>(
+               "SELECT sum(v) FROM Wanted JOIN T ON T.id = Wanted.value"))
+        Sum = std::get<0>(*Row);
+      (void)Conn->run("DROP TABLE Wanted");
+    } else {
+      for (auto &&Row : Conn->runReading<std::int64_t>(
+               "SELECT sum(v) FROM ids(?) JOIN T ON T.id = ids.value",
+               VirtualTable<std::int64_t>::rows(IdRows)))
+        Sum = std::get<0>(*Row);
+    }
+    benchmark::DoNotOptimize(Sum);
+  }
+  State.SetItemsProcessed(State.iterations() * State.range(1));
+}
+
+} // namespace
+
+BENCHMARK(BM_JoinIds)
+    ->ArgNames({"mode", "ids"})
+    ->ArgsProduct({{0, 1}, {100, 10000}});
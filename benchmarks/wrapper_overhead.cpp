@@ -0,0 +1,486 @@
+// Wrapper overhead against hand-written sqlite3 C calls. Every benchmark runs
+// against an in-memory (disk:0) and an on-disk (disk:1) database.
+
+#include "esqlite.h"
+#include "profiler.h"
+#include "query.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+using namespace esqlite;
+
+namespace {
+
+constexpr int RowCount = 1000;
+
+constexpr std::string_view Schema =
+    "CREATE TABLE T (i0 INT, i1 INT, i2 INT, i3 INT, d0 REAL, d1 REAL, "
+    "d2 REAL, s0 TEXT, s1 TEXT, s2 TEXT)";
+
+constexpr std::string_view Fill =
+    "WITH RECURSIVE Seq(n) AS (SELECT 1 UNION ALL SELECT n + 1 FROM Seq "
+    "WHERE n < 1000) INSERT INTO T SELECT n, n * 2, n * 3, n * 4, n * 0.5, "
+    "n * 1.5, n * 2.5, 'text ' || n, 'more text ' || n, "
+    "'even more text ' || n FROM Seq";
+
+auto dbPath(benchmark::State const &State) -> std::string {
+  if (!State.range(0))
+    return ":memory:";
+  std::filesystem::remove("bench.sqlite");
+  return "bench.sqlite";
+}
+
+auto openRaw(benchmark::State &State) -> sqlite3 * {
+  sqlite3 *Db = nullptr;
+  if (sqlite3_open(dbPath(State).c_str(), &Db) != SQLITE_OK ||
+      sqlite3_exec(Db, std::string(Schema).c_str(), nullptr, nullptr,
+                   nullptr) != SQLITE_OK ||
+      sqlite3_exec(Db, std::string(Fill).c_str(), nullptr, nullptr,
+                   nullptr) != SQLITE_OK)
+    State.SkipWithError(sqlite3_errmsg(Db));
+  return Db;
+}
+
+auto openWrapped(benchmark::State &State) -> Connection {
+  auto Conn = open(dbPath(State));
+  if (!Conn) {
+    State.SkipWithError(std::string(Conn.error()).c_str());
+    return {};
+  }
+  if (auto E = Conn->run(Schema); !E)
+    State.SkipWithError(std::string(E.error()).c_str());
+  if (auto E = Conn->run(Fill); !E)
+    State.SkipWithError(std::string(E.error()).c_str());
+  return std::move(*Conn);
+}
+
+struct Pod1 {
+  std::int64_t I0;
+};
+
+struct Pod5 {
+  std::int64_t I0, I1;
+  double D0, D1;
+  std::string_view S0;
+};
+
+struct Pod10 {
+  std::int64_t I0, I1, I2, I3;
+  double D0, D1, D2;
+  std::string_view S0, S1, S2;
+};
+
+template <int Columns> struct Shape;
+
+template <> struct Shape<1> {
+  static constexpr std::string_view Sql = "SELECT i0 FROM T";
+  using Tuple = std::tuple<std::int64_t>;
+  using Pod = Pod1;
+};
+
+template <> struct Shape<5> {
+  static constexpr std::string_view Sql =
+      "SELECT i0, i1, d0, d1, s0 FROM T";
+  using Tuple = std::tuple<std::int64_t, std::int64_t, double, double,
+                           std::string_view>;
+  using Pod = Pod5;
+};
+
+template <> struct Shape<10> {
+  static constexpr std::string_view Sql = "SELECT * FROM T";
+  using Tuple =
+      std::tuple<std::int64_t, std::int64_t, std::int64_t, std::int64_t,
+                 double, double, double, std::string_view, std::string_view,
+                 std::string_view>;
+  using Pod = Pod10;
+};
+
+template <class TupleT, std::size_t... Is>
+void readRaw(sqlite3_stmt *Stmt, TupleT &Row, std::index_sequence<Is...>) {
+  auto ReadOne = [Stmt](int Idx, auto &Column) {
+    using ColumnT = std::decay_t<decltype(Column)>;
+    if constexpr (std::is_same_v<ColumnT, std::int64_t>)
+      Column = sqlite3_column_int64(Stmt, Idx);
+    else if constexpr (std::is_same_v<ColumnT, double>)
+      Column = sqlite3_column_double(Stmt, Idx);
+    else
+      Column = std::string_view(
+          reinterpret_cast<char const *>(sqlite3_column_text(Stmt, Idx)),
+          sqlite3_column_bytes(Stmt, Idx));
+  };
+  (ReadOne(Is, std::get<Is>(Row)), ...);
+}
+
+template <class... Ts>
+auto readTupleOf(Statement &Stmt, std::tuple<Ts...> *) {
+  return Stmt.readTuple<Ts...>();
+}
+
+template <class... Ts>
+auto runReadingOf(Statement &Stmt, std::tuple<Ts...> *) {
+  return Stmt.runReading<Ts...>();
+}
+
+template <class... Ts>
+auto runReadingOf(Connection &Conn, std::string_view Sql,
+                  std::tuple<Ts...> *) {
+  return Conn.runReading<Ts...>(Sql);
+}
+
+void BM_PrepareRaw(benchmark::State &State) {
+  auto *Db = openRaw(State);
+  for (auto _ : State) {
+    sqlite3_stmt *Stmt = nullptr;
+    sqlite3_prepare_v2(Db, "SELECT * FROM T WHERE i0 = ?", -1, &Stmt,
+                       nullptr);
+    benchmark::DoNotOptimize(Stmt);
+    sqlite3_finalize(Stmt);
+  }
+  sqlite3_close(Db);
+}
+
+void BM_PrepareWrapper(benchmark::State &State) {
+  auto Conn = openWrapped(State);
+  for (auto _ : State) {
+    auto Stmt = Conn.prepare("SELECT * FROM T WHERE i0 = ?");
+    benchmark::DoNotOptimize(Stmt);
+  }
+}
+
+constexpr std::string_view BindSql = "SELECT ?, ?, ?, ?, ?";
+
+void BM_BindRaw(benchmark::State &State) {
+  auto *Db = openRaw(State);
+  sqlite3_stmt *Stmt = nullptr;
+  sqlite3_prepare_v2(Db, BindSql.data(), BindSql.size(), &Stmt, nullptr);
+  std::string_view Text = "bound text";
+  for (auto _ : State) {
+    sqlite3_bind_int64(Stmt, 1, 1);
+    sqlite3_bind_int64(Stmt, 2, 2);
+    sqlite3_bind_double(Stmt, 3, 3.5);
+    sqlite3_bind_double(Stmt, 4, 4.5);
+    sqlite3_bind_text(Stmt, 5, Text.data(), Text.size(), SQLITE_TRANSIENT);
+  }
+  sqlite3_finalize(Stmt);
+  sqlite3_close(Db);
+}
+
+void BM_BindWrapper(benchmark::State &State) {
+  auto Conn = openWrapped(State);
+  auto Stmt = Conn.prepare(BindSql);
+  std::string_view Text = "bound text";
+  for (auto _ : State) {
+    auto E = Stmt->bindParams(1, std::int64_t(1), std::int64_t(2), 3.5, 4.5,
+                              Text);
+    benchmark::DoNotOptimize(E);
+  }
+}
+
+// Binding a 1 MiB text parameter: 0 = copied (SQLITE_TRANSIENT),
+// 1 = moved into the statement, 2 = borrowed().
+void BM_BindLarge(benchmark::State &State) {
+  auto Conn = openWrapped(State);
+  auto Stmt = Conn.prepare("SELECT length(?)");
+  std::string Payload(1 << 20, 'x');
+  for (auto _ : State) {
+    ExpectedT<void> E;
+    switch (State.range(1)) {
+    case 0:
+      E = Stmt->bindParam(1, Payload);
+      break;
+    case 1: {
+      State.PauseTiming();
+      std::string Moved = Payload;
+      State.ResumeTiming();
+      E = Stmt->bindParam(1, std::move(Moved));
+      break;
+    }
+    default:
+      E = Stmt->bindParam(1, borrowed(Payload));
+    }
+    benchmark::DoNotOptimize(E);
+    (void)Stmt->step();
+    (void)Stmt->reset();
+  }
+  State.SetBytesProcessed(State.iterations() * Payload.size());
+}
+
+template <int Columns> void BM_ReadRaw(benchmark::State &State) {
+  using ShapeT = Shape<Columns>;
+  auto *Db = openRaw(State);
+  sqlite3_stmt *Stmt = nullptr;
+  sqlite3_prepare_v2(Db, ShapeT::Sql.data(), ShapeT::Sql.size(), &Stmt,
+                     nullptr);
+  typename ShapeT::Tuple Row;
+  for (auto _ : State) {
+    while (sqlite3_step(Stmt) == SQLITE_ROW) {
+      readRaw(Stmt, Row,
+              std::make_index_sequence<std::tuple_size_v<decltype(Row)>>());
+      benchmark::DoNotOptimize(Row);
+    }
+    sqlite3_reset(Stmt);
+  }
+  State.SetItemsProcessed(State.iterations() * RowCount);
+  sqlite3_finalize(Stmt);
+  sqlite3_close(Db);
+}
+
+template <int Columns> void BM_ReadTuple(benchmark::State &State) {
+  using ShapeT = Shape<Columns>;
+  auto Conn = openWrapped(State);
+  auto Stmt = Conn.prepare(ShapeT::Sql);
+  for (auto _ : State) {
+    while (*Stmt->step() == Statement::StepOk::STEP_ROW) {
+      auto Row = readTupleOf(*Stmt, (typename ShapeT::Tuple *)nullptr);
+      benchmark::DoNotOptimize(Row);
+    }
+    (void)Stmt->reset();
+  }
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+template <int Columns> void BM_ReadPod(benchmark::State &State) {
+  using ShapeT = Shape<Columns>;
+  auto Conn = openWrapped(State);
+  auto Stmt = Conn.prepare(ShapeT::Sql);
+  for (auto _ : State) {
+    while (*Stmt->step() == Statement::StepOk::STEP_ROW) {
+      auto Row = Stmt->template readPod<typename ShapeT::Pod>();
+      benchmark::DoNotOptimize(Row);
+    }
+    (void)Stmt->reset();
+  }
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+template <int Columns> void BM_StatementGenerator(benchmark::State &State) {
+  using ShapeT = Shape<Columns>;
+  auto Conn = openWrapped(State);
+  auto Stmt = Conn.prepare(ShapeT::Sql);
+  for (auto _ : State) {
+    for (auto &&Row : runReadingOf(*Stmt, (typename ShapeT::Tuple *)nullptr))
+      benchmark::DoNotOptimize(Row);
+    (void)Stmt->reset();
+  }
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+template <int Columns> void BM_ConnectionGenerator(benchmark::State &State) {
+  using ShapeT = Shape<Columns>;
+  auto Conn = openWrapped(State);
+  for (auto _ : State) {
+    for (auto &&Row :
+         runReadingOf(Conn, ShapeT::Sql, (typename ShapeT::Tuple *)nullptr))
+      benchmark::DoNotOptimize(Row);
+  }
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+// Numeric scan aggregate: one generator resume per row vs. per batch.
+void BM_SumRowwise(benchmark::State &State) {
+  auto Conn = openWrapped(State);
+  for (auto _ : State) {
+    double Sum = 0;
+    for (auto &&Row : Conn.runReading<std::int64_t, double>(
+             "SELECT i0, d0 FROM T"))
+      Sum += std::get<0>(*Row) * std::get<1>(*Row);
+    benchmark::DoNotOptimize(Sum);
+  }
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+void BM_SumColumnar(benchmark::State &State) {
+  auto Conn = openWrapped(State);
+  for (auto _ : State) {
+    double Sum = 0;
+    for (auto &&Batch : Conn.runReadingBatched<std::int64_t, double>(
+             "SELECT i0, d0 FROM T", 256)) {
+      auto I0 = Batch->column<0>().Values;
+      auto D0 = Batch->column<1>().Values;
+      for (std::size_t R = 0; R < Batch->Rows; ++R)
+        Sum += I0[R] * D0[R];
+    }
+    benchmark::DoNotOptimize(Sum);
+  }
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+// The same aggregate as a user-defined function, so no row leaves SQLite.
+void BM_SumAggregate(benchmark::State &State) {
+  struct Dot {
+    double Sum{0};
+    void step(std::int64_t I, double D) { Sum += I * D; }
+    auto value() const { return Sum; }
+  };
+  auto Conn = openWrapped(State);
+  (void)Conn.defineAggregate<Dot>("dot");
+  for (auto _ : State) {
+    for (auto &&Row : Conn.runReading<double>("SELECT dot(i0, d0) FROM T"))
+      benchmark::DoNotOptimize(Row);
+  }
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+// Materializing every row with its text: std::string columns (one
+// allocation per cell) vs. queryAll() views into one arena.
+void BM_CollectStrings(benchmark::State &State) {
+  auto Conn = openWrapped(State);
+  for (auto _ : State) {
+    std::vector<std::tuple<std::int64_t, std::string, std::string>> Rows;
+    for (auto &&Row :
+         Conn.runReading<std::int64_t, std::string, std::string>(
+             "SELECT i0, s0, s2 FROM T"))
+      Rows.push_back(std::move(*Row));
+    benchmark::DoNotOptimize(Rows);
+  }
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+void BM_CollectArena(benchmark::State &State) {
+  struct Row {
+    std::int64_t I0;
+    std::string_view S0;
+    std::string_view S2;
+  };
+  auto Conn = openWrapped(State);
+  for (auto _ : State) {
+    auto Rows = Conn.queryAll<Row>("SELECT i0, s0, s2 FROM T");
+    benchmark::DoNotOptimize(Rows);
+  }
+  State.SetItemsProcessed(State.iterations() * RowCount);
+}
+
+// A repeated 100-row query: cache:0 executes it every time, cache:1 replays
+// the materialized result.
+void BM_ReadCached(benchmark::State &State) {
+  auto Conn = openWrapped(State);
+  if (State.range(1))
+    Conn.enableResultCache();
+  for (auto _ : State) {
+    for (auto &&Row : Conn.runReadingCached<std::int64_t, std::string_view>(
+             "SELECT i0, s0 FROM T WHERE i0 <= ?", 100))
+      benchmark::DoNotOptimize(Row);
+  }
+  State.SetItemsProcessed(State.iterations() * 100);
+}
+
+constexpr std::string_view InsertSql = "INSERT INTO T (i0, d0, s0) VALUES "
+                                       "(?, ?, ?)";
+
+void BM_InsertRaw(benchmark::State &State) {
+  auto *Db = openRaw(State);
+  sqlite3_exec(Db, "BEGIN", nullptr, nullptr, nullptr);
+  std::int64_t I = 0;
+  for (auto _ : State) {
+    sqlite3_stmt *Stmt = nullptr;
+    sqlite3_prepare_v2(Db, InsertSql.data(), InsertSql.size(), &Stmt,
+                       nullptr);
+    sqlite3_bind_int64(Stmt, 1, ++I);
+    sqlite3_bind_double(Stmt, 2, 0.5);
+    sqlite3_bind_text(Stmt, 3, "text", 4, SQLITE_TRANSIENT);
+    sqlite3_step(Stmt);
+    sqlite3_finalize(Stmt);
+  }
+  sqlite3_exec(Db, "COMMIT", nullptr, nullptr, nullptr);
+  sqlite3_close(Db);
+}
+
+// Arg 1 is the statement cache capacity; 0 prepares on every run().
+void BM_Run(benchmark::State &State) {
+  auto Conn = openWrapped(State);
+  Conn.setStatementCacheCapacity(State.range(1));
+  (void)Conn.run("BEGIN");
+  std::int64_t I = 0;
+  std::string_view Text = "text";
+  for (auto _ : State) {
+    auto E = Conn.run(InsertSql, ++I, 0.5, Text);
+    benchmark::DoNotOptimize(E);
+  }
+  (void)Conn.run("COMMIT");
+}
+
+// Same as BM_Run with the cache on, plus sqlite3_trace_v2 profiling.
+void BM_RunProfiled(benchmark::State &State) {
+  auto Conn = openWrapped(State);
+  Profiler Prof;
+  Prof.attach(Conn);
+  (void)Conn.run("BEGIN");
+  std::int64_t I = 0;
+  std::string_view Text = "text";
+  for (auto _ : State) {
+    auto E = Conn.run(InsertSql, ++I, 0.5, Text);
+    benchmark::DoNotOptimize(E);
+  }
+  (void)Conn.run("COMMIT");
+  Prof.detach(Conn);
+}
+
+// Same insert through a Query prepared once by a QueryRegistry.
+void BM_RunTyped(benchmark::State &State) {
+  using Insert = Query<"INSERT INTO T (i0, d0, s0) VALUES (?, ?, ?)", Result<>,
+                       Params<std::int64_t, double, std::string_view>>;
+  auto Db = prepareAll<Insert>(openWrapped(State));
+  if (!Db) {
+    State.SkipWithError(std::string(Db.error()).c_str());
+    return;
+  }
+  (void)Db->connection().run("BEGIN");
+  std::int64_t I = 0;
+  std::string_view Text = "text";
+  for (auto _ : State) {
+    auto E = Db->execute<Insert>(++I, 0.5, Text);
+    benchmark::DoNotOptimize(E);
+  }
+  (void)Db->connection().run("COMMIT");
+}
+
+} // namespace
+
+#define STORAGE_ARGS ArgName("disk")->Arg(0)->Arg(1)
+
+BENCHMARK(BM_PrepareRaw)->STORAGE_ARGS;
+BENCHMARK(BM_PrepareWrapper)->STORAGE_ARGS;
+BENCHMARK(BM_BindRaw)->STORAGE_ARGS;
+BENCHMARK(BM_BindWrapper)->STORAGE_ARGS;
+BENCHMARK(BM_BindLarge)
+    ->ArgNames({"disk", "mode"})
+    ->ArgsProduct({{0}, {0, 1, 2}});
+
+BENCHMARK(BM_ReadRaw<1>)->STORAGE_ARGS;
+BENCHMARK(BM_ReadRaw<5>)->STORAGE_ARGS;
+BENCHMARK(BM_ReadRaw<10>)->STORAGE_ARGS;
+BENCHMARK(BM_ReadTuple<1>)->STORAGE_ARGS;
+BENCHMARK(BM_ReadTuple<5>)->STORAGE_ARGS;
+BENCHMARK(BM_ReadTuple<10>)->STORAGE_ARGS;
+BENCHMARK(BM_ReadPod<1>)->STORAGE_ARGS;
+BENCHMARK(BM_ReadPod<5>)->STORAGE_ARGS;
+BENCHMARK(BM_ReadPod<10>)->STORAGE_ARGS;
+
+BENCHMARK(BM_StatementGenerator<1>)->STORAGE_ARGS;
+BENCHMARK(BM_StatementGenerator<10>)->STORAGE_ARGS;
+BENCHMARK(BM_ConnectionGenerator<1>)->STORAGE_ARGS;
+BENCHMARK(BM_ConnectionGenerator<10>)->STORAGE_ARGS;
+
+BENCHMARK(BM_SumRowwise)->STORAGE_ARGS;
+BENCHMARK(BM_SumColumnar)->STORAGE_ARGS;
+BENCHMARK(BM_SumAggregate)->STORAGE_ARGS;
+BENCHMARK(BM_CollectStrings)->STORAGE_ARGS;
+BENCHMARK(BM_CollectArena)->STORAGE_ARGS;
+BENCHMARK(BM_ReadCached)
+    ->ArgNames({"disk", "cache"})
+    ->ArgsProduct({{0, 1}, {0, 1}});
+
+BENCHMARK(BM_InsertRaw)->STORAGE_ARGS;
+BENCHMARK(BM_Run)
+    ->ArgNames({"disk", "cache"})
+    ->ArgsProduct({{0, 1}, {0, StatementCache::DefaultCapacity}});
+BENCHMARK(BM_RunProfiled)->STORAGE_ARGS;
+BENCHMARK(BM_RunTyped)->STORAGE_ARGS;
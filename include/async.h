@@ -0,0 +1,326 @@
+#ifndef ESQLITE_ASYNC_H
+#define ESQLITE_ASYNC_H
+
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "esqlite.h"
+
+namespace esqlite {
+
+// Schedules a suspended coroutine on the caller's executor. When empty, the
+// coroutine is resumed inline on the connection's worker thread; it may then
+// destroy its AsyncConnection, which finishes shutting down once the worker
+// has drained its queue.
+using Resumer = std::function<void(std::coroutine_handle<>)>;
+
+// A Connection owned by a dedicated worker thread. Every operation is queued
+// to the worker and exposed as an awaitable, so awaiting coroutines never
+// block on sqlite3_step(). Awaitables and row streams must not outlive the
+// AsyncConnection they came from. AsyncConnections come only from
+// openAsync(); a moved-from one may only be assigned to or destroyed.
+struct AsyncConnection final {
+  template <class T> struct Awaitable;
+  template <class... ColTs> struct RowStream;
+
+  AsyncConnection() = delete;
+
+  AsyncConnection(AsyncConnection const &) = delete;
+  AsyncConnection &operator=(AsyncConnection const &) = delete;
+
+  AsyncConnection(AsyncConnection &&) noexcept = default;
+  AsyncConnection &operator=(AsyncConnection &&) noexcept = default;
+
+  // Runs Work(Connection &) on the worker thread; the awaiting coroutine
+  // receives its result.
+  template <class F>
+  auto execute(F &&Work) noexcept
+      -> Awaitable<std::invoke_result_t<F, Connection &>>;
+
+  template <class... Ts>
+  auto runAsync(std::string_view Sql, Ts &&...BindParams) noexcept
+      -> Awaitable<ExpectedT<void>>;
+
+  // Compiles Sql into the connection's statement cache on the worker thread,
+  // so that later runAsync()/runReadingAsync() calls skip the parser.
+  auto prepareAsync(std::string_view Sql) noexcept
+      -> Awaitable<ExpectedT<void>>;
+
+  template <class... ColTs, class... Ts>
+  auto runReadingAsync(std::string_view Sql, Ts &&...BindParams) noexcept
+      -> RowStream<ColTs...>;
+
+private:
+  struct Worker {
+    Worker(Connection &&Conn, Resumer &&Resume) noexcept
+        : Conn(std::move(Conn)), Resume(std::move(Resume)),
+          Thread([this] { loop(); }) {}
+
+    // Called instead of delete. A worker released from one of its own jobs
+    // cannot join itself, so it detaches and deletes itself once drained.
+    void retire() noexcept {
+      bool OnWorker = std::this_thread::get_id() == Thread.get_id();
+      {
+        std::lock_guard Lock(Mutex);
+        Stopping = true;
+        DeleteOnExit = OnWorker;
+      }
+      Ready.notify_one();
+      if (OnWorker) {
+        Thread.detach();
+        return;
+      }
+      Thread.join();
+      delete this;
+    }
+
+    void post(std::move_only_function<void()> Job) noexcept {
+      {
+        std::lock_guard Lock(Mutex);
+        Jobs.push_back(std::move(Job));
+      }
+      Ready.notify_one();
+    }
+
+    void resume(std::coroutine_handle<> Handle) noexcept {
+      if (Resume)
+        Resume(Handle);
+      else
+        Handle.resume();
+    }
+
+    // Drains every queued job before exiting, so no awaiter is left hanging.
+    void loop() noexcept {
+      std::unique_lock Lock(Mutex);
+      while (true) {
+        Ready.wait(Lock, [this] { return Stopping || !Jobs.empty(); });
+        if (Jobs.empty()) {
+          if (DeleteOnExit) {
+            Lock.unlock();
+            delete this;
+          }
+          return;
+        }
+        auto Job = std::move(Jobs.front());
+        Jobs.pop_front();
+        Lock.unlock();
+        Job();
+        Lock.lock();
+      }
+    }
+
+    Connection Conn;
+    Resumer Resume;
+    std::mutex Mutex;
+    std::condition_variable Ready;
+    std::deque<std::move_only_function<void()>> Jobs;
+    bool Stopping{false};
+    bool DeleteOnExit{false};
+    std::thread Thread;
+  };
+
+  struct Retire {
+    void operator()(Worker *W) const noexcept { W->retire(); }
+  };
+
+  using WorkerPtr = std::unique_ptr<Worker, Retire>;
+
+  explicit AsyncConnection(WorkerPtr W) noexcept : W(std::move(W)) {}
+
+  friend auto openAsync(std::string_view Path, int Flags,
+                        Resumer Resume) noexcept -> ExpectedT<AsyncConnection>;
+
+private:
+  WorkerPtr W;
+};
+
+template <class T> struct AsyncConnection::Awaitable final {
+  auto await_ready() const noexcept -> bool { return false; }
+
+  void await_suspend(std::coroutine_handle<> Handle) noexcept {
+    W->post([this, Handle] {
+      Result.emplace(Work(W->Conn));
+      W->resume(Handle);
+    });
+  }
+
+  auto await_resume() noexcept -> T { return std::move(*Result); }
+
+private:
+  Awaitable(Worker *W, std::move_only_function<T(Connection &)> Work) noexcept
+      : W(W), Work(std::move(Work)) {}
+
+  friend struct AsyncConnection;
+
+private:
+  Worker *W;
+  std::move_only_function<T(Connection &)> Work;
+  std::optional<T> Result;
+};
+
+// Asynchronous counterpart of runReading(). Rows are decoded on the worker
+// thread in batches, so the columns must own their data: std::string_view
+// and std::span would point into a statement that has moved on.
+//
+//   while (true) {
+//     auto Batch = co_await Stream.next();
+//     if (Batch.empty())
+//       break;
+//     ...
+//   }
+template <class... ColTs> struct AsyncConnection::RowStream final {
+  static_assert(((!std::is_same_v<ColTs, std::string_view> &&
+                  !std::is_same_v<ColTs, std::span<uint8_t const>>) &&
+                 ...),
+                "Row batches outlive the statement; use owning column types");
+
+  using RowT = ExpectedT<std::tuple<ColTs...>>;
+  using BatchT = std::vector<RowT>;
+
+  static constexpr std::size_t DefaultBatchSize = 64;
+
+  RowStream(RowStream const &) = delete;
+  RowStream &operator=(RowStream const &) = delete;
+
+  RowStream(RowStream &&) noexcept = default;
+  RowStream &operator=(RowStream &&) noexcept = default;
+
+  // The statement lease belongs to the connection's cache, so it is released
+  // on the worker thread.
+  ~RowStream() noexcept {
+    if (W && C)
+      W->post([C = std::move(C)] {});
+  }
+
+  // Yields up to BatchSize rows. An empty batch marks the end of the stream;
+  // an error row is always the last row of its batch.
+  auto next(std::size_t BatchSize = DefaultBatchSize) noexcept
+      -> Awaitable<BatchT> {
+    return {W, [C = C, BatchSize](Connection &) {
+              BatchT Batch;
+              if (C->Done)
+                return Batch;
+              if (!C->Stmt) [[unlikely]] {
+                C->Done = true;
+                Batch.push_back(std::unexpected(C->Stmt.error()));
+                return Batch;
+              }
+
+              Batch.reserve(BatchSize);
+              while (Batch.size() < BatchSize) {
+                auto E = (*C->Stmt)->step();
+                if (!E) [[unlikely]] {
+                  C->Done = true;
+                  Batch.push_back(std::unexpected(E.error()));
+                  break;
+                }
+                if (*E == Statement::StepOk::STEP_DONE) {
+                  C->Done = true;
+                  break;
+                }
+                if (*E == Statement::StepOk::STEP_BUSY) [[unlikely]] {
+                  C->Done = true;
+                  Batch.push_back(std::unexpected("Db is busy"));
+                  break;
+                }
+                Batch.push_back((*C->Stmt)->template readTuple<ColTs...>());
+              }
+              return Batch;
+            }};
+  }
+
+private:
+  struct Cursor {
+    ExpectedT<CachedStatement> Stmt;
+    bool Done{false};
+  };
+
+  RowStream(Worker *W, std::shared_ptr<Cursor> C) noexcept : W(W), C(C) {}
+
+  friend struct AsyncConnection;
+
+private:
+  Worker *W;
+  std::shared_ptr<Cursor> C;
+};
+
+template <class F>
+auto AsyncConnection::execute(F &&Work) noexcept
+    -> Awaitable<std::invoke_result_t<F, Connection &>> {
+  return {W.get(), std::forward<F>(Work)};
+}
+
+template <class... Ts>
+auto AsyncConnection::runAsync(std::string_view Sql,
+                               Ts &&...BindParams) noexcept
+    -> Awaitable<ExpectedT<void>> {
+  return execute([Sql = std::string(Sql),
+                  Params = std::tuple<std::decay_t<Ts>...>(
+                      std::forward<Ts>(BindParams)...)](Connection &Conn) {
+    return std::apply(
+        [&](auto &...Ps) { return Conn.run(Sql, Ps...); }, Params);
+  });
+}
+
+inline auto AsyncConnection::prepareAsync(std::string_view Sql) noexcept
+    -> Awaitable<ExpectedT<void>> {
+  return execute([Sql = std::string(Sql)](Connection &Conn) -> ExpectedT<void> {
+    auto Stmt = Conn.prepareCached(Sql);
+    if (!Stmt) [[unlikely]]
+      return std::unexpected(Stmt.error());
+    return {};
+  });
+}
+
+template <class... ColTs, class... Ts>
+auto AsyncConnection::runReadingAsync(std::string_view Sql,
+                                      Ts &&...BindParams) noexcept
+    -> RowStream<ColTs...> {
+  using StreamT = RowStream<ColTs...>;
+  auto C = std::make_shared<typename StreamT::Cursor>();
+  // Prepared and bound on the worker thread by a job posted now; jobs run
+  // in order, so it is done before the first next() is served.
+  C->Stmt = std::unexpected("Stream not started");
+  W->post([C, Sql = std::string(Sql),
+           Params = std::tuple<std::decay_t<Ts>...>(
+               std::forward<Ts>(BindParams)...),
+           Conn = &W->Conn]() mutable {
+    C->Stmt = Conn->prepareCached(Sql);
+    if (!C->Stmt) [[unlikely]]
+      return;
+    auto Bind = [&](auto &...Ps) { return (*C->Stmt)->bindParams(1, Ps...); };
+    if (auto E = std::apply(Bind, Params); !E) [[unlikely]]
+      C->Stmt = std::unexpected(E.error());
+  });
+  return StreamT(W.get(), std::move(C));
+}
+
+inline auto openAsync(std::string_view Path,
+                      int Flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+                      Resumer Resume = {}) noexcept
+    -> ExpectedT<AsyncConnection> {
+  auto Conn = open_v2(Path, Flags);
+  if (!Conn) [[unlikely]]
+    return std::unexpected(Conn.error());
+  return {AsyncConnection(AsyncConnection::WorkerPtr(
+      new AsyncConnection::Worker(std::move(*Conn), std::move(Resume))))};
+}
+
+} // namespace esqlite
+
+#endif // ESQLITE_ASYNC_H
@@ -0,0 +1,816 @@
+#ifndef ESQLITE_BULK_IO_H
+#define ESQLITE_BULK_IO_H
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "esqlite.h"
+#include "snapshot.h"
+
+namespace esqlite {
+
+enum class BulkFormat {
+  // RFC 4180: comma separated, fields optionally "quoted" with "" as an
+  // escaped quote and line breaks allowed inside quotes.
+  Csv,
+  // One flat JSON object per line; keys name the columns.
+  Ndjson,
+};
+
+struct ImportOptions {
+  BulkFormat Format{BulkFormat::Csv};
+  char Delimiter{','};
+  // CSV only: the first record holds the column names. Without it the
+  // columns are named c1, c2, ...
+  bool Header{true};
+  // 0 uses std::thread::hardware_concurrency().
+  std::size_t ParserThreads{0};
+  // Input is cut into chunks of about this size at record boundaries.
+  std::size_t ChunkSize{std::size_t(4) << 20};
+  // Parsed chunks waiting for the inserter, at most. Bounds memory when
+  // parsing outruns inserting.
+  std::size_t QueueDepth{8};
+  // Rows per transaction; 0 imports everything in one.
+  std::size_t CommitEvery{0};
+};
+
+struct ExportOptions {
+  BulkFormat Format{BulkFormat::Csv};
+  char Delimiter{','};
+  // CSV only: write the column names first.
+  bool Header{true};
+  // Output is collected up to this size before each write.
+  std::size_t BufferSize{std::size_t(1) << 20};
+};
+
+struct TransferStats {
+  std::uint64_t Rows{0};
+  std::uint64_t Bytes{0};
+  std::chrono::nanoseconds Elapsed{0};
+
+  auto megabytesPerSecond() const noexcept -> double {
+    auto Seconds = std::chrono::duration<double>(Elapsed).count();
+    return Seconds > 0 ? double(Bytes) / 1e6 / Seconds : 0;
+  }
+};
+
+namespace detail {
+
+inline auto quoteIdentifier(std::string_view Name) -> std::string {
+  std::string Quoted = "\"";
+  for (char C : Name) {
+    Quoted += C;
+    if (C == '"')
+      Quoted += '"';
+  }
+  return Quoted += '"';
+}
+
+// One parsed field. Text points into the mapped input, or into the chunk's
+// arena when it had to be unescaped.
+struct Cell {
+  enum Kind : std::uint8_t { Null, Integer, Real, Text };
+  Kind Type{Null};
+  std::int64_t Int{0};
+  double Float{0};
+  std::string_view Str;
+};
+
+struct ParsedChunk {
+  std::vector<Cell> Cells;
+  std::size_t Rows{0};
+  ByteArena Arena;
+  std::string_view Error;
+};
+
+struct CsvParser {
+  char Delimiter;
+
+  // Parses one record starting at P; returns false at the end of input.
+  // Fields past Columns are dropped, missing ones stay NULL.
+  auto record(char const *&P, char const *End, std::size_t Columns,
+              Cell *Out, ByteArena &Arena, std::string &Scratch) const
+      -> bool {
+    if (P == End)
+      return false;
+    std::size_t Column = 0;
+    while (true) {
+      std::string_view Field;
+      if (*P == '"') {
+        auto const *Start = ++P;
+        bool Escaped = false;
+        while (P != End) {
+          if (*P == '"') {
+            if (P + 1 != End && P[1] == '"') {
+              Escaped = true;
+              P += 2;
+              continue;
+            }
+            break;
+          }
+          ++P;
+        }
+        Field = {Start, std::size_t(P - Start)};
+        if (P != End)
+          ++P;
+        if (Escaped) {
+          Scratch.clear();
+          for (std::size_t I = 0; I < Field.size(); ++I) {
+            Scratch += Field[I];
+            I += Field[I] == '"';
+          }
+          Field = {reinterpret_cast<char const *>(
+                       Arena.copy(Scratch.data(), Scratch.size())),
+                   Scratch.size()};
+        }
+        // Anything between the closing quote and the delimiter is dropped.
+        while (P != End && *P != Delimiter && *P != '\n')
+          ++P;
+      } else {
+        auto const *Start = P;
+        while (P != End && *P != Delimiter && *P != '\n')
+          ++P;
+        Field = {Start, std::size_t(P - Start)};
+        if (!Field.empty() && Field.back() == '\r' &&
+            (P == End || *P == '\n'))
+          Field.remove_suffix(1);
+      }
+
+      if (Column < Columns)
+        Out[Column] = {Cell::Text, 0, 0, Field};
+      ++Column;
+      if (P == End)
+        return true;
+      if (*P++ == '\n')
+        return true;
+    }
+  }
+};
+
+struct JsonParser {
+  static void skipSpace(char const *&P, char const *End) noexcept {
+    while (P != End && (*P == ' ' || *P == '\t' || *P == '\r'))
+      ++P;
+  }
+
+  static void appendUtf8(std::string &Out, std::uint32_t Code) {
+    if (Code < 0x80) {
+      Out += char(Code);
+    } else if (Code < 0x800) {
+      Out += char(0xC0 | Code >> 6);
+      Out += char(0x80 | (Code & 0x3F));
+    } else if (Code < 0x10000) {
+      Out += char(0xE0 | Code >> 12);
+      Out += char(0x80 | (Code >> 6 & 0x3F));
+      Out += char(0x80 | (Code & 0x3F));
+    } else {
+      Out += char(0xF0 | Code >> 18);
+      Out += char(0x80 | (Code >> 12 & 0x3F));
+      Out += char(0x80 | (Code >> 6 & 0x3F));
+      Out += char(0x80 | (Code & 0x3F));
+    }
+  }
+
+  static auto hex4(char const *P, char const *End, std::uint32_t &Code)
+      -> bool {
+    if (End - P < 4)
+      return false;
+    auto [Ptr, Ec] = std::from_chars(P, P + 4, Code, 16);
+    return Ec == std::errc() && Ptr == P + 4;
+  }
+
+  // P is just past the opening quote. Strings without escapes are returned
+  // in place; others are decoded into the arena.
+  static auto string(char const *&P, char const *End, ByteArena &Arena,
+                     std::string &Scratch, std::string_view &Out) -> bool {
+    auto const *Start = P;
+    while (P != End && *P != '"' && *P != '\\')
+      ++P;
+    if (P == End)
+      return false;
+    if (*P == '"') {
+      Out = {Start, std::size_t(P++ - Start)};
+      return true;
+    }
+
+    Scratch.assign(Start, P);
+    while (P != End && *P != '"') {
+      if (*P != '\\') {
+        Scratch += *P++;
+        continue;
+      }
+      if (++P == End)
+        return false;
+      switch (char C = *P++) {
+      case 'b': Scratch += '\b'; break;
+      case 'f': Scratch += '\f'; break;
+      case 'n': Scratch += '\n'; break;
+      case 'r': Scratch += '\r'; break;
+      case 't': Scratch += '\t'; break;
+      case 'u': {
+        std::uint32_t Code = 0;
+        if (!hex4(P, End, Code))
+          return false;
+        P += 4;
+        std::uint32_t Low = 0;
+        if (Code >= 0xD800 && Code < 0xDC00 && End - P >= 6 && P[0] == '\\' &&
+            P[1] == 'u' && hex4(P + 2, End, Low) && Low >= 0xDC00 &&
+            Low < 0xE000) {
+          Code = 0x10000 + ((Code - 0xD800) << 10) + (Low - 0xDC00);
+          P += 6;
+        }
+        appendUtf8(Scratch, Code);
+        break;
+      }
+      default: Scratch += C; break;
+      }
+    }
+    if (P == End)
+      return false;
+    ++P;
+    Out = {reinterpret_cast<char const *>(
+               Arena.copy(Scratch.data(), Scratch.size())),
+           Scratch.size()};
+    return true;
+  }
+
+  // Nested objects and arrays are kept as their JSON text.
+  static auto raw(char const *&P, char const *End) -> bool {
+    int Depth = 0;
+    while (P != End) {
+      char C = *P++;
+      if (C == '"') {
+        while (P < End && *P != '"')
+          if (*P++ == '\\' && P++ == End)
+            return false;
+        if (P >= End)
+          return false;
+        ++P;
+      } else if (C == '{' || C == '[') {
+        ++Depth;
+      } else if ((C == '}' || C == ']') && --Depth == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static auto value(char const *&P, char const *End, ByteArena &Arena,
+                    std::string &Scratch, Cell &Out) -> bool {
+    if (P == End)
+      return false;
+    auto const *Start = P;
+    switch (*P) {
+    case '"':
+      Out.Type = Cell::Text;
+      return string(++P, End, Arena, Scratch, Out.Str);
+    case '{':
+    case '[':
+      Out.Type = Cell::Text;
+      if (!raw(P, End))
+        return false;
+      Out.Str = {Start, std::size_t(P - Start)};
+      return true;
+    case 't':
+    case 'f':
+    case 'n': {
+      std::string_view Word = *P == 't' ? "true" : *P == 'f' ? "false" : "null";
+      if (std::string_view(P, std::min<std::size_t>(End - P, Word.size())) !=
+          Word)
+        return false;
+      P += Word.size();
+      Out = Cell{};
+      if (Word != "null") {
+        Out.Type = Cell::Integer;
+        Out.Int = Word == "true" ? 1 : 0;
+      }
+      return true;
+    }
+    }
+
+    while (P != End && (std::isdigit(static_cast<unsigned char>(*P)) ||
+                        *P == '-' || *P == '+' || *P == '.' || *P == 'e' ||
+                        *P == 'E'))
+      ++P;
+    if (P == Start)
+      return false;
+    if (std::from_chars(Start, P, Out.Int).ptr == P) {
+      Out.Type = Cell::Integer;
+      return true;
+    }
+    // Fractions, exponents and integers too large for 64 bits.
+    Out.Type = Cell::Real;
+    return std::from_chars(Start, P, Out.Float).ptr == P;
+  }
+
+  // Parses the object on one line into the cells of the matching columns;
+  // unknown keys are ignored. Calls OnKey(Key) for every key if given.
+  template <class KeyFn>
+  static auto record(char const *&P, char const *End,
+                     std::unordered_map<std::string_view, std::size_t> const
+                         &Columns,
+                     Cell *Out, ByteArena &Arena, std::string &Scratch,
+                     KeyFn &&OnKey) -> bool {
+    auto const *LineEnd = std::find(P, End, '\n');
+    auto Fail = [&] {
+      P = LineEnd == End ? End : LineEnd + 1;
+      return false;
+    };
+    skipSpace(P, LineEnd);
+    if (P == LineEnd || *P++ != '{')
+      return Fail();
+    skipSpace(P, LineEnd);
+    if (P != LineEnd && *P == '}') {
+      ++P;
+    } else {
+      while (true) {
+        std::string_view Key;
+        skipSpace(P, LineEnd);
+        if (P == LineEnd || *P++ != '"' ||
+            !string(P, LineEnd, Arena, Scratch, Key))
+          return Fail();
+        OnKey(Key);
+        skipSpace(P, LineEnd);
+        if (P == LineEnd || *P++ != ':')
+          return Fail();
+        skipSpace(P, LineEnd);
+        Cell Value;
+        if (!value(P, LineEnd, Arena, Scratch, Value))
+          return Fail();
+        if (auto It = Columns.find(Key); It != Columns.end())
+          Out[It->second] = Value;
+        skipSpace(P, LineEnd);
+        if (P == LineEnd)
+          return Fail();
+        if (*P == '}') {
+          ++P;
+          break;
+        }
+        if (*P++ != ',')
+          return Fail();
+      }
+    }
+    skipSpace(P, LineEnd);
+    if (P != LineEnd)
+      return Fail();
+    P = LineEnd == End ? End : LineEnd + 1;
+    return true;
+  }
+};
+
+// Cuts [Begin, Size) into chunks of about ChunkSize ending on a record
+// boundary. CSV needs quote tracking, since quoted fields may span lines;
+// this is one sequential pass over the bytes.
+inline auto splitChunks(std::span<std::byte const> Input, std::size_t Begin,
+                        std::size_t ChunkSize, bool TrackQuotes)
+    -> std::vector<std::size_t> {
+  auto const *Data = reinterpret_cast<char const *>(Input.data());
+  auto Size = Input.size();
+  std::vector<std::size_t> Bounds{Begin};
+  bool InQuotes = false;
+  auto Pos = Begin;
+  while (Pos < Size) {
+    auto Target = std::min(Size, Bounds.back() + std::max<std::size_t>(
+                                                     ChunkSize, 1));
+    if (TrackQuotes)
+      InQuotes ^= std::count(Data + Pos, Data + Target, '"') & 1;
+    Pos = Target;
+    while (Pos < Size) {
+      char C = Data[Pos++];
+      if (C == '"' && TrackQuotes)
+        InQuotes = !InQuotes;
+      else if (C == '\n' && !InQuotes)
+        break;
+    }
+    Bounds.push_back(Pos);
+  }
+  return Bounds;
+}
+
+inline void appendCsvField(std::string &Out, std::string_view Field,
+                           char Delimiter) {
+  if (Field.find_first_of(std::string{Delimiter, '"', '\n', '\r'}) ==
+      std::string_view::npos) {
+    Out += Field;
+    return;
+  }
+  Out += '"';
+  for (char C : Field) {
+    Out += C;
+    if (C == '"')
+      Out += '"';
+  }
+  Out += '"';
+}
+
+inline void appendJsonString(std::string &Out, std::string_view Text) {
+  static constexpr char Hex[] = "0123456789abcdef";
+  Out += '"';
+  for (char C : Text) {
+    switch (C) {
+    case '"': Out += "\\\""; break;
+    case '\\': Out += "\\\\"; break;
+    case '\n': Out += "\\n"; break;
+    case '\r': Out += "\\r"; break;
+    case '\t': Out += "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(C) < 0x20) {
+        Out += "\\u00";
+        Out += Hex[C >> 4];
+        Out += Hex[C & 0xF];
+      } else {
+        Out += C;
+      }
+    }
+  }
+  Out += '"';
+}
+
+template <class T> void appendNumber(std::string &Out, T Value) {
+  char Buffer[32];
+  auto [End, Ec] = std::to_chars(Buffer, Buffer + sizeof(Buffer), Value);
+  Out.append(Buffer, End);
+  // Keep reals real when the output is imported again.
+  if constexpr (std::is_floating_point_v<T>)
+    if (std::find_if(Buffer, End, [](char C) {
+          return C == '.' || C == 'e';
+        }) == End)
+      Out += ".0";
+}
+
+} // namespace detail
+
+// Loads the file at Path into Table, creating it (with untyped columns, as
+// the sqlite3 shell's .import does) if it does not exist. CSV fields are
+// bound as text and positionally; NDJSON values keep their JSON type and
+// are matched to columns by key.
+//
+// The input is memory-mapped and cut into chunks that ParserThreads parse
+// concurrently. Parsed chunks reach the calling thread, the only user of
+// Conn, in file order through a queue at most QueueDepth deep; it inserts
+// them with one reused statement inside large transactions. Open Conn with
+// the BulkLoad profile (open_options.h) for the fastest load.
+inline auto importFile(Connection &Conn, std::string_view Path,
+                       std::string_view Table,
+                       ImportOptions const &Options = {}) noexcept
+    -> ExpectedT<TransferStats> {
+  auto Start = std::chrono::steady_clock::now();
+  auto File = detail::MappedFile::open(std::string(Path));
+  if (!File) [[unlikely]]
+    return std::unexpected(File.error());
+  auto Input = std::span<std::byte const>((*File)->bytes());
+  auto const *Data = reinterpret_cast<char const *>(Input.data());
+  auto const *DataEnd = Data + Input.size();
+  bool Csv = Options.Format == BulkFormat::Csv;
+  detail::CsvParser CsvRecord{Options.Delimiter};
+
+  // Column names come from the first record, which is then either skipped
+  // (a CSV header) or imported like the rest.
+  std::vector<std::string> Names;
+  std::size_t DataBegin = 0;
+  {
+    ByteArena Arena;
+    std::string Scratch;
+    auto const *P = Data;
+    if (Csv) {
+      std::vector<detail::Cell> First(1024);
+      CsvRecord.record(P, DataEnd, First.size(), First.data(), Arena,
+                       Scratch);
+      for (std::size_t I = 0; I < First.size() && First[I].Type; ++I)
+        Names.push_back(Options.Header ? std::string(First[I].Str)
+                                       : "c" + std::to_string(I + 1));
+      if (Options.Header)
+        DataBegin = std::size_t(P - Data);
+    } else {
+      detail::Cell Ignored;
+      std::unordered_map<std::string_view, std::size_t> None;
+      while (P != DataEnd && std::isspace(static_cast<unsigned char>(*P)))
+        ++P;
+      if (P != DataEnd &&
+          !detail::JsonParser::record(
+              P, DataEnd, None, &Ignored, Arena, Scratch,
+              [&](std::string_view Key) { Names.emplace_back(Key); }))
+          [[unlikely]]
+        return std::unexpected("Malformed NDJSON record");
+    }
+  }
+  if (Names.empty()) [[unlikely]]
+    return TransferStats{0, Input.size(),
+                         std::chrono::steady_clock::now() - Start};
+
+  auto Quoted = detail::quoteIdentifier(Table);
+  std::string Create = "CREATE TABLE IF NOT EXISTS " + Quoted + " (";
+  for (auto const &Name : Names)
+    Create += detail::quoteIdentifier(Name) + ", ";
+  Create.replace(Create.size() - 2, 2, ")");
+  if (auto E = Conn.run(Create); !E) [[unlikely]]
+    return std::unexpected(E.error());
+
+  // The table decides the columns; it may have existed already.
+  std::vector<std::string> Columns;
+  {
+    auto Probe = Conn.prepare("SELECT * FROM " + Quoted + " LIMIT 0");
+    if (!Probe) [[unlikely]]
+      return std::unexpected(Probe.error());
+    auto *Handle = Probe->nativeHandle();
+    for (int I = 0; I < sqlite3_column_count(Handle); ++I)
+      Columns.emplace_back(sqlite3_column_name(Handle, I));
+  }
+  std::unordered_map<std::string_view, std::size_t> ColumnIndex;
+  for (std::size_t I = 0; I < Columns.size(); ++I)
+    ColumnIndex.emplace(Columns[I], I);
+  auto Width = Columns.size();
+
+  std::string Insert = "INSERT INTO " + Quoted + " VALUES (";
+  for (std::size_t I = 0; I < Width; ++I)
+    Insert += I ? ", ?" : "?";
+  Insert += ")";
+  auto Stmt = Conn.prepare(Insert);
+  if (!Stmt) [[unlikely]]
+    return std::unexpected(Stmt.error());
+
+  auto Bounds = detail::splitChunks(Input, DataBegin, Options.ChunkSize, Csv);
+  auto ChunkCount = Bounds.size() - 1;
+
+  std::mutex Mutex;
+  std::condition_variable Changed;
+  std::map<std::size_t, detail::ParsedChunk> Ready;
+  std::size_t NextClaim = 0, NextInsert = 0;
+  bool Stopped = false;
+  auto Depth = std::max<std::size_t>(Options.QueueDepth, 1);
+
+  auto Parse = [&](std::size_t Index) {
+    detail::ParsedChunk Chunk;
+    std::string Scratch;
+    auto const *P = Data + Bounds[Index];
+    auto const *End = Data + Bounds[Index + 1];
+    while (P != End) {
+      // Blank lines are not records.
+      if (*P == '\n' || (*P == '\r' && P + 1 != End && P[1] == '\n')) {
+        P += *P == '\r' ? 2 : 1;
+        continue;
+      }
+      Chunk.Cells.resize(Chunk.Cells.size() + Width);
+      auto *Row = Chunk.Cells.data() + Chunk.Cells.size() - Width;
+      if (Csv) {
+        CsvRecord.record(P, End, Width, Row, Chunk.Arena, Scratch);
+      } else if (!detail::JsonParser::record(P, End, ColumnIndex, Row,
+                                             Chunk.Arena, Scratch,
+                                             [](std::string_view) {}))
+          [[unlikely]] {
+        Chunk.Error = "Malformed NDJSON record";
+        break;
+      }
+      ++Chunk.Rows;
+    }
+    return Chunk;
+  };
+
+  auto Work = [&] {
+    while (true) {
+      std::size_t Index;
+      {
+        std::unique_lock Lock(Mutex);
+        Changed.wait(Lock, [&] {
+          return Stopped || NextClaim >= ChunkCount ||
+                 NextClaim < NextInsert + Depth;
+        });
+        if (Stopped || NextClaim >= ChunkCount)
+          return;
+        Index = NextClaim++;
+      }
+      auto Chunk = Parse(Index);
+      std::lock_guard Lock(Mutex);
+      Ready.emplace(Index, std::move(Chunk));
+      Changed.notify_all();
+    }
+  };
+
+  auto Threads = Options.ParserThreads ? Options.ParserThreads
+                                       : std::thread::hardware_concurrency();
+  Threads = std::clamp<std::size_t>(Threads, 1, std::max<std::size_t>(
+                                                    ChunkCount, 1));
+  std::vector<std::jthread> Parsers;
+  Parsers.reserve(Threads);
+  for (std::size_t I = 0; I < Threads; ++I)
+    Parsers.emplace_back(Work);
+  auto Stop = [&] {
+    std::lock_guard Lock(Mutex);
+    Stopped = true;
+    Changed.notify_all();
+  };
+
+  TransferStats Stats;
+  Stats.Bytes = Input.size();
+  bool OwnTransaction = sqlite3_get_autocommit(Conn.nativeHandle());
+  std::size_t InTransaction = 0;
+  auto Fail = [&](std::string_view Error) -> ExpectedT<TransferStats> {
+    Stop();
+    if (OwnTransaction && InTransaction)
+      (void)Conn.run("ROLLBACK");
+    return std::unexpected(Error);
+  };
+
+  for (std::size_t Index = 0; Index < ChunkCount; ++Index) {
+    detail::ParsedChunk Chunk;
+    {
+      std::unique_lock Lock(Mutex);
+      Changed.wait(Lock, [&] { return Ready.contains(Index); });
+      auto Node = Ready.extract(Index);
+      Chunk = std::move(Node.mapped());
+      NextInsert = Index + 1;
+      Changed.notify_all();
+    }
+    if (!Chunk.Error.empty()) [[unlikely]]
+      return Fail(Chunk.Error);
+
+    for (std::size_t R = 0; R < Chunk.Rows; ++R) {
+      if (OwnTransaction && !InTransaction) {
+        if (auto E = Conn.run("BEGIN IMMEDIATE"); !E) [[unlikely]]
+          return Fail(E.error());
+      }
+      auto const *Row = Chunk.Cells.data() + R * Width;
+      for (std::size_t C = 0; C < Width; ++C) {
+        auto const &V = Row[C];
+        unsigned Ind = unsigned(C + 1);
+        auto E = V.Type == detail::Cell::Text ? Stmt->bindText(Ind, V.Str, true)
+                 : V.Type == detail::Cell::Integer
+                     ? Stmt->bindNumeric(Ind, V.Int)
+                 : V.Type == detail::Cell::Real
+                     ? Stmt->bindNumeric(Ind, V.Float)
+                     : Stmt->bindNull(Ind);
+        if (!E) [[unlikely]]
+          return Fail(E.error());
+      }
+      auto Step = Stmt->step();
+      (void)Stmt->reset();
+      if (!Step) [[unlikely]]
+        return Fail(Step.error());
+      if (*Step == Statement::StepOk::STEP_BUSY) [[unlikely]]
+        return Fail("Db is busy");
+      ++Stats.Rows;
+      if (OwnTransaction && ++InTransaction == Options.CommitEvery) {
+        if (auto E = Conn.run("COMMIT"); !E) [[unlikely]]
+          return Fail(E.error());
+        InTransaction = 0;
+      }
+    }
+  }
+  Parsers.clear();
+  if (OwnTransaction && InTransaction) {
+    if (auto E = Conn.run("COMMIT"); !E) [[unlikely]]
+      return Fail(E.error());
+  }
+  Stats.Elapsed = std::chrono::steady_clock::now() - Start;
+  return Stats;
+}
+
+// Writes the result of Sql to Out, collecting output in a buffer of
+// Options.BufferSize between writes. Columns are exported with whatever
+// type each value has, so any query works. CSV writes NULL as an empty
+// field; NDJSON writes blobs as hex strings.
+inline auto exportQuery(Connection &Conn, std::string_view Sql,
+                        std::FILE *Out,
+                        ExportOptions const &Options = {}) noexcept
+    -> ExpectedT<TransferStats> {
+  auto Start = std::chrono::steady_clock::now();
+  auto Stmt = Conn.prepare(Sql);
+  if (!Stmt) [[unlikely]]
+    return std::unexpected(Stmt.error());
+  auto *Handle = Stmt->nativeHandle();
+  int Width = sqlite3_column_count(Handle);
+  bool Csv = Options.Format == BulkFormat::Csv;
+
+  TransferStats Stats;
+  std::string Buffer;
+  Buffer.reserve(Options.BufferSize + 4096);
+  auto Flush = [&] {
+    auto Written = std::fwrite(Buffer.data(), 1, Buffer.size(), Out);
+    Stats.Bytes += Written;
+    bool Ok = Written == Buffer.size();
+    Buffer.clear();
+    return Ok;
+  };
+
+  // NDJSON keys, with their quotes and colon, prepared once.
+  std::vector<std::string> Keys(Width);
+  for (int C = 0; C < Width; ++C) {
+    std::string_view Name = sqlite3_column_name(Handle, C);
+    if (Csv) {
+      if (Options.Header) {
+        if (C)
+          Buffer += Options.Delimiter;
+        detail::appendCsvField(Buffer, Name, Options.Delimiter);
+      }
+    } else {
+      Keys[C] = C ? "," : "{";
+      detail::appendJsonString(Keys[C], Name);
+      Keys[C] += ':';
+    }
+  }
+  if (Csv && Options.Header && Width)
+    Buffer += '\n';
+
+  while (true) {
+    auto E = Stmt->step();
+    if (!E) [[unlikely]]
+      return std::unexpected(E.error());
+    if (*E == Statement::StepOk::STEP_DONE)
+      break;
+    if (*E == Statement::StepOk::STEP_BUSY) [[unlikely]]
+      return std::unexpected("Db is busy");
+
+    for (int C = 0; C < Width; ++C) {
+      if (Csv && C)
+        Buffer += Options.Delimiter;
+      if (!Csv)
+        Buffer += Keys[C];
+      switch (sqlite3_column_type(Handle, C)) {
+      case SQLITE_INTEGER:
+        detail::appendNumber(Buffer, sqlite3_column_int64(Handle, C));
+        break;
+      case SQLITE_FLOAT: {
+        double D = sqlite3_column_double(Handle, C);
+        if (std::isfinite(D))
+          detail::appendNumber(Buffer, D);
+        else if (!Csv)
+          Buffer += "null";
+        break;
+      }
+      case SQLITE_NULL:
+        if (!Csv)
+          Buffer += "null";
+        break;
+      case SQLITE_BLOB:
+        if (!Csv) {
+          static constexpr char Hex[] = "0123456789abcdef";
+          auto const *Bytes = static_cast<unsigned char const *>(
+              sqlite3_column_blob(Handle, C));
+          Buffer += '"';
+          for (int I = 0; I < sqlite3_column_bytes(Handle, C); ++I) {
+            Buffer += Hex[Bytes[I] >> 4];
+            Buffer += Hex[Bytes[I] & 0xF];
+          }
+          Buffer += '"';
+          break;
+        }
+        [[fallthrough]];
+      default: {
+        auto const *Text = sqlite3_column_blob(Handle, C);
+        std::string_view Value(static_cast<char const *>(Text),
+                               Text ? sqlite3_column_bytes(Handle, C) : 0);
+        if (Csv)
+          detail::appendCsvField(Buffer, Value, Options.Delimiter);
+        else
+          detail::appendJsonString(Buffer, Value);
+      }
+      }
+    }
+    Buffer += Csv ? "\n" : Width ? "}\n" : "{}\n";
+    ++Stats.Rows;
+    if (Buffer.size() >= Options.BufferSize && !Flush()) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(SQLITE_IOERR_WRITE));
+  }
+  if (!Flush() || std::fflush(Out)) [[unlikely]]
+    return std::unexpected(sqlite3_errstr(SQLITE_IOERR_WRITE));
+  Stats.Elapsed = std::chrono::steady_clock::now() - Start;
+  return Stats;
+}
+
+inline auto exportQuery(Connection &Conn, std::string_view Sql,
+                        std::string_view Path,
+                        ExportOptions const &Options = {}) noexcept
+    -> ExpectedT<TransferStats> {
+  auto *Out = std::fopen(std::string(Path).c_str(), "wb");
+  if (!Out) [[unlikely]]
+    return std::unexpected(sqlite3_errstr(SQLITE_CANTOPEN));
+  auto Stats = exportQuery(Conn, Sql, Out, Options);
+  if (std::fclose(Out) && Stats) [[unlikely]]
+    return std::unexpected(sqlite3_errstr(SQLITE_IOERR_WRITE));
+  return Stats;
+}
+
+} // namespace esqlite
+
+#endif // ESQLITE_BULK_IO_H
@@ -0,0 +1,372 @@
+#ifndef ESQLITE_CHANGE_FEED_H
+#define ESQLITE_CHANGE_FEED_H
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <sqlite3.h>
+
+namespace esqlite {
+
+// A column value as SQLite stores it; std::monostate is NULL.
+using ChangeValue = std::variant<std::monostate, std::int64_t, double,
+                                 std::string, std::vector<std::uint8_t>>;
+
+enum class ChangeOp { Insert, Update, Delete };
+
+struct ChangeEvent {
+  ChangeOp Op{ChangeOp::Insert};
+  std::string Table;
+  // After the change, or before it for a Delete. OldRowId differs only if
+  // an Update moved the row.
+  std::int64_t RowId{0};
+  std::int64_t OldRowId{0};
+  // Every column in table order: Old for Update and Delete, New for Insert
+  // and Update. Both stay empty unless SQLite was built with
+  // SQLITE_ENABLE_PREUPDATE_HOOK; rowid tables are then reported through
+  // sqlite3_update_hook() without values.
+  std::vector<ChangeValue> Old;
+  std::vector<ChangeValue> New;
+};
+
+// The changes of one committed transaction, in statement order.
+struct ChangeBatch {
+  // Consecutive from 1 for the lifetime of the feed.
+  std::uint64_t Sequence{0};
+  std::vector<ChangeEvent> Events;
+};
+
+struct ChangeOptions {
+  // Tables of the main schema to capture; empty captures all of them
+  // except SQLite's internal sqlite_* tables.
+  std::vector<std::string> Tables;
+  // Committed batches waiting for the consumer, at most. A commit that
+  // finds the queue full waits for the consumer, which slows the writer
+  // down instead of losing changes.
+  std::size_t QueueCapacity{1024};
+};
+
+struct ChangeFeedStats {
+  std::uint64_t Batches{0};
+  std::uint64_t Events{0};
+  // Commits that had to wait for room in the queue.
+  std::uint64_t Stalls{0};
+};
+
+namespace detail {
+
+// Bounded lock-free queue for exactly one producer and one consumer
+// thread. Each side caches the other's index and only rereads it (one
+// shared cache line) when the cached value says the queue is full or empty.
+template <class T> struct SpscRing {
+  explicit SpscRing(std::size_t Capacity)
+      : Slots(std::bit_ceil(std::max<std::size_t>(Capacity, 2))),
+        Mask(Slots.size() - 1) {}
+
+  auto tryPush(T &&Value) noexcept -> bool {
+    auto Tail = Producer.Index.load(std::memory_order_relaxed);
+    if (Tail - Producer.Other == Slots.size()) {
+      Producer.Other = Consumer.Index.load(std::memory_order_acquire);
+      if (Tail - Producer.Other == Slots.size())
+        return false;
+    }
+    Slots[Tail & Mask] = std::move(Value);
+    Producer.Index.store(Tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  auto tryPop(T &Out) noexcept -> bool {
+    auto Head = Consumer.Index.load(std::memory_order_relaxed);
+    if (Head == Consumer.Other) {
+      Consumer.Other = Producer.Index.load(std::memory_order_acquire);
+      if (Head == Consumer.Other)
+        return false;
+    }
+    Out = std::move(Slots[Head & Mask]);
+    Consumer.Index.store(Head + 1, std::memory_order_release);
+    return true;
+  }
+
+  auto capacity() const noexcept -> std::size_t { return Slots.size(); }
+
+private:
+  struct alignas(64) Side {
+    std::atomic<std::size_t> Index{0};
+    // The other side's index as last seen.
+    std::size_t Other{0};
+  };
+
+  std::vector<T> Slots;
+  std::size_t Mask;
+  Side Producer;
+  Side Consumer;
+};
+
+// Hook state shared by the connection, which calls the hooks on its
+// writing thread, and the feed's consumer thread.
+struct ChangeCapture {
+  ChangeCapture(sqlite3 *Db, ChangeOptions Options)
+      : Db(Db), Tables(std::move(Options.Tables)),
+        Ring(Options.QueueCapacity) {}
+
+  auto wanted(char const *Schema, char const *Table) const noexcept -> bool {
+    if (std::string_view(Schema) != "main")
+      return false;
+    if (Tables.empty())
+      return !std::string_view(Table).starts_with("sqlite_");
+    return std::ranges::find(Tables, Table) != Tables.end();
+  }
+
+  static auto copyValue(sqlite3_value *V) -> ChangeValue {
+    switch (sqlite3_value_type(V)) {
+    case SQLITE_INTEGER:
+      return std::int64_t(sqlite3_value_int64(V));
+    case SQLITE_FLOAT:
+      return sqlite3_value_double(V);
+    case SQLITE_TEXT: {
+      auto const *Text = reinterpret_cast<char const *>(sqlite3_value_text(V));
+      return Text ? std::string(Text, sqlite3_value_bytes(V)) : std::string();
+    }
+    case SQLITE_BLOB: {
+      auto const *Data =
+          static_cast<std::uint8_t const *>(sqlite3_value_blob(V));
+      return std::vector<std::uint8_t>(Data, Data + sqlite3_value_bytes(V));
+    }
+    default:
+      return std::monostate{};
+    }
+  }
+
+  static auto opOf(int Op) noexcept -> ChangeOp {
+    return Op == SQLITE_INSERT   ? ChangeOp::Insert
+           : Op == SQLITE_DELETE ? ChangeOp::Delete
+                                 : ChangeOp::Update;
+  }
+
+  // Hooks run inside sqlite3_step() and must not throw; an event that
+  // cannot be allocated is lost rather than taking the process down.
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+  static void preupdate(void *Self, sqlite3 *Db, int Op, char const *Schema,
+                        char const *Table, sqlite3_int64 OldKey,
+                        sqlite3_int64 NewKey) noexcept {
+    auto &C = *static_cast<ChangeCapture *>(Self);
+    C.confirm();
+    C.Superseded = !C.Committed.Events.empty();
+    if (!C.Active.load(std::memory_order_relaxed) || !C.wanted(Schema, Table))
+      return;
+    try {
+      auto &E = C.Pending.Events.emplace_back();
+      E.Op = opOf(Op);
+      E.Table = Table;
+      E.OldRowId = OldKey;
+      E.RowId = Op == SQLITE_DELETE ? OldKey : NewKey;
+      int Columns = sqlite3_preupdate_count(Db);
+      sqlite3_value *V = nullptr;
+      if (Op != SQLITE_INSERT)
+        for (int I = 0; I < Columns; ++I)
+          if (sqlite3_preupdate_old(Db, I, &V) == SQLITE_OK)
+            E.Old.push_back(copyValue(V));
+      if (Op != SQLITE_DELETE)
+        for (int I = 0; I < Columns; ++I)
+          if (sqlite3_preupdate_new(Db, I, &V) == SQLITE_OK)
+            E.New.push_back(copyValue(V));
+    } catch (...) {
+    }
+  }
+#else
+  static void update(void *Self, int Op, char const *Schema,
+                     char const *Table, sqlite3_int64 RowId) noexcept {
+    auto &C = *static_cast<ChangeCapture *>(Self);
+    C.confirm();
+    C.Superseded = !C.Committed.Events.empty();
+    if (!C.Active.load(std::memory_order_relaxed) || !C.wanted(Schema, Table))
+      return;
+    try {
+      C.Pending.Events.push_back({opOf(Op), Table, RowId, RowId, {}, {}});
+    } catch (...) {
+    }
+  }
+#endif
+
+  // Called just before the transaction is made durable, which may still
+  // fail (SQLITE_BUSY leaves the transaction open, an I/O error rolls it
+  // back). The events are staged until confirm() sees the commit finished.
+  static auto commit(void *Self) noexcept -> int {
+    auto &C = *static_cast<ChangeCapture *>(Self);
+    if (C.Superseded)
+      C.publish();
+    if (C.Committed.Events.empty()) {
+      std::swap(C.Committed, C.Pending);
+      return 0;
+    }
+    try {
+      std::ranges::move(C.Pending.Events,
+                        std::back_inserter(C.Committed.Events));
+    } catch (...) {
+    }
+    C.Pending.Events.clear();
+    return 0;
+  }
+
+  // A rollback right after the commit hook means that commit failed. Once
+  // a later change has been seen, the staged batch belongs to a commit
+  // that already finished, and only the open transaction is undone.
+  static void rollback(void *Self) noexcept {
+    auto &C = *static_cast<ChangeCapture *>(Self);
+    C.Pending.Events.clear();
+    if (C.Superseded)
+      C.publish();
+    C.Committed.Events.clear();
+  }
+
+  // Publishes the staged batch once the connection is back in autocommit
+  // mode: the commit hook has fired since, and the rollback hook has not.
+  // Runs from the next hook and around every Connection::run(); never from
+  // the commit hook itself, where an implicit transaction still reads as
+  // autocommit.
+  void confirm() noexcept {
+    if (!Committed.Events.empty() && sqlite3_get_autocommit(Db))
+      publish();
+  }
+
+  void publish() noexcept {
+    Superseded = false;
+    if (Committed.Events.empty())
+      return;
+    if (!Active.load(std::memory_order_relaxed)) {
+      Committed.Events.clear();
+      return;
+    }
+    Committed.Sequence = ++Sequence;
+    auto Count = Committed.Events.size();
+    bool Stalled = false;
+    while (!Ring.tryPush(std::move(Committed))) {
+      Stalled = true;
+      if (!Active.load(std::memory_order_relaxed)) {
+        Committed = {};
+        return;
+      }
+      wake();
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    Committed = {};
+    Batches.fetch_add(1, std::memory_order_relaxed);
+    Events.fetch_add(Count, std::memory_order_relaxed);
+    Stalls.fetch_add(Stalled, std::memory_order_relaxed);
+    wake();
+  }
+
+  // SQLite has no hook for ROLLBACK TO; see Connection::changesMark().
+  auto mark() const noexcept -> std::size_t { return Pending.Events.size(); }
+
+  void rollbackTo(std::size_t Mark) noexcept {
+    if (Mark < Pending.Events.size())
+      Pending.Events.erase(Pending.Events.begin() + Mark,
+                           Pending.Events.end());
+  }
+
+  void wake() noexcept {
+    Wakeups.fetch_add(1, std::memory_order_release);
+    Wakeups.notify_one();
+  }
+
+  sqlite3 *const Db;
+  std::vector<std::string> const Tables;
+  SpscRing<ChangeBatch> Ring;
+  // Writer thread only: the open transaction's events, and those of a
+  // commit not yet confirmed.
+  ChangeBatch Pending;
+  ChangeBatch Committed;
+  // A change hook has fired since Committed was staged: a later transaction
+  // is running, so that commit went through.
+  bool Superseded{false};
+  std::uint64_t Sequence{0};
+
+  std::atomic<bool> Active{true};
+  std::atomic<std::uint32_t> Wakeups{0};
+  std::atomic<std::uint64_t> Batches{0};
+  std::atomic<std::uint64_t> Events{0};
+  std::atomic<std::uint64_t> Stalls{0};
+};
+
+} // namespace detail
+
+// A running subscription from Connection::changes(). Batches reach the
+// consumer callback on the feed's own thread in commit order. Destroying
+// the feed or calling stop() delivers what is already queued and ends the
+// thread; changes committed afterwards are not captured.
+struct ChangeFeed final {
+  using ConsumerT = std::function<void(ChangeBatch const &)>;
+
+  ChangeFeed() noexcept = default;
+  ChangeFeed(ChangeFeed &&) noexcept = default;
+  auto operator=(ChangeFeed &&Other) noexcept -> ChangeFeed & {
+    stop();
+    Capture = std::move(Other.Capture);
+    Consumer = std::move(Other.Consumer);
+    return *this;
+  }
+
+  ~ChangeFeed() noexcept { stop(); }
+
+  void stop() noexcept {
+    if (!Capture)
+      return;
+    Capture->Active.store(false, std::memory_order_relaxed);
+    Capture->wake();
+    if (Consumer.joinable())
+      Consumer.join();
+  }
+
+  auto stats() const noexcept -> ChangeFeedStats {
+    if (!Capture)
+      return {};
+    return {Capture->Batches.load(std::memory_order_relaxed),
+            Capture->Events.load(std::memory_order_relaxed),
+            Capture->Stalls.load(std::memory_order_relaxed)};
+  }
+
+private:
+  friend struct Connection;
+
+  ChangeFeed(std::shared_ptr<detail::ChangeCapture> Shared, ConsumerT Fn)
+      : Capture(std::move(Shared)) {
+    Consumer = std::jthread([C = Capture.get(), Fn = std::move(Fn)] {
+      ChangeBatch Batch;
+      while (true) {
+        auto Seen = C->Wakeups.load(std::memory_order_acquire);
+        while (C->Ring.tryPop(Batch))
+          Fn(Batch);
+        if (!C->Active.load(std::memory_order_relaxed)) {
+          // A commit racing with stop() may have pushed one more batch.
+          while (C->Ring.tryPop(Batch))
+            Fn(Batch);
+          return;
+        }
+        C->Wakeups.wait(Seen, std::memory_order_acquire);
+      }
+    });
+  }
+
+  std::shared_ptr<detail::ChangeCapture> Capture;
+  std::jthread Consumer;
+};
+
+} // namespace esqlite
+
+#endif // ESQLITE_CHANGE_FEED_H
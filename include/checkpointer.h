@@ -0,0 +1,262 @@
+#ifndef ESQLITE_CHECKPOINTER_H
+#define ESQLITE_CHECKPOINTER_H
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include <sqlite3.h>
+
+#include "esqlite.h"
+
+namespace esqlite {
+
+struct CheckpointerOptions {
+  // WAL size, in frames (pages), that triggers a PASSIVE checkpoint. It
+  // copies what it can without waiting for anyone.
+  int PassiveFrames{1000};
+  // Above this size the checkpoint is RESTART: it waits up to BusyTimeout
+  // for readers still using old frames, so the next writer can start over
+  // at the beginning of the WAL. New writers wait meanwhile.
+  int RestartFrames{10000};
+  // Above this size the checkpoint is TRUNCATE, which also shrinks the WAL
+  // file to zero bytes.
+  int TruncateFrames{50000};
+  // How long a RESTART or TRUNCATE checkpoint waits for locks.
+  std::chrono::milliseconds BusyTimeout{100};
+  // A WAL below PassiveFrames is still checkpointed this often, so it does
+  // not sit unflushed while writes are rare.
+  std::chrono::milliseconds Interval{1000};
+};
+
+struct CheckpointerStats {
+  std::uint64_t Passive{0};
+  std::uint64_t Restart{0};
+  std::uint64_t Truncate{0};
+  // Checkpoints that could not finish because of readers or writers.
+  std::uint64_t Busy{0};
+  // WAL frames as of the writer's last commit.
+  int WalFrames{0};
+  // WAL frames and frames copied to the database by the last checkpoint.
+  int LastLogFrames{0};
+  int LastCheckpointedFrames{0};
+  std::chrono::nanoseconds LastDuration{0};
+  std::chrono::nanoseconds MaxDuration{0};
+  std::chrono::nanoseconds TotalDuration{0};
+};
+
+// Moves WAL checkpoints off the commit path of a writer connection.
+// SQLite's automatic checkpoint runs inside whichever commit crosses the
+// threshold, which then takes as long as copying the whole WAL. start()
+// replaces it with a wal hook that only records the WAL size. A thread
+// with its own connection does the checkpointing, escalating from PASSIVE
+// to RESTART and TRUNCATE as the WAL grows past the configured sizes.
+//
+// RESTART and TRUNCATE checkpoints hold back new writers while they wait
+// for readers, so the writer needs a busy timeout longer than BusyTimeout.
+// The Checkpointer must be stopped or destroyed before the writer is
+// closed, while the writer is idle: stop() reinstates the writer's own
+// automatic checkpoints.
+struct Checkpointer final {
+  Checkpointer() noexcept = default;
+  Checkpointer(Checkpointer &&) noexcept = default;
+  auto operator=(Checkpointer &&Other) noexcept -> Checkpointer & {
+    stop();
+    Shared = std::move(Other.Shared);
+    Worker = std::move(Other.Worker);
+    return *this;
+  }
+
+  ~Checkpointer() noexcept { stop(); }
+
+  static auto start(Connection &Writer,
+                    CheckpointerOptions Options = {}) noexcept
+      -> ExpectedT<Checkpointer> {
+    auto *Db = Writer.nativeHandle();
+    if (!Db) [[unlikely]]
+      return std::unexpected("DB handle is null");
+    auto const *Path = sqlite3_db_filename(Db, "main");
+    if (!Path || !*Path) [[unlikely]]
+      return std::unexpected("Checkpointer needs an on-disk database");
+
+    auto JournalMode = [](Connection &Conn) {
+      std::string Mode;
+      for (auto &&Row : Conn.runReading<std::string>("PRAGMA journal_mode"))
+        if (Row)
+          Mode = std::get<0>(*Row);
+      return Mode;
+    };
+    if (JournalMode(Writer) != "wal") [[unlikely]]
+      return std::unexpected("Checkpointer needs a WAL-mode database");
+    int AutoCheckpoint = 0;
+    for (auto &&Row : Writer.runReading<int>("PRAGMA wal_autocheckpoint"))
+      if (Row)
+        AutoCheckpoint = std::get<0>(*Row);
+
+    auto Checkpoints = open_v2(Path, SQLITE_OPEN_READWRITE |
+                                         SQLITE_OPEN_NOMUTEX);
+    if (!Checkpoints) [[unlikely]]
+      return std::unexpected(Checkpoints.error());
+    // Also makes the new connection read the database header; until then
+    // it does not know the database is in WAL mode and its checkpoints do
+    // nothing.
+    if (JournalMode(*Checkpoints) != "wal") [[unlikely]]
+      return std::unexpected("Checkpointer needs a WAL-mode database");
+    sqlite3_busy_timeout(Checkpoints->nativeHandle(),
+                         int(Options.BusyTimeout.count()));
+
+    Checkpointer Result;
+    Result.Shared = std::make_shared<State>();
+    auto &S = *Result.Shared;
+    S.Options = Options;
+    S.Writer = Db;
+    S.AutoCheckpoint = AutoCheckpoint;
+    S.Trigger = Options.PassiveFrames;
+    // Replaces the hook sqlite3_wal_autocheckpoint() installs, which is
+    // what runs the automatic checkpoints.
+    sqlite3_wal_hook(Db, &State::walHook, &S);
+    Result.Worker = std::jthread(
+        [&S, Conn = std::move(*Checkpoints)](std::stop_token Stop) mutable {
+          S.run(Conn, Stop);
+        });
+    return Result;
+  }
+
+  // Checkpoints as soon as possible, whatever the WAL size.
+  void checkpointNow() noexcept {
+    if (!Shared)
+      return;
+    std::lock_guard Lock(Shared->Mutex);
+    Shared->Requested = true;
+    Shared->Wake.notify_one();
+  }
+
+  auto stats() const noexcept -> CheckpointerStats {
+    if (!Shared)
+      return {};
+    std::lock_guard Lock(Shared->Mutex);
+    auto Stats = Shared->Stats;
+    Stats.WalFrames = Shared->WalFrames.load(std::memory_order_relaxed);
+    return Stats;
+  }
+
+  // Ends the thread and gives checkpointing back to the writer.
+  void stop() noexcept {
+    if (!Shared)
+      return;
+    Worker.request_stop();
+    {
+      std::lock_guard Lock(Shared->Mutex);
+      Shared->Wake.notify_one();
+    }
+    if (Worker.joinable())
+      Worker.join();
+    sqlite3_wal_autocheckpoint(Shared->Writer, Shared->AutoCheckpoint);
+    Shared.reset();
+  }
+
+private:
+  struct State {
+    // Runs on the writer's thread after every commit; only wakes the
+    // checkpointer when the WAL crosses the trigger size.
+    static auto walHook(void *Self, sqlite3 *, char const *,
+                        int Frames) noexcept -> int {
+      auto &S = *static_cast<State *>(Self);
+      auto Previous = S.WalFrames.exchange(Frames, std::memory_order_relaxed);
+      // A shrinking WAL was restarted from the beginning.
+      if (Frames < Previous)
+        S.Trigger.store(S.Options.PassiveFrames, std::memory_order_relaxed);
+      auto Trigger = S.Trigger.load(std::memory_order_relaxed);
+      if (Frames >= Trigger && Previous < Trigger) {
+        std::lock_guard Lock(S.Mutex);
+        S.Wake.notify_one();
+      }
+      return SQLITE_OK;
+    }
+
+    auto due() const noexcept -> bool {
+      return Requested || WalFrames.load(std::memory_order_relaxed) >=
+                              Trigger.load(std::memory_order_relaxed);
+    }
+
+    void run(Connection &Conn, std::stop_token const &Stop) noexcept {
+      int Done = 0;
+      while (true) {
+        bool Forced = false;
+        {
+          std::unique_lock Lock(Mutex);
+          Wake.wait_for(Lock, Options.Interval,
+                        [&] { return Stop.stop_requested() || due(); });
+          if (Stop.stop_requested())
+            return;
+          Forced = std::exchange(Requested, false);
+        }
+        // The interval alone only flushes a WAL that changed since the
+        // last checkpoint.
+        auto Frames = WalFrames.load(std::memory_order_relaxed);
+        if (Frames > 0 && (Forced || Frames != Done))
+          checkpoint(Conn.nativeHandle(), Frames);
+        Done = Frames;
+      }
+    }
+
+    void checkpoint(sqlite3 *Db, int Frames) noexcept {
+      auto Before = Trigger.load(std::memory_order_relaxed);
+      int Mode = Frames >= Options.TruncateFrames ? SQLITE_CHECKPOINT_TRUNCATE
+                 : Frames >= Options.RestartFrames ? SQLITE_CHECKPOINT_RESTART
+                                                   : SQLITE_CHECKPOINT_PASSIVE;
+      int Log = 0, Checkpointed = 0;
+      auto Start = std::chrono::steady_clock::now();
+      int E = sqlite3_wal_checkpoint_v2(Db, "main", Mode, &Log, &Checkpointed);
+      auto Took = std::chrono::steady_clock::now() - Start;
+      // Next time the WAL has grown by another PassiveFrames, unless the
+      // writer restarted it meanwhile and reset the trigger.
+      Trigger.compare_exchange_strong(Before, Frames + Options.PassiveFrames,
+                                      std::memory_order_relaxed);
+
+      std::lock_guard Lock(Mutex);
+      ++(Mode == SQLITE_CHECKPOINT_TRUNCATE  ? Stats.Truncate
+         : Mode == SQLITE_CHECKPOINT_RESTART ? Stats.Restart
+                                             : Stats.Passive);
+      // A PASSIVE checkpoint that leaves frames behind is not busy; that is
+      // what PASSIVE does.
+      Stats.Busy += E == SQLITE_BUSY;
+      Stats.LastLogFrames = Log;
+      Stats.LastCheckpointedFrames = Checkpointed;
+      Stats.LastDuration = Took;
+      Stats.MaxDuration = std::max<std::chrono::nanoseconds>(
+          Stats.MaxDuration, Took);
+      Stats.TotalDuration += Took;
+    }
+
+    CheckpointerOptions Options;
+    sqlite3 *Writer{nullptr};
+    int AutoCheckpoint{0};
+    std::atomic<int> WalFrames{0};
+    // WAL size at which the hook wakes the checkpointer.
+    std::atomic<int> Trigger{0};
+
+    std::mutex Mutex;
+    std::condition_variable Wake;
+    bool Requested{false};
+    CheckpointerStats Stats;
+  };
+
+  std::shared_ptr<State> Shared;
+  // Last, so the thread is joined before the state goes away.
+  std::jthread Worker;
+};
+
+} // namespace esqlite
+
+#endif // ESQLITE_CHECKPOINTER_H
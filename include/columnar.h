@@ -0,0 +1,140 @@
+#ifndef ESQLITE_COLUMNAR_H
+#define ESQLITE_COLUMNAR_H
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "type_traits.h"
+
+namespace esqlite {
+
+template <typename T>
+inline constexpr bool is_sqlite_columnar_v =
+    is_sqlite_numeric_v<T> ||
+    is_any_of_v<T, std::string_view, std::span<std::uint8_t const>>;
+
+// Bit I of a null mask is set iff row I of the column is NULL.
+struct NullMask {
+  std::span<std::uint64_t const> Words;
+
+  auto isNull(std::size_t Row) const noexcept -> bool {
+    return Words[Row / 64] >> (Row % 64) & 1;
+  }
+};
+
+// Read-only view over one column of a batch. Numeric columns are a dense
+// array (NULL rows read as 0); text and blob columns are an Arrow-style
+// offsets array of Rows + 1 entries over one contiguous byte arena.
+template <class T> struct ColumnView {
+  std::span<T const> Values;
+  NullMask Nulls;
+
+  auto operator[](std::size_t Row) const noexcept -> T { return Values[Row]; }
+};
+
+template <class T>
+  requires(!is_sqlite_numeric_v<T>)
+struct ColumnView<T> {
+  using ByteT = std::conditional_t<std::is_same_v<T, std::string_view>, char,
+                                   std::uint8_t>;
+
+  std::span<std::uint64_t const> Offsets;
+  std::span<ByteT const> Bytes;
+  NullMask Nulls;
+
+  auto operator[](std::size_t Row) const noexcept -> T {
+    return T(Bytes.data() + Offsets[Row], Offsets[Row + 1] - Offsets[Row]);
+  }
+};
+
+// Reusable per-column storage behind ColumnView; keeps its capacity across
+// batches so steady-state fetching does not allocate.
+template <class T> struct ColumnBuffer {
+  static_assert(is_sqlite_columnar_v<T>, "Illegal column type");
+
+  void clear() noexcept {
+    Values.clear();
+    Nulls.clear();
+  }
+
+  void append(sqlite3_stmt *Handle, int Idx, std::size_t Row) noexcept {
+    if (Row % 64 == 0)
+      Nulls.push_back(0);
+    if (sqlite3_column_type(Handle, Idx) == SQLITE_NULL)
+      Nulls.back() |= std::uint64_t(1) << (Row % 64);
+
+    if constexpr (std::is_same_v<T, double>)
+      Values.push_back(sqlite3_column_double(Handle, Idx));
+    else
+      Values.push_back(static_cast<T>(sqlite3_column_int64(Handle, Idx)));
+  }
+
+  auto view() const noexcept -> ColumnView<T> { return {Values, {Nulls}}; }
+
+  std::vector<T> Values;
+  std::vector<std::uint64_t> Nulls;
+};
+
+template <class T>
+  requires(!is_sqlite_numeric_v<T>)
+struct ColumnBuffer<T> {
+  static_assert(is_sqlite_columnar_v<T>, "Illegal column type");
+  using ByteT = typename ColumnView<T>::ByteT;
+
+  void clear() noexcept {
+    Offsets.assign(1, 0);
+    Bytes.clear();
+    Nulls.clear();
+  }
+
+  void append(sqlite3_stmt *Handle, int Idx, std::size_t Row) noexcept {
+    if (Row % 64 == 0)
+      Nulls.push_back(0);
+
+    void const *Data;
+    if constexpr (std::is_same_v<T, std::string_view>)
+      Data = sqlite3_column_text(Handle, Idx);
+    else
+      Data = sqlite3_column_blob(Handle, Idx);
+    auto Size = static_cast<std::size_t>(sqlite3_column_bytes(Handle, Idx));
+
+    if (!Data && sqlite3_column_type(Handle, Idx) == SQLITE_NULL)
+      Nulls.back() |= std::uint64_t(1) << (Row % 64);
+    auto const *First = static_cast<ByteT const *>(Data);
+    Bytes.insert(Bytes.end(), First, First + (Data ? Size : 0));
+    Offsets.push_back(Bytes.size());
+  }
+
+  auto view() const noexcept -> ColumnView<T> {
+    return {Offsets, Bytes, {Nulls}};
+  }
+
+  std::vector<std::uint64_t> Offsets{0};
+  std::vector<ByteT> Bytes;
+  std::vector<std::uint64_t> Nulls;
+};
+
+// One struct-of-arrays chunk of a result set. Views stay valid until the
+// producing generator is resumed.
+template <class... ColTs> struct ColumnBatch {
+  std::size_t Rows{0};
+  std::tuple<ColumnView<ColTs>...> Columns;
+
+  template <std::size_t I> auto column() const noexcept {
+    return std::get<I>(Columns);
+  }
+};
+
+} // namespace esqlite
+
+#endif // ESQLITE_COLUMNAR_H
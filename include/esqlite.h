@@ -3,16 +3,35 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
 #include <expected>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
 #include <span>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <tuple>
+#include <unordered_map>
 #include <utility>
+#include <variant>
 #include <vector>
 
 #include <sqlite3.h>
 
+#include "change_feed.h"
+#include "columnar.h"
+#include "functions.h"
 #include "generator.h"
 #include "type_traits.h"
 
@@ -24,6 +43,225 @@ template <typename ReturnT>
 using ExpectedT = std::expected<ReturnT, std::string_view>;
 
 struct Connection;
+template <class... ColTs> struct RowRange;
+
+// Caller-owned text or blob bound without a copy (SQLITE_STATIC). The
+// memory must stay valid and unchanged until the parameter is rebound or
+// the statement's bindings are cleared, which for Connection::run() and
+// cached statements happens when the call returns.
+template <class T> struct Borrowed {
+  T Value;
+};
+
+inline auto borrowed(std::string_view S) noexcept
+    -> Borrowed<std::string_view> {
+  return {S};
+}
+
+// A temporary would be destroyed before the statement is stepped.
+auto borrowed(std::string &&) -> Borrowed<std::string_view> = delete;
+
+template <class T>
+  requires is_sqlite_blob<T> && std::ranges::borrowed_range<T>
+auto borrowed(T &&S) noexcept -> Borrowed<std::span<std::uint8_t const>> {
+  return {{reinterpret_cast<std::uint8_t const *>(std::data(S)),
+           std::size(S)}};
+}
+
+// A native object passed through sqlite3_bind_pointer(). It is visible only
+// to SQL functions that ask for the same Type through
+// sqlite3_value_pointer(), so Type must be a string literal (SQLite compares
+// it by pointer and keeps it for the lifetime of the binding).
+template <class T> struct NativePointer {
+  T *Ptr;
+  char const *Type;
+};
+
+template <class T>
+inline constexpr bool is_borrowed_v = false;
+template <class T>
+inline constexpr bool is_borrowed_v<Borrowed<T>> = true;
+
+template <class T>
+inline constexpr bool is_native_pointer_v = false;
+template <class T>
+inline constexpr bool is_native_pointer_v<NativePointer<T>> = true;
+
+// Snapshot of sqlite3_stmt_status() counters for one statement.
+struct StatementCounters {
+  int FullscanSteps{0};
+  int Sorts{0};
+  int AutoIndex{0};
+  int VmSteps{0};
+  int Reprepares{0};
+  int Runs{0};
+  int MemUsed{0};
+};
+
+// sqlite3_db_status() memory counters of one connection, in bytes or
+// lookaside slot counts.
+struct ConnectionMemoryStats {
+  int CacheUsed{0};
+  int SchemaUsed{0};
+  int StmtUsed{0};
+  int LookasideUsed{0};
+  int LookasideHit{0};
+  int LookasideMissSize{0};
+  int LookasideMissFull{0};
+};
+
+// Outcome of a bulk write. Rows [0, Written) are durable; FailedAt is the
+// index of the first row that could not be written, if any.
+struct BulkResult {
+  std::size_t Written{0};
+  std::optional<std::size_t> FailedAt;
+  std::string_view Error;
+
+  explicit operator bool() const noexcept { return !FailedAt; }
+};
+
+// Errors of a query stopped by its QueryLimits. They are distinct from
+// every SQLite error string, so callers can tell them apart with ==.
+inline constexpr std::string_view DeadlineExceeded = "Query deadline exceeded";
+inline constexpr std::string_view QueryCancelled = "Query was cancelled";
+
+// Lets another thread stop queries run with QueryLimits::Token set. Copies
+// share one state; once cancelled a token stays cancelled until reset().
+//
+// cancel() interrupts the connections currently stepping under the token
+// with sqlite3_interrupt(), which stops every statement running on them at
+// that moment, not only the one the token was passed to.
+struct CancellationToken final {
+  CancellationToken() : Shared(std::make_shared<State>()) {}
+
+  void cancel() const noexcept {
+    std::lock_guard Lock(Shared->Mutex);
+    Shared->Cancelled.store(true, std::memory_order_relaxed);
+    for (auto *Db : Shared->Running)
+      sqlite3_interrupt(Db);
+  }
+
+  auto cancelled() const noexcept -> bool {
+    return Shared->Cancelled.load(std::memory_order_relaxed);
+  }
+
+  void reset() const noexcept {
+    Shared->Cancelled.store(false, std::memory_order_relaxed);
+  }
+
+private:
+  friend struct Statement;
+
+  struct State {
+    std::atomic<bool> Cancelled{false};
+    std::mutex Mutex;
+    // A connection stays registered only while it steps, so cancel() never
+    // touches one that may be closed concurrently.
+    std::vector<sqlite3 *> Running;
+  };
+
+  void attach(sqlite3 *Db) const noexcept {
+    std::lock_guard Lock(Shared->Mutex);
+    Shared->Running.push_back(Db);
+  }
+
+  void detach(sqlite3 *Db) const noexcept {
+    std::lock_guard Lock(Shared->Mutex);
+    auto &Running = Shared->Running;
+    Running.erase(std::find(Running.begin(), Running.end(), Db));
+  }
+
+  std::shared_ptr<State> Shared;
+};
+
+// When a query gives up. Both limits are checked from a progress handler
+// every CheckEvery virtual machine instructions, so a step that spends its
+// time outside the VM (a long sort inside one opcode, a busy wait) notices
+// late; a cancellation also interrupts the connection directly.
+struct QueryLimits {
+  using Clock = std::chrono::steady_clock;
+
+  // Absolute, so it bounds the whole query rather than each step.
+  Clock::time_point Deadline{Clock::time_point::max()};
+  // Not owned; must outlive the query.
+  CancellationToken const *Token{nullptr};
+  int CheckEvery{1000};
+
+  static auto after(Clock::duration Timeout) noexcept -> QueryLimits {
+    return {Clock::now() + Timeout};
+  }
+
+  // Empty while the query may go on, else the error it stops with.
+  auto exceeded() const noexcept -> std::string_view {
+    if (Token && Token->cancelled())
+      return QueryCancelled;
+    if (Deadline != Clock::time_point::max() && Clock::now() >= Deadline)
+      return DeadlineExceeded;
+    return {};
+  }
+};
+
+// Bump allocator for the text and blob cells of a ResultSet. Chunks grow
+// geometrically and never move, so copies handed out stay valid for the
+// arena's lifetime, including across moves of the arena itself.
+struct ByteArena final {
+  static constexpr std::size_t FirstChunk = 4 << 10;
+  static constexpr std::size_t MaxChunk = 1 << 20;
+
+  // Copies Bytes into the arena and returns where they landed.
+  auto copy(void const *Bytes, std::size_t Size) -> std::byte * {
+    if (Size > Left) [[unlikely]]
+      grow(Size);
+    auto *At = Cursor;
+    if (Size)
+      std::memcpy(At, Bytes, Size);
+    Cursor += Size;
+    Left -= Size;
+    Used += Size;
+    return At;
+  }
+
+  // Bytes handed out, and bytes reserved from the system.
+  auto used() const noexcept -> std::size_t { return Used; }
+  auto reserved() const noexcept -> std::size_t { return Reserved; }
+  auto chunks() const noexcept -> std::size_t { return Chunks.size(); }
+
+private:
+  void grow(std::size_t AtLeast) {
+    auto Size = Chunks.empty() ? FirstChunk
+                               : std::min(Reserved, MaxChunk);
+    Size = std::max(Size, AtLeast);
+    Chunks.push_back(std::make_unique_for_overwrite<std::byte[]>(Size));
+    Cursor = Chunks.back().get();
+    Left = Size;
+    Reserved += Size;
+  }
+
+  std::vector<std::unique_ptr<std::byte[]>> Chunks;
+  std::byte *Cursor{nullptr};
+  std::size_t Left{0};
+  std::size_t Used{0};
+  std::size_t Reserved{0};
+};
+
+// Rows materialized by Statement::collect() and Connection::queryAll().
+// std::string_view and std::span<std::uint8_t const> members of Pod point
+// into the result's own arena, so they stay valid as long as the ResultSet
+// (moving it is fine) rather than only until the next step.
+template <class Pod> struct ResultSet final {
+  auto begin() const noexcept { return Rows.begin(); }
+  auto end() const noexcept { return Rows.end(); }
+  auto size() const noexcept { return Rows.size(); }
+  auto empty() const noexcept { return Rows.empty(); }
+  auto operator[](std::size_t I) const noexcept -> Pod const & {
+    return Rows[I];
+  }
+
+  auto arena() const noexcept -> ByteArena const & { return Arena; }
+
+  std::vector<Pod> Rows;
+  ByteArena Arena;
+};
 
 struct Statement final {
   // TODO: Create the prepared statement object using sqlite3_prepare_v2().
@@ -39,13 +277,15 @@ struct Statement final {
   constexpr Statement &operator=(Statement const &) = delete;
 
   constexpr Statement(Statement &&Other) noexcept
-      : Handle(std::exchange(Other.Handle, nullptr)) {}
+      : Handle(std::exchange(Other.Handle, nullptr)),
+        Owned(std::move(Other.Owned)) {}
 
   constexpr Statement &operator=(Statement &&Other) noexcept {
     if (this == &Other) [[unlikely]]
       return *this;
-    this->~Statement();
+    sqlite3_finalize(Handle);
     Handle = std::exchange(Other.Handle, nullptr);
+    Owned = std::move(Other.Owned);
     return *this;
   }
 
@@ -96,40 +336,120 @@ struct Statement final {
     if (!Handle) [[unlikely]]
       return std::unexpected("Statement handle is null");
 
-    int E = sqlite3_bind_text(Handle, Ind, S.data(), S.size(),
-                              IsStatic ? SQLITE_STATIC : SQLITE_TRANSIENT);
+    int E = sqlite3_bind_text64(Handle, Ind, S.data(), S.size(),
+                                IsStatic ? SQLITE_STATIC : SQLITE_TRANSIENT,
+                                SQLITE_UTF8);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return {};
+  }
+
+  // Takes the string instead of copying it. The statement keeps it alive
+  // until the parameter is rebound, the bindings are cleared or the
+  // statement is finalized.
+  auto bindText(unsigned Ind, std::string &&S) noexcept -> ExpectedT<void> {
+    auto *Slot = ownedSlot(Ind);
+    if (!Slot) [[unlikely]]
+      return std::unexpected(Handle ? sqlite3_errstr(SQLITE_RANGE)
+                                    : "Statement handle is null");
+    auto &Kept = Slot->emplace<std::string>(std::move(S));
+    return bindText(Ind, Kept, true);
+  }
+
+  // TODO: bindText16 clone
+
+  auto bindBlob(unsigned Ind, std::span<uint8_t const> S,
+                bool IsStatic) noexcept -> ExpectedT<void> {
+    if (!Handle) [[unlikely]]
+      return std::unexpected("Statement handle is null");
+
+    int E = sqlite3_bind_blob64(Handle, Ind, S.data(), S.size(),
+                                IsStatic ? SQLITE_STATIC : SQLITE_TRANSIENT);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return {};
+  }
+
+  // Takes the buffer instead of copying it; see bindText(unsigned, string&&).
+  template <class ByteT>
+    requires is_any_of_v<ByteT, char, std::uint8_t>
+  auto bindBlob(unsigned Ind, std::vector<ByteT> &&S) noexcept
+      -> ExpectedT<void> {
+    auto *Slot = ownedSlot(Ind);
+    if (!Slot) [[unlikely]]
+      return std::unexpected(Handle ? sqlite3_errstr(SQLITE_RANGE)
+                                    : "Statement handle is null");
+    auto &Kept = Slot->emplace<std::vector<ByteT>>(std::move(S));
+    return bindBlob(Ind, asBytes(Kept), true);
+  }
+
+  // Binds an object that only SQL functions can see; see NativePointer.
+  // Destroy, if given, runs when SQLite drops the binding.
+  auto bindPointer(unsigned Ind, void *P, char const *Type,
+                   void (*Destroy)(void *) = nullptr) noexcept
+      -> ExpectedT<void> {
+    if (!Handle) [[unlikely]]
+      return std::unexpected("Statement handle is null");
+
+    int E = sqlite3_bind_pointer(Handle, Ind, P, Type, Destroy);
     if (E != SQLITE_OK) [[unlikely]]
       return std::unexpected(sqlite3_errstr(E));
     return {};
   }
 
-  // TODO: bindText16, bindText64 clones
+  // Hands the object over to SQLite, which deletes it with the binding.
+  template <class T>
+  auto bindPointer(unsigned Ind, std::unique_ptr<T> P,
+                   char const *Type) noexcept -> ExpectedT<void> {
+    return bindPointer(Ind, P.release(), Type,
+                       [](void *Ptr) { delete static_cast<T *>(Ptr); });
+  }
 
-  auto bindBlob(unsigned Ind, std::span<uint8_t> S, bool IsStatic) noexcept
+  // Binds a blob of Size zero bytes without allocating it, to be filled in
+  // place afterwards through a Blob handle.
+  auto bindZeroBlob(unsigned Ind, std::uint64_t Size) noexcept
       -> ExpectedT<void> {
     if (!Handle) [[unlikely]]
       return std::unexpected("Statement handle is null");
 
-    int E = sqlite3_bind_blob(Handle, Ind, S.data(), S.size(),
-                              IsStatic ? SQLITE_STATIC : SQLITE_TRANSIENT);
+    int E = sqlite3_bind_zeroblob64(Handle, Ind, Size);
     if (E != SQLITE_OK) [[unlikely]]
       return std::unexpected(sqlite3_errstr(E));
     return {};
   }
 
+  // Rvalue std::string and std::vector arguments are moved into the
+  // statement rather than copied; wrap caller memory in borrowed() to skip
+  // the copy without transferring ownership.
   template <typename T>
   auto bindParam(size_t Idx, T &&Param) noexcept -> ExpectedT<void> {
-    if constexpr (is_sqlite_numeric_v<T>) {
+    using ParamT = std::remove_cvref_t<T>;
+    constexpr bool IsRvalue = !std::is_lvalue_reference_v<T> &&
+                              !std::is_const_v<std::remove_reference_t<T>>;
+    if constexpr (is_borrowed_v<ParamT>) {
+      if constexpr (is_sqlite_text<decltype(Param.Value)>)
+        return bindText(Idx, Param.Value, true);
+      else
+        return bindBlob(Idx, Param.Value, true);
+    } else if constexpr (is_native_pointer_v<ParamT>) {
+      return bindPointer(Idx, Param.Ptr, Param.Type);
+    } else if constexpr (is_sqlite_numeric_v<T>) {
       return bindNumeric(Idx, Param);
     } else if constexpr (is_sqlite_text<T>) {
-      return bindText(Idx, std::forward<T>(Param), false);
+      if constexpr (IsRvalue && std::is_same_v<ParamT, std::string>)
+        return bindText(Idx, std::move(Param));
+      else
+        return bindText(Idx, Param, false);
     } else if constexpr (is_sqlite_blob<T>) {
-      return bindBlob(Idx, std::forward<T>(Param), false);
+      if constexpr (IsRvalue && requires { Param.get_allocator(); })
+        return bindBlob(Idx, std::move(Param));
+      else
+        return bindBlob(Idx, asBytes(Param), false);
     } else if constexpr (is_sqlite_null<T>) {
       return bindNull(Idx);
+    } else {
+      static_assert(always_false_v<T>, "Illegal type param");
     }
-    assert(false && "Illegal type param");
-    std::unreachable();
   }
 
   template <typename T, typename... Ts>
@@ -143,7 +463,17 @@ struct Statement final {
 
   auto bindParams(size_t FirstIdx) noexcept -> ExpectedT<void> { return {}; }
 
-  // TODO: bindBlob64
+  // Binds a tuple or an aggregate (members in declaration order) to the
+  // parameters starting at index 1.
+  template <class RowT> auto bindRow(RowT &&Row) noexcept -> ExpectedT<void> {
+    auto BindFromOne = [this](auto &&...Fields) {
+      return bindParams(1, std::forward<decltype(Fields)>(Fields)...);
+    };
+    if constexpr (is_tuple_like_v<RowT>)
+      return std::apply(BindFromOne, std::forward<RowT>(Row));
+    else
+      return std::apply(BindFromOne, asRefTuple(Row));
+  }
 
   enum class StepOk {
     STEP_ROW,
@@ -171,8 +501,26 @@ struct Statement final {
       return {StepOk::STEP_DONE};
     if (E == SQLITE_BUSY)
       return {StepOk::STEP_BUSY};
-    assert(false && "unkown step error");
-    std::unreachable();
+    // Constraint violations, I/O errors and the like.
+    return std::unexpected(sqlite3_errstr(E));
+  }
+
+  // step() that fails with DeadlineExceeded or QueryCancelled once Limits
+  // say so. Installs a progress handler on the connection for the duration
+  // of the call, replacing any other.
+  auto step(QueryLimits const &Limits) noexcept -> ExpectedT<StepOk> {
+    if (!Handle) [[unlikely]]
+      return std::unexpected("Statement handle is null");
+    if (auto Stop = Limits.exceeded(); !Stop.empty()) [[unlikely]]
+      return std::unexpected(Stop);
+
+    LimitScope Scope(Handle, Limits);
+    return Scope.check(step());
+  }
+
+  auto step(QueryLimits::Clock::time_point Deadline) noexcept
+      -> ExpectedT<StepOk> {
+    return step(QueryLimits{Deadline});
   }
 
   auto reset() noexcept -> ExpectedT<void> {
@@ -185,6 +533,69 @@ struct Statement final {
     return {};
   }
 
+  // Reset zeroes every counter except MemUsed, which is a gauge.
+  auto counters(bool Reset = false) noexcept -> StatementCounters {
+    if (!Handle) [[unlikely]]
+      return {};
+
+    auto Get = [this, Reset](int Op) {
+      return sqlite3_stmt_status(Handle, Op, Reset);
+    };
+    return {Get(SQLITE_STMTSTATUS_FULLSCAN_STEP),
+            Get(SQLITE_STMTSTATUS_SORT),
+            Get(SQLITE_STMTSTATUS_AUTOINDEX),
+            Get(SQLITE_STMTSTATUS_VM_STEP),
+            Get(SQLITE_STMTSTATUS_REPREPARE),
+            Get(SQLITE_STMTSTATUS_RUN),
+            Get(SQLITE_STMTSTATUS_MEMUSED)};
+  }
+
+  // Escape hatch for sqlite3 APIs the wrapper does not cover.
+  auto nativeHandle() const noexcept -> sqlite3_stmt * { return Handle; }
+
+  auto clearBindings() noexcept -> ExpectedT<void> {
+    if (!Handle) [[unlikely]]
+      return std::unexpected("Statement handle is null");
+
+    int E = sqlite3_clear_bindings(Handle);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    for (auto &Slot : Owned)
+      Slot = std::monostate{};
+    return {};
+  }
+
+  // Binds, steps and resets once per row. Stops at the first failing row.
+  // No transaction is opened; see Connection::insertMany for that.
+  template <std::ranges::input_range RangeT>
+  auto executeMany(RangeT &&Rows) noexcept -> BulkResult {
+    BulkResult Result;
+    for (auto &&Row : Rows) {
+      auto E = executeRow(std::forward<decltype(Row)>(Row));
+      if (!E) [[unlikely]] {
+        Result.FailedAt = Result.Written;
+        Result.Error = E.error();
+        return Result;
+      }
+      ++Result.Written;
+    }
+    return Result;
+  }
+
+  template <class RowT>
+  auto executeRow(RowT &&Row) noexcept -> ExpectedT<void> {
+    auto E = bindRow(std::forward<RowT>(Row));
+    if (E) [[likely]] {
+      auto S = step();
+      if (!S) [[unlikely]]
+        E = std::unexpected(S.error());
+      else if (*S == StepOk::STEP_BUSY) [[unlikely]]
+        E = std::unexpected("Db is busy");
+    }
+    (void)reset();
+    return E;
+  }
+
   auto readNumeric(int Idx, int &X) noexcept -> ExpectedT<void> {
     if (!Handle) [[unlikely]]
       return std::unexpected("Statement handle is null");
@@ -248,8 +659,7 @@ struct Statement final {
         return std::unexpected(E.error());
       Param = *E;
     } else {
-      assert(false && "Illegal type param");
-      std::unreachable();
+      static_assert(always_false_v<T>, "Illegal type param");
     }
     return {};
   }
@@ -280,6 +690,48 @@ struct Statement final {
     return Result;
   }
 
+  // Runs the statement to completion and materializes every row as a Pod,
+  // with fields reflected as in readPod(). Text and blob cells read into
+  // view members are copied into the result's arena, sized from
+  // sqlite3_column_bytes(); other members are read as usual.
+  template <class Pod> auto collect() noexcept -> ExpectedT<ResultSet<Pod>> {
+    ResultSet<Pod> Result;
+    while (true) {
+      auto E = step();
+      if (!E) [[unlikely]]
+        return std::unexpected(E.error());
+      if (*E == StepOk::STEP_DONE)
+        return Result;
+      if (*E == StepOk::STEP_BUSY) [[unlikely]]
+        return std::unexpected("Db is busy");
+
+      auto &Row = Result.Rows.emplace_back();
+      ExpectedT<void> Read;
+      staticFor<std::tuple_size_v<decltype(asRefTuple(Row))>>([&](auto I) {
+        auto &Field = std::get<I>(asRefTuple(Row));
+        using FieldT = std::remove_cvref_t<decltype(Field)>;
+        if constexpr (std::is_same_v<FieldT, std::string_view>) {
+          auto const *Data = sqlite3_column_text(Handle, I);
+          auto Size = std::size_t(sqlite3_column_bytes(Handle, I));
+          Field = {reinterpret_cast<char const *>(
+                       Result.Arena.copy(Data, Size)),
+                   Size};
+        } else if constexpr (std::is_same_v<FieldT,
+                                            std::span<std::uint8_t const>>) {
+          auto const *Data = sqlite3_column_blob(Handle, I);
+          auto Size = std::size_t(sqlite3_column_bytes(Handle, I));
+          Field = {reinterpret_cast<std::uint8_t const *>(
+                       Result.Arena.copy(Data, Size)),
+                   Size};
+        } else if (Read) {
+          Read = readColumn(I, Field);
+        }
+      });
+      if (!Read) [[unlikely]]
+        return std::unexpected(Read.error());
+    }
+  }
+
   template <class... Ts>
   auto readTuple() noexcept -> ExpectedT<std::tuple<Ts...>> {
     std::tuple<Ts...> Result;
@@ -316,147 +768,2062 @@ struct Statement final {
     co_return;
   }
 
-private:
-  constexpr Statement(sqlite3_stmt *Handle) noexcept : Handle(Handle) {}
+  // runReading() under Limits; see step(QueryLimits). The handler is
+  // installed once for the whole scan rather than per row, so statements
+  // run on the connection while a row is being handled obey Limits too.
+  template <class... ColTs>
+  auto runReading(QueryLimits Limits)
+      -> Generator<ExpectedT<std::tuple<ColTs...>>> {
+    if (!Handle) [[unlikely]] {
+      co_yield std::unexpected("Statement handle is null");
+      co_return;
+    }
+    if (auto Stop = Limits.exceeded(); !Stop.empty()) [[unlikely]] {
+      co_yield std::unexpected(Stop);
+      co_return;
+    }
 
-private:
-  friend struct Connection;
+    LimitScope Scope(Handle, Limits);
+    while (true) {
+      auto E = Scope.check(step());
+      if (!E) [[unlikely]] {
+        co_yield std::unexpected(E.error());
+        co_return;
+      }
 
-private:
-  sqlite3_stmt *Handle{nullptr};
-};
+      if (*E == Statement::StepOk::STEP_DONE)
+        co_return;
 
-struct Connection final {
+      if (*E == Statement::StepOk::STEP_BUSY) [[unlikely]] {
+        co_yield std::unexpected("Db is busy");
+        co_return;
+      }
 
-  constexpr Connection() noexcept = default;
+      co_yield readTuple<ColTs...>();
+    }
+  }
 
-  constexpr Connection(Connection const &) = delete;
-  constexpr Connection &operator=(Connection const &) = delete;
+  // Same rows as runReading() as a plain input range over this statement:
+  // no coroutine frame, and rows are decoded on dereference.
+  template <class... ColTs>
+  auto runReadingRange() noexcept -> RowRange<ColTs...>;
+
+  // Columnar counterpart of runReading(): fills per-column buffers with up to
+  // BatchSize rows and yields views over them. Buffers are reused, so a batch
+  // is only valid until the generator is resumed. BatchSize must not be 0.
+  template <class... ColTs>
+  auto runReadingBatched(std::size_t BatchSize)
+      -> Generator<ExpectedT<ColumnBatch<ColTs...>>> {
+    if (!BatchSize) [[unlikely]] {
+      co_yield std::unexpected("Batch size must not be 0");
+      co_return;
+    }
 
-  constexpr Connection(Connection &&Other) noexcept
-      : RawHandle(std::exchange(Other.RawHandle, nullptr)) {}
+    std::tuple<ColumnBuffer<ColTs>...> Buffers;
+    auto Flush = [&Buffers](std::size_t Rows) {
+      return std::apply(
+          [Rows](auto const &...Bufs) {
+            return ColumnBatch<ColTs...>{Rows, {Bufs.view()...}};
+          },
+          Buffers);
+    };
 
-  constexpr Connection &operator=(Connection &&Other) noexcept {
-    if (this == &Other) [[unlikely]]
-      return *this;
-    this->~Connection();
+    while (true) {
+      std::apply([](auto &...Bufs) { (Bufs.clear(), ...); }, Buffers);
+
+      std::size_t Rows = 0;
+      for (; Rows < BatchSize; ++Rows) {
+        auto E = step();
+        if (!E) [[unlikely]] {
+          co_yield std::unexpected(E.error());
+          co_return;
+        }
+
+        if (*E == Statement::StepOk::STEP_DONE)
+          break;
+
+        if (*E == Statement::StepOk::STEP_BUSY) [[unlikely]] {
+          co_yield std::unexpected("Db is busy");
+          co_return;
+        }
+
+        staticFor<sizeof...(ColTs)>([&](auto I) {
+          std::get<I>(Buffers).append(Handle, I, Rows);
+        });
+      }
 
-    RawHandle = std::exchange(Other.RawHandle, nullptr);
-    return *this;
+      if (Rows)
+        co_yield Flush(Rows);
+      if (Rows < BatchSize)
+        co_return;
+    }
   }
 
-  ~Connection() noexcept { sqlite3_close(RawHandle); }
+private:
+  // Polls Limits from a progress handler and registers the connection with
+  // the token while alive.
+  struct LimitScope {
+    LimitScope(sqlite3_stmt *Stmt, QueryLimits const &Limits) noexcept
+        : Db(sqlite3_db_handle(Stmt)), Limits(Limits) {
+      sqlite3_progress_handler(
+          Db, Limits.CheckEvery,
+          [](void *L) -> int {
+            return !static_cast<QueryLimits const *>(L)->exceeded().empty();
+          },
+          const_cast<QueryLimits *>(&Limits));
+      if (Limits.Token)
+        Limits.Token->attach(Db);
+    }
 
-  auto prepare(std::string_view Sql) noexcept -> ExpectedT<Statement> {
-    if (!RawHandle) [[unlikely]]
-      return std::unexpected("DB handle is null");
+    LimitScope(LimitScope const &) = delete;
+    auto operator=(LimitScope const &) -> LimitScope & = delete;
 
-    sqlite3_stmt *Handle = nullptr;
+    ~LimitScope() noexcept {
+      if (Limits.Token)
+        Limits.Token->detach(Db);
+      sqlite3_progress_handler(Db, 0, nullptr, nullptr);
+    }
 
-    int E =
-        sqlite3_prepare_v2(RawHandle, Sql.data(), Sql.size(), &Handle, nullptr);
-    if (E != SQLITE_OK) [[unlikely]] {
-      return std::unexpected(sqlite3_errstr(E));
+    // Replaces the generic error of an interrupted step with the reason.
+    auto check(ExpectedT<StepOk> E) const noexcept -> ExpectedT<StepOk> {
+      if (!E && sqlite3_errcode(Db) == SQLITE_INTERRUPT) [[unlikely]]
+        if (auto Stop = Limits.exceeded(); !Stop.empty())
+          return std::unexpected(Stop);
+      return E;
     }
 
-    return {Statement(Handle)};
-  }
+    sqlite3 *Db;
+    QueryLimits const &Limits;
+  };
 
-  template <class... Ts>
-  auto run(std::string_view Sql, Ts &&...BindParams) noexcept
-      -> ExpectedT<void> {
-    auto Stmt = prepare(Sql);
-    if (!Stmt) [[unlikely]]
-      return std::unexpected(Stmt.error());
+  constexpr Statement(sqlite3_stmt *Handle) noexcept : Handle(Handle) {}
 
-    if (auto E = Stmt->bindParams(1, std::forward<Ts>(BindParams)...); !E) {
-      return E;
-    }
+  using OwnedParam = std::variant<std::monostate, std::string,
+                                  std::vector<char>, std::vector<std::uint8_t>>;
 
-    if (auto E = Stmt->step(); !E) [[unlikely]] {
-      return std::unexpected(Stmt.error());
-    }
+  // Sized once to the parameter count so kept buffers never move.
+  auto ownedSlot(unsigned Ind) noexcept -> OwnedParam * {
+    if (!Handle) [[unlikely]]
+      return nullptr;
+    if (Owned.empty())
+      Owned.resize(sqlite3_bind_parameter_count(Handle));
+    return Ind >= 1 && Ind <= Owned.size() ? &Owned[Ind - 1] : nullptr;
+  }
 
-    return {};
+  template <class T>
+  static auto asBytes(T const &S) noexcept -> std::span<std::uint8_t const> {
+    return {reinterpret_cast<std::uint8_t const *>(std::data(S)),
+            std::size(S)};
   }
 
-  auto run(std::string_view Sql) noexcept -> ExpectedT<void> {
-    auto Stmt = prepare(Sql);
-    if (!Stmt) [[unlikely]]
-      return std::unexpected(Stmt.error());
+private:
+  friend struct Connection;
 
-    if (auto E = Stmt->step(); !E) [[unlikely]] {
-      return std::unexpected(Stmt.error());
-    }
+private:
+  sqlite3_stmt *Handle{nullptr};
+  // Payloads moved in by bindText(string&&) / bindBlob(vector&&), indexed
+  // by parameter. Destroyed after the statement is finalized.
+  std::vector<OwnedParam> Owned;
+};
 
-    return {};
-  }
+// Incremental I/O handle over one BLOB (or TEXT) value, opened with
+// Connection::openBlob(). Reads and writes go straight between SQLite's pages
+// and caller memory without materializing the value. A write can change
+// bytes but never the size; reserve space with Statement::bindZeroBlob().
+struct Blob final {
+  constexpr Blob() noexcept = default;
 
-  template <class... ColTs, class... BindTs>
-  auto runReading(std::string_view Sql, BindTs &&...BindParams)
-      -> Generator<ExpectedT<std::tuple<ColTs...>>> {
-    auto Stmt = prepare(Sql);
-    if (!Stmt) [[unlikely]]
-      co_return std::unexpected(Stmt.error());
+  constexpr Blob(Blob const &) = delete;
+  constexpr Blob &operator=(Blob const &) = delete;
 
-    if (auto E = Stmt->bindParams(1, std::forward<BindTs>(BindParams)...); !E)
-        [[unlikely]] {
-      co_return E;
-    }
+  constexpr Blob(Blob &&Other) noexcept
+      : Handle(std::exchange(Other.Handle, nullptr)) {}
 
-    for (auto&& Value : Stmt->runReading<ColTs...>())
-      co_yield std::forward<decltype(Value)>(Value);
+  constexpr Blob &operator=(Blob &&Other) noexcept {
+    if (this == &Other) [[unlikely]]
+      return *this;
+    this->~Blob();
+    Handle = std::exchange(Other.Handle, nullptr);
+    return *this;
   }
 
-  template <class... ColTs>
-  auto runReading(std::string_view Sql)
-      -> Generator<ExpectedT<std::tuple<ColTs...>>> {
-    auto Stmt = prepare(Sql);
-    if (!Stmt) [[unlikely]] {
-      co_yield std::unexpected(Stmt.error());
-      co_return;
-    }
+  ~Blob() noexcept { sqlite3_blob_close(Handle); }
 
-    for (auto&& Value : Stmt->runReading<ColTs...>())
-      co_yield std::forward<decltype(Value)>(Value);
+  auto size() const noexcept -> std::size_t {
+    return Handle ? sqlite3_blob_bytes(Handle) : 0;
   }
 
-private:
-  constexpr Connection(sqlite3 *RawHandle) noexcept : RawHandle(RawHandle) {}
+  auto read(std::span<std::uint8_t> Out, std::size_t Offset) noexcept
+      -> ExpectedT<void> {
+    if (!Handle) [[unlikely]]
+      return std::unexpected("Blob handle is null");
 
-  friend auto open(std::string_view Path) noexcept -> ExpectedT<Connection> {
-    sqlite3 *Handle = nullptr;
-    auto E = sqlite3_open(Path.data(), &Handle);
+    int E = sqlite3_blob_read(Handle, Out.data(), Out.size(), Offset);
     if (E != SQLITE_OK) [[unlikely]]
       return std::unexpected(sqlite3_errstr(E));
-    return {Connection(Handle)};
+    return {};
   }
 
-  friend auto open16(std::string_view Path) noexcept -> ExpectedT<Connection> {
-    sqlite3 *Handle = nullptr;
-    auto E = sqlite3_open16(Path.data(), &Handle);
+  auto write(std::span<std::uint8_t const> In, std::size_t Offset) noexcept
+      -> ExpectedT<void> {
+    if (!Handle) [[unlikely]]
+      return std::unexpected("Blob handle is null");
+
+    int E = sqlite3_blob_write(Handle, In.data(), In.size(), Offset);
     if (E != SQLITE_OK) [[unlikely]]
       return std::unexpected(sqlite3_errstr(E));
-    return {Connection(Handle)};
+    return {};
   }
 
-  friend auto open_v2(std::string_view Path, int Flags) noexcept
-      -> ExpectedT<Connection> {
-    sqlite3 *Handle = nullptr;
-    auto E = sqlite3_open_v2(Path.data(), &Handle, Flags, nullptr);
+  // Points the handle at another row of the same table and column, which is
+  // much cheaper than opening a new handle.
+  auto reopen(std::int64_t Rowid) noexcept -> ExpectedT<void> {
+    if (!Handle) [[unlikely]]
+      return std::unexpected("Blob handle is null");
+
+    int E = sqlite3_blob_reopen(Handle, Rowid);
     if (E != SQLITE_OK) [[unlikely]]
       return std::unexpected(sqlite3_errstr(E));
-    return {Connection(Handle)};
+    return {};
+  }
+
+  // Streams the value through Buffer, calling Sink(std::span<uint8_t const>)
+  // once per chunk.
+  template <class SinkT>
+  auto readChunks(std::span<std::uint8_t> Buffer, SinkT &&Sink) noexcept
+      -> ExpectedT<void> {
+    if (Buffer.empty()) [[unlikely]]
+      return std::unexpected("Chunk buffer is empty");
+
+    auto Total = size();
+    for (std::size_t Offset = 0; Offset < Total; Offset += Buffer.size()) {
+      auto Chunk = Buffer.first(std::min(Buffer.size(), Total - Offset));
+      if (auto E = read(Chunk, Offset); !E) [[unlikely]]
+        return E;
+      Sink(std::span<std::uint8_t const>(Chunk));
+    }
+    return {};
+  }
+
+  // Fills the value through Buffer: Source(std::span<uint8_t>) stores up to
+  // Buffer.size() bytes and returns how many, 0 meaning end of input. Returns
+  // the number of bytes written.
+  template <class SourceT>
+  auto writeChunks(std::span<std::uint8_t> Buffer, SourceT &&Source) noexcept
+      -> ExpectedT<std::size_t> {
+    if (Buffer.empty()) [[unlikely]]
+      return std::unexpected("Chunk buffer is empty");
+
+    auto Total = size();
+    std::size_t Offset = 0;
+    while (Offset < Total) {
+      auto Want = std::min(Buffer.size(), Total - Offset);
+      std::size_t Got = Source(Buffer.first(Want));
+      if (!Got)
+        break;
+      if (auto E = write(Buffer.first(std::min(Got, Want)), Offset); !E)
+          [[unlikely]]
+        return std::unexpected(E.error());
+      Offset += std::min(Got, Want);
+    }
+    return Offset;
   }
 
 private:
-  sqlite3 *RawHandle{nullptr};
+  constexpr Blob(sqlite3_blob *Handle) noexcept : Handle(Handle) {}
+
+private:
+  friend struct Connection;
+
+private:
+  sqlite3_blob *Handle{nullptr};
 };
 
-ExpectedT<Connection> open_v2(std::string_view Path, int Flags) noexcept;
-ExpectedT<Connection> open16(std::string_view Path) noexcept;
+// A database image produced by Connection::serialize(), in memory owned by
+// SQLite.
+struct DatabaseImage {
+  struct Free {
+    void operator()(unsigned char *P) const noexcept { sqlite3_free(P); }
+  };
+
+  std::unique_ptr<unsigned char, Free> Data;
+  std::size_t Size{0};
+
+  auto bytes() const noexcept -> std::span<std::byte const> {
+    return {reinterpret_cast<std::byte const *>(Data.get()), Size};
+  }
+};
+
+enum class BackupMethod {
+  // sqlite3_backup: copies pages in small steps, throttled and with
+  // progress reports.
+  Pages,
+  // VACUUM INTO: one statement that writes a compacted copy. Dest must not
+  // exist or be empty.
+  VacuumInto,
+};
+
+struct BackupProgress {
+  // Pages left and total pages in the source, as of the last step.
+  int Remaining{0};
+  int PageCount{0};
+  std::size_t Steps{0};
+  // Times the copy started over because the source was written to.
+  std::size_t Restarts{0};
+};
+
+struct BackupOptions {
+  BackupMethod Method{BackupMethod::Pages};
+  // Pages copied per sqlite3_backup_step(); each step holds the source read
+  // lock only for its own duration.
+  int PagesPerStep{64};
+  // Sleep between steps; zero yields instead.
+  std::chrono::microseconds Pause{1000};
+  // On a WAL source, keep one read transaction open for the whole copy.
+  // Writers are not blocked in WAL mode, and the backup is a consistent
+  // snapshot that never restarts. Other journal modes always release the
+  // lock between steps.
+  bool PinSnapshot{true};
+  // A source written between steps makes the copy start over. After this
+  // many restarts the rest is copied in a single step.
+  std::size_t MaxRestarts{8};
+  // Called on the backup thread after every step.
+  std::function<void(BackupProgress const &)> OnProgress{};
+};
+
+// A backup running on its own thread. Destroying an unfinished job cancels
+// it.
+struct BackupJob final {
+  BackupJob() noexcept = default;
+
+  // Stops at the next step. The destination's write transaction is rolled
+  // back, leaving it as it was before the backup (a VACUUM INTO target is
+  // removed).
+  void cancel() noexcept { Worker.request_stop(); }
+
+  // True once the backup has ended, and for a job that was already waited
+  // for or never started.
+  auto finished() const noexcept -> bool {
+    return !Result.valid() || Result.wait_for(std::chrono::seconds(0)) ==
+                                  std::future_status::ready;
+  }
+
+  // Blocks until the backup ends. Only the first call gets its outcome.
+  auto wait() noexcept -> ExpectedT<BackupProgress> {
+    if (!Result.valid()) [[unlikely]]
+      return std::unexpected("No backup to wait for");
+    return Result.get();
+  }
+
+private:
+  friend struct Connection;
+
+  std::future<ExpectedT<BackupProgress>> Result;
+  // Last, so the thread is stopped and joined before Result goes away.
+  std::jthread Worker;
+};
+
+#ifdef SQLITE_ENABLE_SESSION
+enum class ConflictPolicy {
+  // Stop and roll the whole changeset back.
+  Abort,
+  // Skip the conflicting change.
+  Omit,
+  // Overwrite the conflicting row; changes to a missing row are skipped.
+  Replace,
+};
+
+// Records the changes made through one connection to the attached tables
+// with the session extension and serializes them as a changeset (old and
+// new values, so conflicts can be detected when applying) or a patchset
+// (new values and primary keys only, smaller). Only tables with a declared
+// PRIMARY KEY are recorded. A session must not outlive its connection.
+struct ChangeSession final {
+  ChangeSession() noexcept = default;
+  ChangeSession(ChangeSession const &) = delete;
+  auto operator=(ChangeSession const &) -> ChangeSession & = delete;
+  ChangeSession(ChangeSession &&Other) noexcept
+      : Handle(std::exchange(Other.Handle, nullptr)),
+        Alive(std::move(Other.Alive)) {}
+  auto operator=(ChangeSession &&Other) noexcept -> ChangeSession & {
+    std::swap(Handle, Other.Handle);
+    std::swap(Alive, Other.Alive);
+    return *this;
+  }
+
+  ~ChangeSession() noexcept {
+    if (Handle)
+      sqlite3session_delete(Handle);
+  }
+
+  // Everything recorded since the session started; recording goes on.
+  auto changeset() const noexcept -> ExpectedT<std::vector<std::uint8_t>> {
+    return serialize(&sqlite3session_changeset);
+  }
+
+  auto patchset() const noexcept -> ExpectedT<std::vector<std::uint8_t>> {
+    return serialize(&sqlite3session_patchset);
+  }
+
+  auto empty() const noexcept -> bool {
+    return !Handle || sqlite3session_isempty(Handle);
+  }
+
+  auto nativeHandle() const noexcept -> sqlite3_session * { return Handle; }
+
+private:
+  friend struct Connection;
+
+  ChangeSession(sqlite3_session *Handle, std::shared_ptr<int> Alive) noexcept
+      : Handle(Handle), Alive(std::move(Alive)) {}
+
+  auto serialize(int (*Fn)(sqlite3_session *, int *, void **)) const noexcept
+      -> ExpectedT<std::vector<std::uint8_t>> {
+    if (!Handle) [[unlikely]]
+      return std::unexpected("Session handle is null");
+    int Size = 0;
+    void *Data = nullptr;
+    int E = Fn(Handle, &Size, &Data);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    auto const *Bytes = static_cast<std::uint8_t const *>(Data);
+    std::vector<std::uint8_t> Result(Bytes, Bytes + Size);
+    sqlite3_free(Data);
+    return Result;
+  }
+
+  sqlite3_session *Handle{nullptr};
+  std::shared_ptr<int> Alive;
+};
+#endif
+
+struct StatementCacheStats {
+  std::size_t Hits{0};
+  std::size_t Misses{0};
+  std::size_t Evictions{0};
+};
+
+struct StatementCache;
+
+// Lease over a prepared statement handed out by a StatementCache. On
+// destruction the statement is reset, its bindings are cleared and it is
+// returned to the cache. A lease may outlive its Connection object: the
+// cache stays behind until the last lease is released, and then finalizes
+// the statement, which lets SQLite close the database.
+struct CachedStatement final {
+  CachedStatement() noexcept = default;
+
+  CachedStatement(CachedStatement const &) = delete;
+  CachedStatement &operator=(CachedStatement const &) = delete;
+
+  CachedStatement(CachedStatement &&Other) noexcept
+      : Owner(std::exchange(Other.Owner, nullptr)), Slot(Other.Slot),
+        Owned(std::move(Other.Owned)) {}
+
+  CachedStatement &operator=(CachedStatement &&Other) noexcept {
+    if (this == &Other) [[unlikely]]
+      return *this;
+    release();
+    Owner = std::exchange(Other.Owner, nullptr);
+    Slot = Other.Slot;
+    Owned = std::move(Other.Owned);
+    return *this;
+  }
+
+  ~CachedStatement() noexcept { release(); }
+
+  auto operator*() noexcept -> Statement &;
+  auto operator->() noexcept -> Statement * { return &**this; }
+
+private:
+  struct Entry {
+    std::string Sql;
+    Statement Stmt;
+    bool InUse{false};
+  };
+  using SlotT = std::list<Entry>::iterator;
+
+  CachedStatement(StatementCache *Owner, SlotT Slot) noexcept
+      : Owner(Owner), Slot(Slot) {}
+
+  CachedStatement(Statement &&Stmt) noexcept : Owned(std::move(Stmt)) {}
+
+  void release() noexcept;
+
+  friend struct StatementCache;
+
+private:
+  // Non-null iff the statement lives in the cache slot; otherwise the lease
+  // owns an uncached statement that is finalized on release.
+  StatementCache *Owner{nullptr};
+  SlotT Slot{};
+  Statement Owned;
+};
+
+// Bounded LRU of prepared statements keyed by SQL text. A statement checked
+// out of the cache is marked in use and is never handed out twice; a second
+// concurrent request for the same SQL gets a private, uncached statement.
+struct StatementCache final {
+  static constexpr std::size_t DefaultCapacity = 16;
+
+  StatementCache() noexcept = default;
+
+  StatementCache(StatementCache const &) = delete;
+  StatementCache &operator=(StatementCache const &) = delete;
+
+  template <class PrepareT>
+  auto acquire(std::string_view Sql, PrepareT &&Prepare) noexcept
+      -> ExpectedT<CachedStatement> {
+    if (auto It = Index.find(Sql); It != Index.end()) {
+      auto Slot = It->second;
+      if (!Slot->InUse) {
+        ++Stats.Hits;
+        Slot->InUse = true;
+        Lru.splice(Lru.begin(), Lru, Slot);
+        return {CachedStatement(this, Slot)};
+      }
+    }
+
+    ++Stats.Misses;
+    ExpectedT<Statement> Stmt = Prepare(Sql);
+    if (!Stmt) [[unlikely]]
+      return std::unexpected(Stmt.error());
+
+    if (Index.contains(Sql) || !makeRoom(1))
+      return {CachedStatement(std::move(*Stmt))};
+
+    Lru.push_front({std::string(Sql), std::move(*Stmt), true});
+    Index.emplace(Lru.front().Sql, Lru.begin());
+    return {CachedStatement(this, Lru.begin())};
+  }
+
+  void setCapacity(std::size_t NewCapacity) noexcept {
+    Capacity = NewCapacity;
+    makeRoom(0);
+  }
+
+  auto capacity() const noexcept -> std::size_t { return Capacity; }
+  auto size() const noexcept -> std::size_t { return Lru.size(); }
+  auto stats() const noexcept -> StatementCacheStats { return Stats; }
+
+  // Called when the connection closes. Idle statements are finalized
+  // now; while leases are outstanding the cache owns itself and goes away
+  // with the last one.
+  static void retire(std::unique_ptr<StatementCache> Self) noexcept {
+    Self->clear();
+    if (Self->Lru.empty())
+      return;
+    Self->Retired = true;
+    (void)Self.release();
+  }
+
+  // Finalizes every idle statement. Statements currently leased out are
+  // finalized when their lease is released.
+  void clear() noexcept {
+    for (auto It = Lru.begin(); It != Lru.end();) {
+      if (It->InUse) {
+        ++It;
+        continue;
+      }
+      Index.erase(It->Sql);
+      It = Lru.erase(It);
+    }
+  }
+
+private:
+  // Evicts idle entries from the LRU end until Extra more fit. Returns false
+  // if that is impossible because the remaining entries are all in use.
+  auto makeRoom(std::size_t Extra) noexcept -> bool {
+    if (Capacity < Extra)
+      return false;
+    auto It = Lru.end();
+    while (Lru.size() + Extra > Capacity && It != Lru.begin()) {
+      --It;
+      if (It->InUse)
+        continue;
+      Index.erase(It->Sql);
+      It = Lru.erase(It);
+      ++Stats.Evictions;
+    }
+    return Lru.size() + Extra <= Capacity;
+  }
+
+  void release(CachedStatement::SlotT Slot) noexcept {
+    if (Retired) [[unlikely]] {
+      Index.erase(Slot->Sql);
+      Lru.erase(Slot);
+      if (Lru.empty())
+        delete this;
+      return;
+    }
+    (void)Slot->Stmt.reset();
+    (void)Slot->Stmt.clearBindings();
+    Slot->InUse = false;
+    makeRoom(0);
+  }
+
+  friend struct CachedStatement;
+
+private:
+  std::list<CachedStatement::Entry> Lru;
+  std::unordered_map<std::string_view, CachedStatement::SlotT> Index;
+  std::size_t Capacity{DefaultCapacity};
+  StatementCacheStats Stats;
+  bool Retired{false};
+};
+
+inline auto CachedStatement::operator*() noexcept -> Statement & {
+  return Owner ? Slot->Stmt : Owned;
+}
+
+inline void CachedStatement::release() noexcept {
+  if (Owner)
+    std::exchange(Owner, nullptr)->release(Slot);
+  Owned = Statement();
+}
+
+// Input range over the rows of a statement, either borrowed or leased from
+// the statement cache. Yields ExpectedT<std::tuple<ColTs...>> like the
+// runReading() generators, ending after the first error, but steps the
+// statement directly: iterating allocates nothing and every row is decoded
+// exactly once, in operator*. Views into text and blob columns are valid
+// until the next increment.
+template <class... ColTs> struct RowRange final {
+  using RowT = ExpectedT<std::tuple<ColTs...>>;
+
+  struct Iterator {
+    using value_type = RowT;
+    using difference_type = std::ptrdiff_t;
+
+    auto operator*() const noexcept -> RowT { return Range->current(); }
+
+    auto operator++() noexcept -> Iterator & {
+      Range->advance();
+      return *this;
+    }
+    void operator++(int) noexcept { ++*this; }
+
+    friend auto operator==(Iterator const &It, std::default_sentinel_t) noexcept
+        -> bool {
+      return It.done();
+    }
+
+    auto done() const noexcept -> bool {
+      return Range->State == Position::Done;
+    }
+
+    RowRange *Range{nullptr};
+  };
+
+  explicit RowRange(Statement &Stmt) noexcept : Borrowed(&Stmt) {}
+
+  explicit RowRange(ExpectedT<CachedStatement> Stmt) noexcept {
+    if (Stmt) [[likely]] {
+      Lease = std::move(*Stmt);
+    } else {
+      State = Position::Error;
+      Error = Stmt.error();
+    }
+  }
+
+  RowRange(RowRange &&) noexcept = default;
+  RowRange &operator=(RowRange &&) noexcept = default;
+
+  // Steps to the first row; an input range is only walked once.
+  auto begin() noexcept -> Iterator {
+    if (State == Position::Start)
+      advance();
+    return {this};
+  }
+
+  auto end() const noexcept -> std::default_sentinel_t { return {}; }
+
+private:
+  enum class Position { Start, Row, Error, Done };
+
+  auto statement() noexcept -> Statement & {
+    return Borrowed ? *Borrowed : *Lease;
+  }
+
+  void advance() noexcept {
+    if (State == Position::Error || State == Position::Done) {
+      State = Position::Done;
+      return;
+    }
+    auto E = statement().step();
+    if (!E) [[unlikely]] {
+      State = Position::Error;
+      Error = E.error();
+    } else if (*E == Statement::StepOk::STEP_DONE) {
+      State = Position::Done;
+    } else if (*E == Statement::StepOk::STEP_BUSY) [[unlikely]] {
+      State = Position::Error;
+      Error = "Db is busy";
+    } else {
+      State = Position::Row;
+    }
+  }
+
+  auto current() noexcept -> RowT {
+    if (State == Position::Error) [[unlikely]]
+      return std::unexpected(Error);
+    return statement().template readTuple<ColTs...>();
+  }
+
+  Statement *Borrowed{nullptr};
+  CachedStatement Lease;
+  Position State{Position::Start};
+  std::string_view Error;
+};
+
+template <class... ColTs>
+inline auto Statement::runReadingRange() noexcept -> RowRange<ColTs...> {
+  return RowRange<ColTs...>(*this);
+}
+
+struct ResultCacheOptions {
+  // Upper bound on the memory held by cached rows and their keys.
+  std::size_t MaxBytes{16 << 20};
+  // Larger results are still streamed to the caller but not cached.
+  std::size_t MaxEntryBytes{1 << 20};
+  // Also notice commits from other connections through PRAGMA data_version,
+  // at the cost of one extra step per lookup.
+  bool CheckDataVersion{true};
+};
+
+struct ResultCacheStats {
+  std::uint64_t Hits{0};
+  std::uint64_t Misses{0};
+  // Entries dropped because a table they read changed.
+  std::uint64_t Invalidations{0};
+  // Entries dropped to stay within MaxBytes.
+  std::uint64_t Evictions{0};
+  std::size_t Entries{0};
+  std::size_t Bytes{0};
+
+  auto hitRatio() const noexcept -> double {
+    auto Lookups = Hits + Misses;
+    return Lookups ? double(Hits) / Lookups : 0;
+  }
+};
+
+// Materialized query results keyed by SQL, column types and bound values.
+// Each result is one contiguous buffer of encoded rows that is replayed
+// into tuples on a hit.
+//
+// Invalidation is per table: the tables a query reads are captured once
+// per SQL text from its EXPLAIN bytecode, and sqlite3_update_hook() bumps a
+// version per table on every row change, so stale entries are detected on
+// lookup. Changes the update hook does not report (WITHOUT ROWID tables,
+// the truncate optimization) show up as a sqlite3_total_changes64() delta
+// the hook did not account for and flush the whole cache, as do commits by
+// other connections seen through PRAGMA data_version. Results are only
+// stored outside explicit transactions, so a rollback can never leave a
+// cached result behind.
+//
+// Owned by Connection, whose update hook it shares with the change feed.
+struct ResultCache final {
+  struct Entry {
+    std::string Key;
+    // The arena: every row, column after column. Numbers are stored raw,
+    // text and blobs as a 32-bit length followed by the bytes.
+    std::vector<std::byte> Rows;
+    std::size_t RowCount{0};
+    // Version of every table read, as of the start of the query.
+    std::vector<std::pair<std::uint64_t const *, std::uint64_t>> Tables;
+
+    auto bytes() const noexcept -> std::size_t {
+      return sizeof(Entry) + Key.size() + Rows.size() +
+             Tables.size() * sizeof(Tables[0]);
+    }
+  };
+  using EntryPtr = std::shared_ptr<Entry const>;
+
+  // A result being recorded while it streams to the caller.
+  struct Pending {
+    Entry Result;
+    std::uint64_t Epoch{0};
+    bool Cacheable{true};
+  };
+
+  ResultCache(sqlite3 *Db, ResultCacheOptions Options) noexcept
+      : Db(Db), Options(Options) {
+    LastTotal = sqlite3_total_changes64(Db);
+    if (Options.CheckDataVersion &&
+        sqlite3_prepare_v2(Db, "PRAGMA data_version", -1, &DataVersion,
+                           nullptr) == SQLITE_OK &&
+        sqlite3_step(DataVersion) == SQLITE_ROW)
+      LastDataVersion = sqlite3_column_int64(DataVersion, 0);
+    sqlite3_reset(DataVersion);
+  }
+
+  ResultCache(ResultCache const &) = delete;
+  ResultCache &operator=(ResultCache const &) = delete;
+
+  ~ResultCache() noexcept { sqlite3_finalize(DataVersion); }
+
+  auto stats() const noexcept -> ResultCacheStats {
+    auto Result = Stats;
+    Result.Entries = Lru.size();
+    Result.Bytes = Bytes;
+    return Result;
+  }
+
+  void clear() noexcept {
+    Lru.clear();
+    Index.clear();
+    Bytes = 0;
+    ++Epoch;
+  }
+
+  // Flushes everything if the database changed in a way the per-table
+  // versions cannot attribute.
+  void sync() noexcept {
+    auto Total = sqlite3_total_changes64(Db);
+    bool Unexplained = std::uint64_t(Total - LastTotal) != HookChanges;
+    LastTotal = Total;
+    HookChanges = 0;
+    if (DataVersion && sqlite3_step(DataVersion) == SQLITE_ROW) {
+      auto Version = sqlite3_column_int64(DataVersion, 0);
+      Unexplained |= Version != LastDataVersion;
+      LastDataVersion = Version;
+    }
+    sqlite3_reset(DataVersion);
+    if (Unexplained && !Lru.empty())
+      clear();
+  }
+
+  template <class... ColTs, class... BindTs>
+  static auto key(std::string_view Sql, BindTs const &...BindParams) noexcept
+      -> std::string {
+    std::string Key(Sql);
+    // Distinguishes the same SQL read as different column types.
+    auto const *Tag = &TypeTag<ColTs...>::Id;
+    Key.append(reinterpret_cast<char const *>(&Tag), sizeof(Tag));
+    (appendParam(Key, BindParams), ...);
+    return Key;
+  }
+
+  auto find(std::string const &Key) noexcept -> EntryPtr {
+    auto It = Index.find(Key);
+    if (It == Index.end()) {
+      ++Stats.Misses;
+      return nullptr;
+    }
+    auto Slot = It->second;
+    auto Stale = std::ranges::any_of((*Slot)->Tables, [](auto const &T) {
+      return *T.first != T.second;
+    });
+    if (Stale) {
+      erase(Slot);
+      ++Stats.Invalidations;
+      ++Stats.Misses;
+      return nullptr;
+    }
+    ++Stats.Hits;
+    Lru.splice(Lru.begin(), Lru, Slot);
+    return *Slot;
+  }
+
+  auto begin(std::string_view Sql, std::string &&Key) noexcept -> Pending {
+    Pending P;
+    P.Result.Key = std::move(Key);
+    P.Epoch = Epoch;
+    P.Cacheable = sqlite3_get_autocommit(Db);
+    auto Tables = tablesOf(Sql);
+    if (!Tables) {
+      P.Cacheable = false;
+      return P;
+    }
+    for (auto *Version : *Tables)
+      P.Result.Tables.emplace_back(Version, *Version);
+    return P;
+  }
+
+  template <class... ColTs>
+  void record(Statement &Stmt, Pending &P) noexcept {
+    if (!P.Cacheable)
+      return;
+    int Idx = 0;
+    (encode<ColTs>(Stmt, Idx++, P.Result.Rows), ...);
+    ++P.Result.RowCount;
+    if (P.Result.Rows.size() > Options.MaxEntryBytes) {
+      P.Cacheable = false;
+      P.Result.Rows = {};
+    }
+  }
+
+  void insert(Pending &&P) noexcept {
+    // Skip results that a flush overtook or that saw uncommitted data.
+    if (!P.Cacheable || P.Epoch != Epoch || !sqlite3_get_autocommit(Db))
+      return;
+    if (auto It = Index.find(P.Result.Key); It != Index.end())
+      erase(It->second);
+    auto E = std::make_shared<Entry>(std::move(P.Result));
+    E->Rows.shrink_to_fit();
+    Bytes += E->bytes();
+    Lru.push_front(std::move(E));
+    Index.emplace(Lru.front()->Key, Lru.begin());
+    while (Bytes > Options.MaxBytes && !Lru.empty()) {
+      erase(std::prev(Lru.end()));
+      ++Stats.Evictions;
+    }
+  }
+
+  template <class T> static void decode(std::byte const *&In, T &Col) noexcept {
+    if constexpr (is_sqlite_numeric_v<T>) {
+      std::memcpy(&Col, In, sizeof(T));
+      In += sizeof(T);
+    } else {
+      std::uint32_t Size;
+      std::memcpy(&Size, In, sizeof(Size));
+      In += sizeof(Size);
+      if constexpr (std::is_assignable_v<T &, std::string_view>)
+        Col = std::string_view(reinterpret_cast<char const *>(In), Size);
+      else
+        Col = std::span<std::uint8_t const>(
+            reinterpret_cast<std::uint8_t const *>(In), Size);
+      In += Size;
+    }
+  }
+
+  // Called from the connection's update hook for every row change.
+  static void onUpdate(void *Ctx, int, char const *, char const *Table,
+                       sqlite3_int64) noexcept {
+    auto &C = *static_cast<ResultCache *>(Ctx);
+    ++C.HookChanges;
+    // Row changes arrive in runs against the same table.
+    if (C.LastTable != Table) {
+      C.LastTable = Table;
+      auto It = C.TableVersions.find(C.LastTable);
+      C.LastVersion = It == C.TableVersions.end() ? nullptr : &It->second;
+    }
+    if (C.LastVersion)
+      ++*C.LastVersion;
+  }
+
+private:
+  using SlotT = std::list<EntryPtr>::iterator;
+
+  template <class...> struct TypeTag {
+    static constexpr char Id = 0;
+  };
+
+  template <class T> static void appendParam(std::string &Key, T const &P) {
+    auto Append = [&Key](char Tag, void const *Data, std::size_t Size) {
+      Key.push_back(Tag);
+      Key.append(reinterpret_cast<char const *>(&Size), sizeof(Size));
+      Key.append(static_cast<char const *>(Data), Size);
+    };
+    if constexpr (is_borrowed_v<T>) {
+      appendParam(Key, P.Value);
+    } else if constexpr (is_sqlite_numeric_v<T>) {
+      Append(std::is_same_v<T, double> ? 'd' : 'i', &P, sizeof(P));
+    } else if constexpr (is_sqlite_text<T>) {
+      Append('t', std::data(P), std::size(P));
+    } else if constexpr (is_sqlite_blob<T>) {
+      Append('b', std::data(P), std::size(P));
+    } else if constexpr (is_sqlite_null<T>) {
+      Append('n', nullptr, 0);
+    } else {
+      static_assert(always_false_v<T>,
+                    "Parameter type cannot be part of a cache key");
+    }
+  }
+
+  template <class T>
+  static void encode(Statement &Stmt, int Idx,
+                     std::vector<std::byte> &Out) noexcept {
+    auto Append = [&Out](void const *Data, std::size_t Size) {
+      auto const *Bytes = static_cast<std::byte const *>(Data);
+      Out.insert(Out.end(), Bytes, Bytes + Size);
+    };
+    if constexpr (is_sqlite_numeric_v<T>) {
+      T Value{};
+      (void)Stmt.readNumeric(Idx, Value);
+      Append(&Value, sizeof(Value));
+    } else {
+      std::span<std::byte const> Value;
+      if constexpr (std::is_assignable_v<T &, std::string_view>)
+        Value = std::as_bytes(std::span(*Stmt.readText(Idx)));
+      else
+        Value = std::as_bytes(*Stmt.readBlob(Idx));
+      auto Size = static_cast<std::uint32_t>(Value.size());
+      Append(&Size, sizeof(Size));
+      Append(Value.data(), Value.size());
+    }
+  }
+
+  // Version counters of the tables Sql reads, or null if they could not be
+  // determined. Captured once per SQL text.
+  auto tablesOf(std::string_view Sql) noexcept
+      -> std::vector<std::uint64_t *> const * {
+    auto [It, Inserted] = SqlTables.try_emplace(std::string(Sql));
+    if (!Inserted)
+      return &It->second;
+
+    auto Names = tableNamesOf(Sql);
+    if (!Names) [[unlikely]] {
+      SqlTables.erase(It);
+      return nullptr;
+    }
+
+    std::ranges::sort(*Names);
+    auto Unique = std::ranges::unique(*Names);
+    Names->erase(Unique.begin(), Unique.end());
+    for (auto &Name : *Names)
+      It->second.push_back(&TableVersions[std::move(Name)]);
+    // The update hook may have cached a miss for a table now watched.
+    LastTable.clear();
+    LastVersion = nullptr;
+    return &It->second;
+  }
+
+  // Reads the tables from the bytecode rather than through the authorizer,
+  // which belongs to the application: every OpenRead names the root page
+  // of a table or index, and sqlite_schema maps it back to its table.
+  auto tableNamesOf(std::string_view Sql) noexcept
+      -> std::optional<std::vector<std::string>> {
+    auto Explain = "EXPLAIN " + std::string(Sql);
+    sqlite3_stmt *Stmt = nullptr;
+    int E = sqlite3_prepare_v2(Db, Explain.c_str(), Explain.size(), &Stmt,
+                               nullptr);
+    // Columns: addr, opcode, p1, p2, p3, p4, p5, comment.
+    std::vector<std::pair<int, int>> Roots;
+    while (E == SQLITE_OK && sqlite3_step(Stmt) == SQLITE_ROW) {
+      std::string_view Op =
+          reinterpret_cast<char const *>(sqlite3_column_text(Stmt, 1));
+      if (Op == "OpenRead" || Op == "ReopenIdx")
+        Roots.emplace_back(sqlite3_column_int(Stmt, 4),
+                           sqlite3_column_int(Stmt, 3));
+    }
+    sqlite3_finalize(Stmt);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::nullopt;
+
+    std::ranges::sort(Roots);
+    auto Unique = std::ranges::unique(Roots);
+    Roots.erase(Unique.begin(), Unique.end());
+
+    std::vector<std::string> Names;
+    for (auto [Schema, Root] : Roots) {
+      // A page no table owns (sqlite_schema itself, say) cannot be
+      // watched, so the query is not cached.
+      auto const *SchemaName = sqlite3_db_name(Db, Schema);
+      if (!SchemaName) [[unlikely]]
+        return std::nullopt;
+      auto Lookup = std::string("SELECT tbl_name FROM \"") + SchemaName +
+                    "\".sqlite_schema WHERE rootpage = ?";
+      Stmt = nullptr;
+      bool Found =
+          sqlite3_prepare_v2(Db, Lookup.c_str(), Lookup.size(), &Stmt,
+                             nullptr) == SQLITE_OK &&
+          sqlite3_bind_int(Stmt, 1, Root) == SQLITE_OK &&
+          sqlite3_step(Stmt) == SQLITE_ROW;
+      if (Found)
+        Names.emplace_back(
+            reinterpret_cast<char const *>(sqlite3_column_text(Stmt, 0)));
+      sqlite3_finalize(Stmt);
+      if (!Found) [[unlikely]]
+        return std::nullopt;
+    }
+    return Names;
+  }
+
+  void erase(SlotT Slot) noexcept {
+    Bytes -= (*Slot)->bytes();
+    Index.erase((*Slot)->Key);
+    Lru.erase(Slot);
+  }
+
+  sqlite3 *Db;
+  ResultCacheOptions Options;
+  sqlite3_stmt *DataVersion{nullptr};
+  std::int64_t LastDataVersion{0};
+  std::int64_t LastTotal{0};
+  std::uint64_t HookChanges{0};
+  std::uint64_t Epoch{0};
+
+  std::list<EntryPtr> Lru;
+  std::unordered_map<std::string_view, SlotT> Index;
+  std::size_t Bytes{0};
+  ResultCacheStats Stats;
+
+  // Nodes are never erased, so Entry::Tables can point into them.
+  std::unordered_map<std::string, std::uint64_t> TableVersions;
+  std::unordered_map<std::string, std::vector<std::uint64_t *>> SqlTables;
+  std::string LastTable;
+  std::uint64_t *LastVersion{nullptr};
+};
+
+namespace detail {
+
+// A connection has a single sqlite3_update_hook(). Connection points it at
+// this dispatcher whenever the result cache or, without
+// SQLITE_ENABLE_PREUPDATE_HOOK, a change feed needs row changes.
+struct UpdateHooks {
+  ResultCache *Results{nullptr};
+  ChangeCapture *Changes{nullptr};
+
+  static void onUpdate(void *Self, int Op, char const *Schema,
+                       char const *Table, sqlite3_int64 RowId) noexcept {
+    auto &H = *static_cast<UpdateHooks *>(Self);
+    if (H.Results)
+      ResultCache::onUpdate(H.Results, Op, Schema, Table, RowId);
+#ifndef SQLITE_ENABLE_PREUPDATE_HOOK
+    if (H.Changes)
+      ChangeCapture::update(H.Changes, Op, Schema, Table, RowId);
+#endif
+  }
+};
+
+} // namespace detail
+
+struct Connection final {
+
+  Connection() noexcept = default;
+
+  constexpr Connection(Connection const &) = delete;
+  constexpr Connection &operator=(Connection const &) = delete;
+
+  Connection(Connection &&Other) noexcept
+      : RawHandle(std::exchange(Other.RawHandle, nullptr)),
+        Cache(std::move(Other.Cache)), Results(std::move(Other.Results)),
+        BorrowedImages(std::move(Other.BorrowedImages)),
+        Changes(std::move(Other.Changes)),
+        Sessions(std::move(Other.Sessions)),
+        Updates(std::move(Other.Updates)) {}
+
+  Connection &operator=(Connection &&Other) noexcept {
+    if (this == &Other) [[unlikely]]
+      return *this;
+    close();
+
+    RawHandle = std::exchange(Other.RawHandle, nullptr);
+    Cache = std::move(Other.Cache);
+    Results = std::move(Other.Results);
+    BorrowedImages = std::move(Other.BorrowedImages);
+    Changes = std::move(Other.Changes);
+    Sessions = std::move(Other.Sessions);
+    Updates = std::move(Other.Updates);
+    return *this;
+  }
+
+  ~Connection() noexcept { close(); }
+
+  auto prepare(std::string_view Sql) noexcept -> ExpectedT<Statement> {
+    if (!RawHandle) [[unlikely]]
+      return std::unexpected("DB handle is null");
+
+    sqlite3_stmt *Handle = nullptr;
+
+    int E =
+        sqlite3_prepare_v2(RawHandle, Sql.data(), Sql.size(), &Handle, nullptr);
+    if (E != SQLITE_OK) [[unlikely]] {
+      return std::unexpected(sqlite3_errstr(E));
+    }
+
+    return {Statement(Handle)};
+  }
+
+  // Same as prepare(), but goes through the per-connection statement cache.
+  // The returned lease gives the statement back to the cache on destruction.
+  auto prepareCached(std::string_view Sql) noexcept
+      -> ExpectedT<CachedStatement> {
+    if (!Cache) [[unlikely]]
+      return std::unexpected("DB handle is null");
+    return Cache->acquire(Sql,
+                          [this](std::string_view S) { return prepare(S); });
+  }
+
+  void setStatementCacheCapacity(std::size_t Capacity) noexcept {
+    if (Cache)
+      Cache->setCapacity(Capacity);
+  }
+
+  auto statementCacheStats() const noexcept -> StatementCacheStats {
+    return Cache ? Cache->stats() : StatementCacheStats{};
+  }
+
+  void clearStatementCache() noexcept {
+    if (Cache)
+      Cache->clear();
+  }
+
+  // Escape hatch for sqlite3 APIs the wrapper does not cover.
+  auto nativeHandle() const noexcept -> sqlite3 * { return RawHandle; }
+
+  // Per-connection lookaside allocator for small, short-lived objects. Fails
+  // with SQLITE_BUSY while lookaside memory is in use, so call it right
+  // after open().
+  auto setLookaside(int SlotSize, int Slots) noexcept -> ExpectedT<void> {
+    if (!RawHandle) [[unlikely]]
+      return std::unexpected("DB handle is null");
+
+    // Statements in the cache may hold lookaside memory.
+    clearStatementCache();
+    int E = sqlite3_db_config(RawHandle, SQLITE_DBCONFIG_LOOKASIDE, nullptr,
+                              SlotSize, Slots);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return {};
+  }
+
+  auto memoryStats() const noexcept -> ConnectionMemoryStats {
+    auto Get = [this](int Op) {
+      int Current = 0, Highwater = 0;
+      sqlite3_db_status(RawHandle, Op, &Current, &Highwater, 0);
+      // Hit/miss counters only report through the high-water value.
+      return Op == SQLITE_DBSTATUS_LOOKASIDE_HIT ||
+                     Op == SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE ||
+                     Op == SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL
+                 ? Highwater
+                 : Current;
+    };
+    if (!RawHandle) [[unlikely]]
+      return {};
+    return {Get(SQLITE_DBSTATUS_CACHE_USED),
+            Get(SQLITE_DBSTATUS_SCHEMA_USED),
+            Get(SQLITE_DBSTATUS_STMT_USED),
+            Get(SQLITE_DBSTATUS_LOOKASIDE_USED),
+            Get(SQLITE_DBSTATUS_LOOKASIDE_HIT),
+            Get(SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE),
+            Get(SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL)};
+  }
+
+  // Opens Table.Column at Rowid for incremental I/O. Db is the schema name
+  // ("main", "temp" or an attached database).
+  auto openBlob(std::string_view Table, std::string_view Column,
+                std::int64_t Rowid, bool Writable,
+                std::string_view Db = "main") noexcept -> ExpectedT<Blob> {
+    if (!RawHandle) [[unlikely]]
+      return std::unexpected("DB handle is null");
+
+    sqlite3_blob *Handle = nullptr;
+    int E = sqlite3_blob_open(RawHandle, std::string(Db).c_str(),
+                              std::string(Table).c_str(),
+                              std::string(Column).c_str(), Rowid, Writable,
+                              &Handle);
+    if (E != SQLITE_OK) [[unlikely]] {
+      sqlite3_blob_close(Handle);
+      return std::unexpected(sqlite3_errstr(E));
+    }
+    return {Blob(Handle)};
+  }
+
+  // Copies the database Schema ("main", "temp" or an attached name) into a
+  // contiguous image, e.g. to ship as a snapshot and reopen with
+  // deserialize() or openInMemoryFrom().
+  auto serialize(std::string_view Schema = "main") const noexcept
+      -> ExpectedT<DatabaseImage> {
+    if (!RawHandle) [[unlikely]]
+      return std::unexpected("DB handle is null");
+
+    sqlite3_int64 Size = 0;
+    DatabaseImage Image;
+    Image.Data.reset(
+        sqlite3_serialize(RawHandle, std::string(Schema).c_str(), &Size, 0));
+    if (!Image.Data && Size) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(SQLITE_NOMEM));
+    Image.Size = static_cast<std::size_t>(Size);
+    return Image;
+  }
+
+  // Replaces Schema with an in-memory copy of Image that the connection can
+  // read and write; nothing is written back to any file. Image may come
+  // from serialize() on any connection, WAL-mode ones included.
+  auto deserialize(std::span<std::byte const> Image,
+                   std::string_view Schema = "main") noexcept
+      -> ExpectedT<void> {
+    auto *Copy = static_cast<unsigned char *>(sqlite3_malloc64(Image.size()));
+    if (!Copy && !Image.empty()) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(SQLITE_NOMEM));
+    // An empty image gives an empty database; memcpy() may not take null.
+    if (!Image.empty())
+      std::memcpy(Copy, Image.data(), Image.size());
+    // An image taken from a WAL database says so in the header (bytes 18
+    // and 19); the in-memory VFS cannot run WAL, so mark it rollback.
+    if (Image.size() >= 100)
+      for (auto I : {18, 19})
+        Copy[I] = Copy[I] == 2 ? 1 : Copy[I];
+    return deserializeRaw(Copy, Image.size(), Schema,
+                          SQLITE_DESERIALIZE_FREEONCLOSE |
+                              SQLITE_DESERIALIZE_RESIZEABLE);
+  }
+
+  // Zero-copy and read-only: SQLite reads Image in place. Owner keeps the
+  // memory alive and is released once Schema is replaced again or the
+  // connection closes.
+  auto deserializeBorrowed(std::span<std::byte const> Image,
+                           std::shared_ptr<void const> Owner,
+                           std::string_view Schema = "main") noexcept
+      -> ExpectedT<void> {
+    auto *Data =
+        const_cast<unsigned char *>(reinterpret_cast<unsigned char const *>(
+            Image.data()));
+    auto E = deserializeRaw(Data, Image.size(), Schema,
+                            SQLITE_DESERIALIZE_READONLY);
+    if (E) [[likely]]
+      BorrowedImages.insert_or_assign(std::string(Schema), std::move(Owner));
+    return E;
+  }
+
+  // Copies this database to the file Dest on a background thread. The copy
+  // reads through its own connection, so this one stays free for writes
+  // while it runs; an in-memory database cannot be backed up this way (use
+  // serialize()).
+  auto backupTo(std::string_view Dest, BackupOptions Options = {}) noexcept
+      -> ExpectedT<BackupJob>;
+
+  // Streams the changes of committed transactions to Consumer; see
+  // ChangeFeed. Installs this connection's preupdate (or update), commit
+  // and rollback hooks, replacing any others and ending an earlier feed.
+  // The update hook stays shared with the result cache.
+  //
+  // The commit hook runs before the commit is durable, so a transaction is
+  // only published once the connection is seen back in autocommit mode
+  // without the rollback hook having fired: around the run() that committed
+  // it, or from the next hook if it was committed through a Statement.
+  // SQLite reports no hook for ROLLBACK TO; code that runs it itself must
+  // report it through changesMark() and discardChangesSince().
+  //
+  // Sessions use the same single preupdate hook, so a feed cannot start
+  // while a ChangeSession of this connection is alive, and vice versa.
+  auto changes(ChangeFeed::ConsumerT Consumer,
+               ChangeOptions Options = {}) noexcept -> ExpectedT<ChangeFeed> {
+    if (!RawHandle) [[unlikely]]
+      return std::unexpected("DB handle is null");
+    if (!Consumer) [[unlikely]]
+      return std::unexpected("Change consumer is empty");
+    if (Sessions.use_count() > 1) [[unlikely]]
+      return std::unexpected("A change session is recording on the connection");
+
+    auto Capture =
+        std::make_shared<detail::ChangeCapture>(RawHandle, std::move(Options));
+    auto *C = Capture.get();
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+    sqlite3_preupdate_hook(RawHandle, &detail::ChangeCapture::preupdate, C);
+#endif
+    sqlite3_commit_hook(RawHandle, &detail::ChangeCapture::commit, C);
+    sqlite3_rollback_hook(RawHandle, &detail::ChangeCapture::rollback, C);
+    if (Changes)
+      Changes->Active.store(false, std::memory_order_relaxed);
+    Changes = Capture;
+    routeUpdates();
+    return ChangeFeed(std::move(Capture), std::move(Consumer));
+  }
+
+  // Position in the open transaction's captured changes. Take it right
+  // before opening a savepoint, and pass it to discardChangesSince() after
+  // rolling back to that savepoint.
+  auto changesMark() const noexcept -> std::size_t {
+    return Changes ? Changes->mark() : 0;
+  }
+
+  void discardChangesSince(std::size_t Mark) noexcept {
+    if (Changes)
+      Changes->rollbackTo(Mark);
+  }
+
+#ifdef SQLITE_ENABLE_SESSION
+  // Starts recording changes to Tables of Schema, or to all of its tables
+  // if Tables is empty.
+  auto startSession(std::vector<std::string> const &Tables = {},
+                    std::string_view Schema = "main") noexcept
+      -> ExpectedT<ChangeSession> {
+    if (!RawHandle) [[unlikely]]
+      return std::unexpected("DB handle is null");
+    if (Changes) {
+      if (Changes->Active.load(std::memory_order_relaxed)) [[unlikely]]
+        return std::unexpected("A change feed is running on the connection");
+      sqlite3_preupdate_hook(RawHandle, nullptr, nullptr);
+      sqlite3_commit_hook(RawHandle, nullptr, nullptr);
+      sqlite3_rollback_hook(RawHandle, nullptr, nullptr);
+      Changes.reset();
+    }
+    if (!Sessions)
+      Sessions = std::make_shared<int>();
+
+    sqlite3_session *Handle = nullptr;
+    int E = sqlite3session_create(RawHandle, std::string(Schema).c_str(),
+                                  &Handle);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    ChangeSession Session(Handle, Sessions);
+    if (Tables.empty())
+      E = sqlite3session_attach(Handle, nullptr);
+    for (auto const &Table : Tables)
+      if (E = sqlite3session_attach(Handle, Table.c_str()); E != SQLITE_OK)
+        break;
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return Session;
+  }
+
+  // Applies a changeset or patchset from ChangeSession in one transaction.
+  auto applyChangeset(std::span<std::uint8_t const> Changeset,
+                      ConflictPolicy Policy = ConflictPolicy::Abort) noexcept
+      -> ExpectedT<void> {
+    if (!RawHandle) [[unlikely]]
+      return std::unexpected("DB handle is null");
+    auto OnConflict = [](void *P, int Conflict,
+                         sqlite3_changeset_iter *) -> int {
+      switch (*static_cast<ConflictPolicy *>(P)) {
+      case ConflictPolicy::Omit:
+        return SQLITE_CHANGESET_OMIT;
+      case ConflictPolicy::Replace:
+        // REPLACE is only allowed for conflicts with an existing row.
+        return Conflict == SQLITE_CHANGESET_DATA ||
+                       Conflict == SQLITE_CHANGESET_CONFLICT
+                   ? SQLITE_CHANGESET_REPLACE
+                   : SQLITE_CHANGESET_OMIT;
+      default:
+        return SQLITE_CHANGESET_ABORT;
+      }
+    };
+    int E = sqlite3changeset_apply(
+        RawHandle, int(Changeset.size()),
+        const_cast<std::uint8_t *>(Changeset.data()), nullptr, OnConflict,
+        &Policy);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return {};
+  }
+#endif
+
+  // Registers Fn as the SQL function Name. Argument and result types are
+  // deduced from Fn's signature: int, std::int64_t, double, std::string,
+  // std::string_view, std::span<std::uint8_t const>, std::optional of those
+  // for NULL, and std::expected<R, std::string_view> to raise an SQL error.
+  // The default flags let SQLite factor calls out of loops and use the
+  // function in indexes and schema; pass 0 for one with side effects.
+  template <class F>
+  auto defineFunction(std::string_view Name, F Fn,
+                      int Flags = SQLITE_DETERMINISTIC |
+                                  SQLITE_INNOCUOUS) noexcept
+      -> ExpectedT<void> {
+    using Function = detail::ScalarFunction<F>;
+    return createFunction(Name, Function::Traits::Arity, Flags,
+                          new F(std::move(Fn)), &Function::call, nullptr,
+                          nullptr, nullptr, nullptr, &Function::destroy);
+  }
+
+  // Registers an aggregate whose state is a copy of Initial per group:
+  // step(Args...) runs for every row and value() gives the result, with
+  // types deduced as for defineFunction(). The state lives in SQLite's
+  // aggregate context, so a group costs no separate allocation.
+  template <class StateT>
+  auto defineAggregate(std::string_view Name, StateT Initial = {},
+                       int Flags = SQLITE_DETERMINISTIC |
+                                   SQLITE_INNOCUOUS) noexcept
+      -> ExpectedT<void> {
+    using Function = detail::AggregateFunction<StateT>;
+    return createFunction(Name, Function::StepTraits::Arity, Flags,
+                          new StateT(std::move(Initial)), nullptr,
+                          &Function::step, &Function::finish, nullptr,
+                          nullptr, &Function::destroy);
+  }
+
+  // An aggregate that can also run as a window function: inverse(Args...)
+  // removes a row that leaves the frame, and value() is called for every
+  // row of the window.
+  template <class StateT>
+  auto defineWindow(std::string_view Name, StateT Initial = {},
+                    int Flags = SQLITE_DETERMINISTIC |
+                                SQLITE_INNOCUOUS) noexcept
+      -> ExpectedT<void> {
+    using Function = detail::AggregateFunction<StateT>;
+    return createFunction(Name, Function::StepTraits::Arity, Flags,
+                          new StateT(std::move(Initial)), nullptr,
+                          &Function::step, &Function::finish,
+                          &Function::value, &Function::inverse,
+                          &Function::destroy);
+  }
+
+  // Frees as much page cache memory as possible (sqlite3_db_release_memory).
+  auto releaseMemory() noexcept -> ExpectedT<void> {
+    if (!RawHandle) [[unlikely]]
+      return std::unexpected("DB handle is null");
+
+    int E = sqlite3_db_release_memory(RawHandle);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return {};
+  }
+
+  template <class... Ts>
+  auto run(std::string_view Sql, Ts &&...BindParams) noexcept
+      -> ExpectedT<void> {
+    auto Stmt = prepareCached(Sql);
+    if (!Stmt) [[unlikely]]
+      return std::unexpected(Stmt.error());
+
+    if (auto B = (*Stmt)->bindParams(1, std::forward<Ts>(BindParams)...); !B) {
+      return B;
+    }
+
+    if (Changes)
+      Changes->confirm();
+    auto E = (*Stmt)->step();
+    if (Changes)
+      Changes->confirm();
+    if (!E) [[unlikely]]
+      return std::unexpected(E.error());
+    if (*E == Statement::StepOk::STEP_BUSY) [[unlikely]]
+      return std::unexpected("Db is busy");
+
+    return {};
+  }
+
+  auto run(std::string_view Sql) noexcept -> ExpectedT<void> {
+    auto Stmt = prepareCached(Sql);
+    if (!Stmt) [[unlikely]]
+      return std::unexpected(Stmt.error());
+
+    if (Changes)
+      Changes->confirm();
+    auto E = (*Stmt)->step();
+    if (Changes)
+      Changes->confirm();
+    if (!E) [[unlikely]]
+      return std::unexpected(E.error());
+    if (*E == Statement::StepOk::STEP_BUSY) [[unlikely]]
+      return std::unexpected("Db is busy");
+
+    return {};
+  }
+
+  // Writes every row of Rows through one reused statement inside a
+  // BEGIN IMMEDIATE transaction, committing every CommitEvery rows (0 means a
+  // single transaction). On failure the current chunk is rolled back; earlier
+  // chunks stay committed. Inside an already open transaction the rows are
+  // written as part of it and CommitEvery is ignored.
+  template <std::ranges::input_range RangeT>
+  auto insertMany(std::string_view Sql, RangeT &&Rows,
+                  std::size_t CommitEvery = 0) noexcept -> BulkResult {
+    BulkResult Result;
+    auto Fail = [&Result](std::size_t At, std::string_view Error) {
+      Result.FailedAt = At;
+      Result.Error = Error;
+      return Result;
+    };
+
+    auto Stmt = prepareCached(Sql);
+    if (!Stmt) [[unlikely]]
+      return Fail(0, Stmt.error());
+
+    if (!RawHandle || !sqlite3_get_autocommit(RawHandle))
+      return (*Stmt)->executeMany(std::forward<RangeT>(Rows));
+
+    std::size_t Pending = 0;
+    bool InTransaction = false;
+    for (auto &&Row : Rows) {
+      if (!InTransaction) {
+        if (auto E = run("BEGIN IMMEDIATE"); !E) [[unlikely]]
+          return Fail(Result.Written, E.error());
+        InTransaction = true;
+      }
+
+      if (auto E = (*Stmt)->executeRow(std::forward<decltype(Row)>(Row)); !E)
+          [[unlikely]] {
+        (void)run("ROLLBACK");
+        return Fail(Result.Written + Pending, E.error());
+      }
+
+      if (++Pending == CommitEvery) {
+        if (auto E = run("COMMIT"); !E) [[unlikely]] {
+          (void)run("ROLLBACK");
+          return Fail(Result.Written, E.error());
+        }
+        Result.Written += std::exchange(Pending, 0);
+        InTransaction = false;
+      }
+    }
+
+    if (InTransaction) {
+      if (auto E = run("COMMIT"); !E) [[unlikely]] {
+        (void)run("ROLLBACK");
+        return Fail(Result.Written, E.error());
+      }
+      Result.Written += Pending;
+    }
+    return Result;
+  }
+
+  // Statement is prepared and parameters are bound eagerly, so temporaries
+  // passed as BindParams need not outlive the returned generator.
+  template <class... ColTs, class... BindTs>
+  auto runReading(std::string_view Sql, BindTs &&...BindParams)
+      -> Generator<ExpectedT<std::tuple<ColTs...>>> {
+    auto Stmt = prepareCached(Sql);
+    if (Stmt) [[likely]] {
+      if (auto E = (*Stmt)->bindParams(1, std::forward<BindTs>(BindParams)...);
+          !E) [[unlikely]]
+        Stmt = std::unexpected(E.error());
+    }
+    return readAll<ColTs...>(std::move(Stmt));
+  }
+
+  template <class... ColTs>
+  auto runReading(std::string_view Sql)
+      -> Generator<ExpectedT<std::tuple<ColTs...>>> {
+    return readAll<ColTs...>(prepareCached(Sql));
+  }
+
+  // Stops with DeadlineExceeded or QueryCancelled once Limits say so, e.g.
+  // runReading<int>(QueryLimits::after(50ms), Sql). The limits come first
+  // since the bind parameters are variadic.
+  template <class... ColTs, class... BindTs>
+  auto runReading(QueryLimits Limits, std::string_view Sql,
+                  BindTs &&...BindParams)
+      -> Generator<ExpectedT<std::tuple<ColTs...>>> {
+    auto Stmt = prepareCached(Sql);
+    if (Stmt) [[likely]] {
+      if (auto E = (*Stmt)->bindParams(1, std::forward<BindTs>(BindParams)...);
+          !E) [[unlikely]]
+        Stmt = std::unexpected(E.error());
+    }
+    return readAll<ColTs...>(std::move(Stmt), Limits);
+  }
+
+  // Materializes every row of Sql as a Pod; see Statement::collect().
+  template <class Pod, class... BindTs>
+  auto queryAll(std::string_view Sql, BindTs &&...BindParams) noexcept
+      -> ExpectedT<ResultSet<Pod>> {
+    auto Stmt = prepareCached(Sql);
+    if (!Stmt) [[unlikely]]
+      return std::unexpected(Stmt.error());
+    if (auto E = (*Stmt)->bindParams(1, std::forward<BindTs>(BindParams)...);
+        !E) [[unlikely]]
+      return std::unexpected(E.error());
+    return (*Stmt)->collect<Pod>();
+  }
+
+  // Allocation-free counterpart of runReading(); see RowRange. Works with
+  // std::views, e.g. runReadingRange<...>(Sql) | std::views::take(10).
+  template <class... ColTs, class... BindTs>
+  auto runReadingRange(std::string_view Sql, BindTs &&...BindParams) noexcept
+      -> RowRange<ColTs...> {
+    auto Stmt = prepareCached(Sql);
+    if (Stmt) [[likely]] {
+      if (auto E = (*Stmt)->bindParams(1, std::forward<BindTs>(BindParams)...);
+          !E) [[unlikely]]
+        Stmt = std::unexpected(E.error());
+    }
+    return RowRange<ColTs...>(std::move(Stmt));
+  }
+
+  template <class... ColTs, class... BindTs>
+  auto runReadingBatched(std::string_view Sql, std::size_t BatchSize,
+                         BindTs &&...BindParams)
+      -> Generator<ExpectedT<ColumnBatch<ColTs...>>> {
+    auto Stmt = prepareCached(Sql);
+    if (Stmt) [[likely]] {
+      if (auto E = (*Stmt)->bindParams(1, std::forward<BindTs>(BindParams)...);
+          !E) [[unlikely]]
+        Stmt = std::unexpected(E.error());
+    }
+    return readAllBatched<ColTs...>(std::move(Stmt), BatchSize);
+  }
+
+  // Opts in to caching results of runReadingCached(); see ResultCache.
+  // Replaces any update hook installed on this connection.
+  void enableResultCache(ResultCacheOptions Options = {}) noexcept {
+    Results = std::make_unique<ResultCache>(RawHandle, Options);
+    routeUpdates();
+  }
+
+  void disableResultCache() noexcept {
+    Results.reset();
+    routeUpdates();
+  }
+
+  auto resultCacheStats() const noexcept -> ResultCacheStats {
+    return Results ? Results->stats() : ResultCacheStats{};
+  }
+
+  // Same as runReading(), but served from the result cache when it is
+  // enabled and holds a current result for this SQL, column types and
+  // parameter values. Only use it for deterministic queries. On a hit, views
+  // point into the cached result and stay valid while the generator lives.
+  template <class... ColTs, class... BindTs>
+  auto runReadingCached(std::string_view Sql, BindTs &&...BindParams)
+      -> Generator<ExpectedT<std::tuple<ColTs...>>> {
+    if (!Results)
+      return runReading<ColTs...>(Sql, std::forward<BindTs>(BindParams)...);
+
+    Results->sync();
+    auto Key = ResultCache::key<ColTs...>(Sql, BindParams...);
+    if (auto Entry = Results->find(Key))
+      return replayAll<ColTs...>(std::move(Entry));
+
+    auto Pending = Results->begin(Sql, std::move(Key));
+    auto Stmt = prepareCached(Sql);
+    if (Stmt) [[likely]] {
+      if (auto E = (*Stmt)->bindParams(1, std::forward<BindTs>(BindParams)...);
+          !E) [[unlikely]]
+        Stmt = std::unexpected(E.error());
+    }
+    return recordAll<ColTs...>(std::move(Stmt), *Results, std::move(Pending));
+  }
+
+private:
+  Connection(sqlite3 *RawHandle) noexcept
+      : RawHandle(RawHandle), Cache(std::make_unique<StatementCache>()) {}
+
+  void close() noexcept {
+    // Statements still alive, such as leased ones, keep the database open
+    // until they are finalized; sqlite3_close_v2() then closes it.
+    if (RawHandle)
+      sqlite3_update_hook(RawHandle, nullptr, nullptr);
+    if (Changes)
+      Changes->confirm();
+    Results.reset();
+    if (Cache)
+      StatementCache::retire(std::move(Cache));
+    sqlite3_close_v2(RawHandle);
+    RawHandle = nullptr;
+    BorrowedImages.clear();
+    Changes.reset();
+    Updates.reset();
+  }
+
+  // Points the update hook at the dispatcher while anything needs it.
+  void routeUpdates() noexcept {
+    if (!RawHandle) [[unlikely]]
+      return;
+    if (!Updates)
+      Updates = std::make_unique<detail::UpdateHooks>();
+    Updates->Results = Results.get();
+#ifndef SQLITE_ENABLE_PREUPDATE_HOOK
+    Updates->Changes = Changes.get();
+#endif
+    if (Updates->Results || Updates->Changes)
+      sqlite3_update_hook(RawHandle, &detail::UpdateHooks::onUpdate,
+                          Updates.get());
+    else
+      sqlite3_update_hook(RawHandle, nullptr, nullptr);
+  }
+
+  // On failure SQLite frees Data itself if FREEONCLOSE is set.
+  auto deserializeRaw(unsigned char *Data, std::size_t Size,
+                      std::string_view Schema, unsigned Flags) noexcept
+      -> ExpectedT<void> {
+    if (!RawHandle) [[unlikely]] {
+      if (Flags & SQLITE_DESERIALIZE_FREEONCLOSE)
+        sqlite3_free(Data);
+      return std::unexpected("DB handle is null");
+    }
+    // The statements may reference the schema being replaced.
+    clearStatementCache();
+    std::string Name(Schema);
+    int E = sqlite3_deserialize(RawHandle, Name.c_str(), Data, Size, Size,
+                                Flags);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    // SQLite no longer reads the image the schema held before.
+    BorrowedImages.erase(Name);
+    return {};
+  }
+
+  template <class... ColTs>
+  static auto readAll(ExpectedT<CachedStatement> Stmt)
+      -> Generator<ExpectedT<std::tuple<ColTs...>>> {
+    if (!Stmt) [[unlikely]] {
+      co_yield std::unexpected(Stmt.error());
+      co_return;
+    }
+
+    for (auto &&Value : (*Stmt)->runReading<ColTs...>())
+      co_yield std::forward<decltype(Value)>(Value);
+  }
+
+  template <class... ColTs>
+  static auto readAll(ExpectedT<CachedStatement> Stmt, QueryLimits Limits)
+      -> Generator<ExpectedT<std::tuple<ColTs...>>> {
+    if (!Stmt) [[unlikely]] {
+      co_yield std::unexpected(Stmt.error());
+      co_return;
+    }
+
+    for (auto &&Value : (*Stmt)->runReading<ColTs...>(Limits))
+      co_yield std::forward<decltype(Value)>(Value);
+  }
+
+  template <class... ColTs>
+  static auto replayAll(ResultCache::EntryPtr Entry)
+      -> Generator<ExpectedT<std::tuple<ColTs...>>> {
+    auto const *In = Entry->Rows.data();
+    for (std::size_t Row = 0; Row < Entry->RowCount; ++Row) {
+      std::tuple<ColTs...> Values;
+      std::apply([&](auto &...Cols) { (ResultCache::decode(In, Cols), ...); },
+                 Values);
+      co_yield ExpectedT<std::tuple<ColTs...>>(std::move(Values));
+    }
+  }
+
+  // Streams rows like readAll() while recording them; the result is cached
+  // only if the caller reads it to the end.
+  template <class... ColTs>
+  static auto recordAll(ExpectedT<CachedStatement> Stmt, ResultCache &Results,
+                        ResultCache::Pending Pending)
+      -> Generator<ExpectedT<std::tuple<ColTs...>>> {
+    if (!Stmt) [[unlikely]] {
+      co_yield std::unexpected(Stmt.error());
+      co_return;
+    }
+
+    while (true) {
+      auto E = (*Stmt)->step();
+      if (!E) [[unlikely]] {
+        co_yield std::unexpected(E.error());
+        co_return;
+      }
+      if (*E == Statement::StepOk::STEP_DONE)
+        break;
+      if (*E == Statement::StepOk::STEP_BUSY) [[unlikely]] {
+        co_yield std::unexpected("Db is busy");
+        co_return;
+      }
+      Results.record<ColTs...>(**Stmt, Pending);
+      co_yield (*Stmt)->readTuple<ColTs...>();
+    }
+    Results.insert(std::move(Pending));
+  }
+
+  using ScalarFn = void (*)(sqlite3_context *, int, sqlite3_value **);
+  using FinalFn = void (*)(sqlite3_context *);
+
+  // Takes ownership of UserData: SQLite passes it to Destroy, also when
+  // registration fails.
+  auto createFunction(std::string_view Name, int Arity, int Flags,
+                      void *UserData, ScalarFn Call, ScalarFn Step,
+                      FinalFn Final, FinalFn Value, ScalarFn Inverse,
+                      void (*Destroy)(void *)) noexcept -> ExpectedT<void> {
+    if (!RawHandle) [[unlikely]] {
+      Destroy(UserData);
+      return std::unexpected("DB handle is null");
+    }
+    auto FunctionName = std::string(Name);
+    Flags |= SQLITE_UTF8;
+    int E = Inverse ? sqlite3_create_window_function(
+                          RawHandle, FunctionName.c_str(), Arity, Flags,
+                          UserData, Step, Final, Value, Inverse, Destroy)
+                    : sqlite3_create_function_v2(
+                          RawHandle, FunctionName.c_str(), Arity, Flags,
+                          UserData, Call, Step, Final, Destroy);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return {};
+  }
+
+  static auto copyPages(Connection &Source, Connection &Target,
+                        BackupOptions const &Options,
+                        std::stop_token Stop) noexcept
+      -> ExpectedT<BackupProgress>;
+  static auto vacuumInto(Connection &Source, std::string const &Dest,
+                         BackupOptions const &Options,
+                         std::stop_token Stop) noexcept
+      -> ExpectedT<BackupProgress>;
+
+  template <class... ColTs>
+  static auto readAllBatched(ExpectedT<CachedStatement> Stmt,
+                             std::size_t BatchSize)
+      -> Generator<ExpectedT<ColumnBatch<ColTs...>>> {
+    if (!Stmt) [[unlikely]] {
+      co_yield std::unexpected(Stmt.error());
+      co_return;
+    }
+
+    for (auto &&Batch : (*Stmt)->runReadingBatched<ColTs...>(BatchSize))
+      co_yield std::forward<decltype(Batch)>(Batch);
+  }
+
+  friend auto open(std::string_view Path) noexcept -> ExpectedT<Connection> {
+    sqlite3 *Handle = nullptr;
+    auto E = sqlite3_open(Path.data(), &Handle);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return {Connection(Handle)};
+  }
+
+  friend auto open16(std::string_view Path) noexcept -> ExpectedT<Connection> {
+    sqlite3 *Handle = nullptr;
+    auto E = sqlite3_open16(Path.data(), &Handle);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return {Connection(Handle)};
+  }
+
+  friend auto open_v2(std::string_view Path, int Flags) noexcept
+      -> ExpectedT<Connection> {
+    sqlite3 *Handle = nullptr;
+    auto E = sqlite3_open_v2(Path.data(), &Handle, Flags, nullptr);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return {Connection(Handle)};
+  }
+
+private:
+  sqlite3 *RawHandle{nullptr};
+  // On the heap, so leases keep a stable pointer when the Connection moves.
+  std::unique_ptr<StatementCache> Cache;
+  std::unique_ptr<ResultCache> Results;
+  // Memory that deserializeBorrowed() images live in, by schema.
+  std::unordered_map<std::string, std::shared_ptr<void const>> BorrowedImages;
+  // State of the change hooks installed by changes().
+  std::shared_ptr<detail::ChangeCapture> Changes;
+  // Shared with every ChangeSession, so use_count() > 1 while one lives.
+  std::shared_ptr<int> Sessions;
+  // Target of the update hook; on the heap, so it survives moves.
+  std::unique_ptr<detail::UpdateHooks> Updates;
+};
+
+ExpectedT<Connection> open_v2(std::string_view Path, int Flags) noexcept;
+ExpectedT<Connection> open16(std::string_view Path) noexcept;
 ExpectedT<Connection> open(std::string_view Path) noexcept;
 
+inline auto Connection::backupTo(std::string_view Dest,
+                                 BackupOptions Options) noexcept
+    -> ExpectedT<BackupJob> {
+  if (!RawHandle) [[unlikely]]
+    return std::unexpected("DB handle is null");
+  auto const *Path = sqlite3_db_filename(RawHandle, "main");
+  if (!Path || !*Path) [[unlikely]]
+    return std::unexpected("backupTo needs an on-disk database");
+
+  // Both connections are opened here so that bad paths fail the call; the
+  // worker is their only user afterwards.
+  auto Source = open_v2(Path, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX);
+  if (!Source) [[unlikely]]
+    return std::unexpected(Source.error());
+  Connection Target;
+  if (Options.Method == BackupMethod::Pages) {
+    auto Opened = open_v2(Dest, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                                    SQLITE_OPEN_NOMUTEX);
+    if (!Opened) [[unlikely]]
+      return std::unexpected(Opened.error());
+    Target = std::move(*Opened);
+  }
+
+  // A read transaction held across steps pins the snapshot as of this
+  // call. Only in WAL mode, where it does not keep writers out.
+  if (Options.Method == BackupMethod::Pages && Options.PinSnapshot) {
+    std::string Mode;
+    for (auto &&Row :
+         Source->runReading<std::string_view>("PRAGMA journal_mode"))
+      if (Row)
+        Mode = std::get<0>(*Row);
+    // BEGIN is deferred; the read starts the transaction.
+    if (Mode == "wal" && Source->run("BEGIN"))
+      (void)Source->run("SELECT 1 FROM sqlite_schema LIMIT 1");
+  }
+
+  std::promise<ExpectedT<BackupProgress>> Promise;
+  BackupJob Job;
+  Job.Result = Promise.get_future();
+  Job.Worker = std::jthread(
+      [Source = std::move(*Source), Target = std::move(Target),
+       Dest = std::string(Dest), Options = std::move(Options),
+       Promise = std::move(Promise)](std::stop_token Stop) mutable {
+        auto Result = Options.Method == BackupMethod::Pages
+                          ? copyPages(Source, Target, Options, Stop)
+                          : vacuumInto(Source, Dest, Options, Stop);
+        // Closed before wait() returns, so the caller can open Dest
+        // right away.
+        Source.close();
+        Target.close();
+        Promise.set_value(std::move(Result));
+      });
+  return Job;
+}
+
+inline auto Connection::copyPages(Connection &Source, Connection &Target,
+                                  BackupOptions const &Options,
+                                  std::stop_token Stop) noexcept
+    -> ExpectedT<BackupProgress> {
+  auto *Backup =
+      sqlite3_backup_init(Target.RawHandle, "main", Source.RawHandle, "main");
+  if (!Backup) [[unlikely]]
+    return std::unexpected(sqlite3_errstr(sqlite3_errcode(Target.RawHandle)));
+
+  BackupProgress Progress;
+  int Done = 0;
+  int E = SQLITE_OK;
+  while (E != SQLITE_DONE) {
+    if (Stop.stop_requested()) {
+      // Rolls back the destination's write transaction.
+      sqlite3_backup_finish(Backup);
+      return std::unexpected("Backup was cancelled");
+    }
+
+    bool Last = Progress.Restarts >= Options.MaxRestarts;
+    E = sqlite3_backup_step(Backup, Last ? -1 : Options.PagesPerStep);
+    if (E == SQLITE_OK || E == SQLITE_DONE) {
+      Progress.Remaining = sqlite3_backup_remaining(Backup);
+      Progress.PageCount = sqlite3_backup_pagecount(Backup);
+      ++Progress.Steps;
+      // A restart copies from page 1 again, so fewer pages are done than
+      // before the step.
+      auto Now = Progress.PageCount - Progress.Remaining;
+      if (E == SQLITE_OK && Now <= Done)
+        ++Progress.Restarts;
+      Done = Now;
+      if (Options.OnProgress)
+        Options.OnProgress(Progress);
+    } else if (E != SQLITE_BUSY && E != SQLITE_LOCKED) [[unlikely]] {
+      sqlite3_backup_finish(Backup);
+      return std::unexpected(sqlite3_errstr(E));
+    }
+
+    if (E == SQLITE_DONE)
+      break;
+    if (Options.Pause.count())
+      std::this_thread::sleep_for(Options.Pause);
+    else
+      std::this_thread::yield();
+  }
+
+  E = sqlite3_backup_finish(Backup);
+  if (!sqlite3_get_autocommit(Source.RawHandle))
+    (void)Source.run("COMMIT");
+  if (E != SQLITE_OK) [[unlikely]]
+    return std::unexpected(sqlite3_errstr(E));
+  return Progress;
+}
+
+inline auto Connection::vacuumInto(Connection &Source, std::string const &Dest,
+                                   BackupOptions const &Options,
+                                   std::stop_token Stop) noexcept
+    -> ExpectedT<BackupProgress> {
+  BackupProgress Progress;
+  for (auto &&Row : Source.runReading<std::int64_t>("PRAGMA page_count"))
+    if (Row)
+      Progress.PageCount = static_cast<int>(std::get<0>(*Row));
+
+  // VACUUM INTO is a single statement; the progress handler is the only
+  // place a cancellation can get in.
+  sqlite3_progress_handler(
+      Source.RawHandle, 1000,
+      [](void *Token) -> int {
+        return static_cast<std::stop_token *>(Token)->stop_requested();
+      },
+      &Stop);
+  auto E = Source.run("VACUUM INTO ?", std::string_view(Dest));
+  sqlite3_progress_handler(Source.RawHandle, 0, nullptr, nullptr);
+
+  if (!E) [[unlikely]] {
+    bool Cancelled = Stop.stop_requested();
+    if (Cancelled)
+      std::remove(Dest.c_str());
+    return std::unexpected(Cancelled ? "Backup was cancelled" : E.error());
+  }
+  Progress.Steps = 1;
+  if (Options.OnProgress)
+    Options.OnProgress(Progress);
+  return Progress;
+}
+
 } // namespace esqlite
 
 #endif // ESQLITE_ESQLITE_H
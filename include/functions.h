@@ -0,0 +1,221 @@
+#ifndef ESQLITE_FUNCTIONS_H
+#define ESQLITE_FUNCTIONS_H
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <expected>
+#include <memory>
+#include <new>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <sqlite3.h>
+
+#include "type_traits.h"
+
+namespace esqlite {
+
+namespace detail {
+
+// Argument and result types of a function pointer, member function or
+// (non-generic) callable object.
+template <class F>
+struct CallableTraits : CallableTraits<decltype(&F::operator())> {};
+
+template <class R, class... As> struct CallableTraits<R (*)(As...)> {
+  using ResultT = R;
+  using ArgsT = std::tuple<std::decay_t<As>...>;
+  static constexpr int Arity = sizeof...(As);
+};
+
+template <class R, class... As>
+struct CallableTraits<R (*)(As...) noexcept> : CallableTraits<R (*)(As...)> {};
+
+#define ESQLITE_MEMBER_TRAITS(Qualifiers)                                      \
+  template <class C, class R, class... As>                                     \
+  struct CallableTraits<R (C::*)(As...) Qualifiers>                            \
+      : CallableTraits<R (*)(As...)> {};
+ESQLITE_MEMBER_TRAITS()
+ESQLITE_MEMBER_TRAITS(const)
+ESQLITE_MEMBER_TRAITS(noexcept)
+ESQLITE_MEMBER_TRAITS(const noexcept)
+#undef ESQLITE_MEMBER_TRAITS
+
+template <class T> inline constexpr bool is_optional_v = false;
+template <class T> inline constexpr bool is_optional_v<std::optional<T>> = true;
+
+template <class T> inline constexpr bool is_expected_v = false;
+template <class T, class E>
+inline constexpr bool is_expected_v<std::expected<T, E>> = true;
+
+// Views into text and blob arguments point into SQLite's value and are valid
+// only for the call. std::optional<T> maps NULL to std::nullopt; any other
+// type reads NULL with SQLite's usual conversion (0 or empty).
+template <class T> auto readValue(sqlite3_value *Value) noexcept -> T {
+  if constexpr (is_optional_v<T>) {
+    if (sqlite3_value_type(Value) == SQLITE_NULL)
+      return std::nullopt;
+    return readValue<typename T::value_type>(Value);
+  } else if constexpr (std::is_same_v<T, int>) {
+    return sqlite3_value_int(Value);
+  } else if constexpr (std::is_same_v<T, std::int64_t>) {
+    return sqlite3_value_int64(Value);
+  } else if constexpr (std::is_same_v<T, double>) {
+    return sqlite3_value_double(Value);
+  } else if constexpr (is_sqlite_text<T>) {
+    auto const *Data =
+        reinterpret_cast<char const *>(sqlite3_value_text(Value));
+    return T(Data ? Data : "", sqlite3_value_bytes(Value));
+  } else if constexpr (std::is_same_v<T, std::span<std::uint8_t const>>) {
+    auto const *Data =
+        static_cast<std::uint8_t const *>(sqlite3_value_blob(Value));
+    return T(Data, Data ? sqlite3_value_bytes(Value) : 0);
+  } else {
+    static_assert(always_false_v<T>, "Unsupported function argument type");
+  }
+}
+
+template <class T>
+void setResult(sqlite3_context *Ctx, T &&Result) noexcept {
+  using U = std::remove_cvref_t<T>;
+  if constexpr (is_expected_v<U>) {
+    if (!Result) [[unlikely]] {
+      std::string_view Error = Result.error();
+      sqlite3_result_error(Ctx, Error.data(), int(Error.size()));
+    } else if constexpr (!std::is_void_v<typename U::value_type>) {
+      setResult(Ctx, *std::forward<T>(Result));
+    } else {
+      sqlite3_result_null(Ctx);
+    }
+  } else if constexpr (is_optional_v<U>) {
+    if (Result)
+      setResult(Ctx, *std::forward<T>(Result));
+    else
+      sqlite3_result_null(Ctx);
+  } else if constexpr (std::is_same_v<U, std::nullptr_t>) {
+    sqlite3_result_null(Ctx);
+  } else if constexpr (std::is_same_v<U, bool> || std::is_same_v<U, int>) {
+    sqlite3_result_int(Ctx, Result);
+  } else if constexpr (std::is_same_v<U, std::int64_t>) {
+    sqlite3_result_int64(Ctx, Result);
+  } else if constexpr (std::is_same_v<U, double>) {
+    sqlite3_result_double(Ctx, Result);
+  } else if constexpr (is_sqlite_text<U>) {
+    sqlite3_result_text64(Ctx, Result.data(), Result.size(), SQLITE_TRANSIENT,
+                          SQLITE_UTF8);
+  } else if constexpr (is_sqlite_blob<U>) {
+    sqlite3_result_blob64(Ctx, Result.data(), Result.size(), SQLITE_TRANSIENT);
+  } else {
+    static_assert(always_false_v<T>, "Unsupported function result type");
+  }
+}
+
+// Calls Fn with the arguments decoded per ArgsT and sets its result unless
+// R is void. Exceptions must not unwind through SQLite, so they become an
+// SQL error.
+template <class R, class ArgsT, class F>
+void invoke(sqlite3_context *Ctx, F &&Fn, sqlite3_value **Argv) noexcept {
+  try {
+    [&]<std::size_t... Is>(std::index_sequence<Is...>) {
+      if constexpr (std::is_void_v<R>)
+        Fn(readValue<std::tuple_element_t<Is, ArgsT>>(Argv[Is])...);
+      else
+        setResult(Ctx,
+                  Fn(readValue<std::tuple_element_t<Is, ArgsT>>(Argv[Is])...));
+    }(std::make_index_sequence<std::tuple_size_v<ArgsT>>());
+  } catch (std::bad_alloc const &) {
+    sqlite3_result_error_nomem(Ctx);
+  } catch (std::exception const &E) {
+    sqlite3_result_error(Ctx, E.what(), -1);
+  } catch (...) {
+    sqlite3_result_error(Ctx, "Unknown exception in a user function", -1);
+  }
+}
+
+template <class F> struct ScalarFunction {
+  using Traits = CallableTraits<F>;
+
+  static void call(sqlite3_context *Ctx, int, sqlite3_value **Argv) noexcept {
+    auto &Fn = *static_cast<F *>(sqlite3_user_data(Ctx));
+    invoke<typename Traits::ResultT, typename Traits::ArgsT>(Ctx, Fn, Argv);
+  }
+
+  static void destroy(void *Fn) noexcept { delete static_cast<F *>(Fn); }
+};
+
+// One state per group lives in sqlite3_aggregate_context(), copied from the
+// prototype registered with the function on the group's first row; the
+// memory is zeroed by SQLite, so Constructed starts out false.
+template <class StateT> struct AggregateFunction {
+  struct Slot {
+    bool Constructed;
+    alignas(StateT) unsigned char Storage[sizeof(StateT)];
+  };
+  static_assert(alignof(Slot) <= 8,
+                "sqlite3_aggregate_context() memory is 8-byte aligned");
+
+  using StepTraits = CallableTraits<decltype(&StateT::step)>;
+  using ValueTraits = CallableTraits<decltype(&StateT::value)>;
+
+  static auto state(sqlite3_context *Ctx) noexcept -> StateT * {
+    auto *S =
+        static_cast<Slot *>(sqlite3_aggregate_context(Ctx, sizeof(Slot)));
+    if (!S) [[unlikely]] {
+      sqlite3_result_error_nomem(Ctx);
+      return nullptr;
+    }
+    if (!S->Constructed) {
+      auto const &Prototype = *static_cast<StateT *>(sqlite3_user_data(Ctx));
+      new (S->Storage) StateT(Prototype);
+      S->Constructed = true;
+    }
+    return std::launder(reinterpret_cast<StateT *>(S->Storage));
+  }
+
+  static void step(sqlite3_context *Ctx, int, sqlite3_value **Argv) noexcept {
+    if (auto *State = AggregateFunction::state(Ctx)) [[likely]]
+      invoke<void, typename StepTraits::ArgsT>(
+          Ctx, [State](auto &&...As) { State->step(As...); }, Argv);
+  }
+
+  // Window functions only: the row leaves the frame.
+  static void inverse(sqlite3_context *Ctx, int,
+                      sqlite3_value **Argv) noexcept {
+    if (auto *State = AggregateFunction::state(Ctx)) [[likely]]
+      invoke<void, typename StepTraits::ArgsT>(
+          Ctx, [State](auto &&...As) { State->inverse(As...); }, Argv);
+  }
+
+  static void value(sqlite3_context *Ctx) noexcept {
+    if (auto *State = AggregateFunction::state(Ctx)) [[likely]]
+      invoke<typename ValueTraits::ResultT, std::tuple<>>(
+          Ctx, [State] { return State->value(); }, nullptr);
+  }
+
+  // An empty group still gets a state, so value() sees the prototype.
+  static void finish(sqlite3_context *Ctx) noexcept {
+    auto *State = AggregateFunction::state(Ctx);
+    if (!State) [[unlikely]]
+      return;
+    value(Ctx);
+    State->~StateT();
+  }
+
+  static void destroy(void *Prototype) noexcept {
+    delete static_cast<StateT *>(Prototype);
+  }
+};
+
+} // namespace detail
+
+} // namespace esqlite
+
+#endif // ESQLITE_FUNCTIONS_H
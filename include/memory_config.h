@@ -0,0 +1,328 @@
+#ifndef ESQLITE_MEMORY_CONFIG_H
+#define ESQLITE_MEMORY_CONFIG_H
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "esqlite.h"
+
+namespace esqlite {
+
+struct PoolAllocatorStats {
+  std::uint64_t Mallocs{0};
+  std::uint64_t Frees{0};
+  std::uint64_t Reallocs{0};
+  // Requests above the largest size class, served by std::malloc.
+  std::uint64_t LargeMallocs{0};
+  // Slab memory reserved from the system for the size classes.
+  std::size_t ArenaBytes{0};
+};
+
+// Size-class allocator for SQLite's many small allocations. Small blocks
+// are carved from large slabs and recycled through per-thread caches that
+// spill into shared per-class free lists, so steady-state traffic neither
+// fragments the heap nor takes a global lock. Slabs are kept for the life of
+// the process, since freed blocks may sit in any thread's cache.
+struct PoolAllocator final {
+  static constexpr std::array<std::uint32_t, 16> Classes = {
+      16,  32,  48,  64,   96,   128,  192,  256,
+      384, 512, 768, 1024, 1536, 2048, 3072, 4096};
+  static constexpr std::size_t NumClasses = Classes.size();
+  static constexpr std::size_t Header = 16;
+  static constexpr std::size_t SlabSize = 256 << 10;
+  static constexpr std::uint32_t CacheLimit = 64;
+  static constexpr std::uint32_t Large = ~0u;
+
+  static auto methods() noexcept -> sqlite3_mem_methods const & {
+    static sqlite3_mem_methods const Methods = {
+        &xMalloc,  &xFree, &xRealloc,  &xSize,
+        &xRoundup, &xInit, &xShutdown, nullptr};
+    return Methods;
+  }
+
+  static auto stats() noexcept -> PoolAllocatorStats {
+    auto &S = shared();
+    PoolAllocatorStats Stats;
+    Stats.Mallocs = S.Mallocs.load(std::memory_order_relaxed);
+    Stats.Frees = S.Frees.load(std::memory_order_relaxed);
+    Stats.Reallocs = S.Reallocs.load(std::memory_order_relaxed);
+    Stats.LargeMallocs = S.LargeMallocs.load(std::memory_order_relaxed);
+    std::lock_guard Lock(S.Mutex);
+    Stats.ArenaBytes = S.Slabs.size() * SlabSize;
+    return Stats;
+  }
+
+private:
+  struct FreeBlock {
+    FreeBlock *Next;
+  };
+
+  struct BlockHeader {
+    std::uint32_t Class;
+    std::uint32_t Pad;
+    std::uint64_t Size;
+  };
+  static_assert(sizeof(BlockHeader) <= Header);
+
+  struct Shared {
+    std::mutex Mutex;
+    std::array<FreeBlock *, NumClasses> Free{};
+    std::vector<void *> Slabs;
+    std::byte *Bump{nullptr};
+    std::size_t BumpLeft{0};
+
+    std::atomic<std::uint64_t> Mallocs{0};
+    std::atomic<std::uint64_t> Frees{0};
+    std::atomic<std::uint64_t> Reallocs{0};
+    std::atomic<std::uint64_t> LargeMallocs{0};
+  };
+
+  struct Cache {
+    ~Cache() noexcept {
+      for (std::uint32_t C = 0; C < NumClasses; ++C)
+        spill(C, Counts[C]);
+    }
+
+    // Moves N blocks of class C to the shared free list.
+    void spill(std::uint32_t C, std::uint32_t N) noexcept {
+      if (!N)
+        return;
+      auto *First = Heads[C];
+      auto *Last = First;
+      for (std::uint32_t I = 1; I < N; ++I)
+        Last = Last->Next;
+      Heads[C] = Last->Next;
+      Counts[C] -= N;
+
+      auto &S = shared();
+      std::lock_guard Lock(S.Mutex);
+      Last->Next = S.Free[C];
+      S.Free[C] = First;
+    }
+
+    std::array<FreeBlock *, NumClasses> Heads{};
+    std::array<std::uint32_t, NumClasses> Counts{};
+  };
+
+  // Deliberately leaked: SQLite may free blocks during static destruction.
+  static auto shared() noexcept -> Shared & {
+    static Shared &S = *new Shared;
+    return S;
+  }
+
+  static auto cache() noexcept -> Cache & {
+    thread_local Cache C;
+    return C;
+  }
+
+  static auto classOf(std::size_t Size) noexcept -> std::uint32_t {
+    auto It = std::ranges::lower_bound(Classes, Size);
+    return It == Classes.end()
+               ? Large
+               : static_cast<std::uint32_t>(It - Classes.begin());
+  }
+
+  static auto headerOf(void *P) noexcept -> BlockHeader * {
+    return reinterpret_cast<BlockHeader *>(static_cast<std::byte *>(P) -
+                                           Header);
+  }
+
+  // Refills the calling thread's cache with up to CacheLimit / 2 blocks.
+  static auto refill(std::uint32_t C) noexcept -> std::byte * {
+    auto &S = shared();
+    auto &Local = cache();
+    auto BlockSize = Header + Classes[C];
+    std::lock_guard Lock(S.Mutex);
+    for (std::uint32_t I = 0; I < CacheLimit / 2; ++I) {
+      FreeBlock *Block = S.Free[C];
+      if (Block) {
+        S.Free[C] = Block->Next;
+      } else {
+        if (S.BumpLeft < BlockSize) {
+          auto *Slab = static_cast<std::byte *>(std::malloc(SlabSize));
+          if (!Slab) [[unlikely]]
+            break;
+          S.Slabs.push_back(Slab);
+          S.Bump = Slab;
+          S.BumpLeft = SlabSize;
+        }
+        Block = reinterpret_cast<FreeBlock *>(S.Bump);
+        S.Bump += BlockSize;
+        S.BumpLeft -= BlockSize;
+      }
+      Block->Next = Local.Heads[C];
+      Local.Heads[C] = Block;
+      ++Local.Counts[C];
+    }
+    return reinterpret_cast<std::byte *>(Local.Heads[C]);
+  }
+
+  static auto xMalloc(int N) noexcept -> void * {
+    auto &S = shared();
+    S.Mallocs.fetch_add(1, std::memory_order_relaxed);
+    auto Size = static_cast<std::size_t>(std::max(N, 1));
+    auto C = classOf(Size);
+
+    std::byte *Block;
+    if (C == Large) {
+      S.LargeMallocs.fetch_add(1, std::memory_order_relaxed);
+      Block = static_cast<std::byte *>(std::malloc(Header + Size));
+    } else {
+      auto &Local = cache();
+      Block = reinterpret_cast<std::byte *>(Local.Heads[C]);
+      if (!Block)
+        Block = refill(C);
+      if (Block) {
+        Local.Heads[C] = Local.Heads[C]->Next;
+        --Local.Counts[C];
+      }
+    }
+    if (!Block) [[unlikely]]
+      return nullptr;
+
+    auto *H = reinterpret_cast<BlockHeader *>(Block);
+    H->Class = C;
+    H->Size = C == Large ? Size : Classes[C];
+    return Block + Header;
+  }
+
+  static void xFree(void *P) noexcept {
+    if (!P)
+      return;
+    shared().Frees.fetch_add(1, std::memory_order_relaxed);
+    auto *H = headerOf(P);
+    if (H->Class == Large) {
+      std::free(H);
+      return;
+    }
+
+    auto C = H->Class;
+    auto &Local = cache();
+    auto *Block = reinterpret_cast<FreeBlock *>(H);
+    Block->Next = Local.Heads[C];
+    Local.Heads[C] = Block;
+    if (++Local.Counts[C] > CacheLimit)
+      Local.spill(C, CacheLimit / 2);
+  }
+
+  static auto xRealloc(void *P, int N) noexcept -> void * {
+    shared().Reallocs.fetch_add(1, std::memory_order_relaxed);
+    auto Size = static_cast<std::size_t>(std::max(N, 1));
+    auto *H = headerOf(P);
+    if (H->Class != Large && Size <= H->Size)
+      return P;
+
+    void *New = xMalloc(N);
+    if (!New) [[unlikely]]
+      return nullptr;
+    std::memcpy(New, P, std::min<std::size_t>(H->Size, Size));
+    xFree(P);
+    return New;
+  }
+
+  static auto xSize(void *P) noexcept -> int {
+    return P ? static_cast<int>(headerOf(P)->Size) : 0;
+  }
+
+  static auto xRoundup(int N) noexcept -> int {
+    auto C = classOf(static_cast<std::size_t>(std::max(N, 1)));
+    return C == Large ? (N + 7) & ~7 : static_cast<int>(Classes[C]);
+  }
+
+  static auto xInit(void *) noexcept -> int { return SQLITE_OK; }
+  static void xShutdown(void *) noexcept {}
+};
+
+struct MemoryConfig {
+  // Install PoolAllocator through SQLITE_CONFIG_MALLOC.
+  bool UsePoolAllocator{false};
+  // Preallocated page cache (SQLITE_CONFIG_PAGECACHE). A slot must hold a
+  // page plus SQLite's per-page header, i.e. page_size + ~256 bytes.
+  // Zero slots leaves the page cache on the general allocator.
+  int PageCacheSlotSize{4096 + 256};
+  int PageCacheSlots{0};
+  // SQLITE_CONFIG_MEMSTATUS. Keeping it on makes sqlite3_memory_used()
+  // meaningful at the cost of a mutex per allocation.
+  bool MemStatus{true};
+};
+
+// Process-wide SQLite memory setup. Must run before SQLite is initialized
+// (i.e. before the first open()) or after sqlite3_shutdown().
+inline auto configure(MemoryConfig const &Config) noexcept -> ExpectedT<void> {
+  auto Check = [](int E) -> ExpectedT<void> {
+    if (E == SQLITE_MISUSE) [[unlikely]]
+      return std::unexpected("SQLite is already initialized; configure() "
+                             "must run before the first connection is "
+                             "opened");
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return {};
+  };
+
+  if (auto E = Check(sqlite3_config(SQLITE_CONFIG_MEMSTATUS,
+                                    static_cast<int>(Config.MemStatus)));
+      !E) [[unlikely]]
+    return E;
+
+  // The allocator PoolAllocator replaced, reinstalled when it is no longer
+  // wanted.
+  static std::optional<sqlite3_mem_methods> Replaced;
+  if (Config.UsePoolAllocator) {
+    if (!Replaced) {
+      sqlite3_mem_methods Current;
+      if (auto E = Check(sqlite3_config(SQLITE_CONFIG_GETMALLOC, &Current));
+          !E) [[unlikely]]
+        return E;
+      Replaced = Current;
+    }
+    if (auto E = Check(sqlite3_config(SQLITE_CONFIG_MALLOC,
+                                      &PoolAllocator::methods()));
+        !E) [[unlikely]]
+      return E;
+  } else if (Replaced) {
+    if (auto E = Check(sqlite3_config(SQLITE_CONFIG_MALLOC, &*Replaced)); !E)
+        [[unlikely]]
+      return E;
+    Replaced.reset();
+  }
+
+  // SQLite only borrows the buffer, so it lives here until reconfigured.
+  static std::unique_ptr<std::byte[]> PageCache;
+  std::unique_ptr<std::byte[]> Buffer;
+  if (Config.PageCacheSlots > 0)
+    Buffer = std::make_unique<std::byte[]>(
+        std::size_t(Config.PageCacheSlotSize) * Config.PageCacheSlots);
+  if (auto E = Check(sqlite3_config(SQLITE_CONFIG_PAGECACHE, Buffer.get(),
+                                    Config.PageCacheSlotSize,
+                                    Buffer ? Config.PageCacheSlots : 0));
+      !E) [[unlikely]]
+    return E;
+  PageCache = std::move(Buffer);
+  return {};
+}
+
+// Bytes currently allocated by SQLite across all connections.
+inline auto memoryUsed() noexcept -> std::int64_t {
+  return sqlite3_memory_used();
+}
+
+inline auto memoryHighwater(bool Reset = false) noexcept -> std::int64_t {
+  return sqlite3_memory_highwater(Reset);
+}
+
+} // namespace esqlite
+
+#endif // ESQLITE_MEMORY_CONFIG_H
@@ -0,0 +1,270 @@
+#ifndef ESQLITE_OPEN_OPTIONS_H
+#define ESQLITE_OPEN_OPTIONS_H
+
+#pragma once
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <sqlite3.h>
+
+#include "esqlite.h"
+
+namespace esqlite {
+
+enum class JournalMode { Default, Delete, Truncate, Persist, Memory, Wal, Off };
+enum class Synchronous { Default, Off, Normal, Full, Extra };
+enum class TempStore { Default, File, Memory };
+enum class Threading {
+  Default,
+  // SQLITE_OPEN_NOMUTEX: the connection must be used by one thread at a time.
+  MultiThread,
+  // SQLITE_OPEN_FULLMUTEX: every call on the connection is serialized.
+  Serialized,
+};
+
+// Connection settings applied by open(Path, OpenOptions). Unset fields keep
+// SQLite's defaults. Every setting is read back after it is applied, so a
+// setting SQLite ignores (e.g. page_size on a database that already has
+// content, or WAL on an in-memory database) fails the open instead of
+// silently leaving the connection misconfigured.
+struct OpenOptions {
+  int Flags{SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE};
+  Threading Mutex{Threading::Default};
+  std::optional<std::chrono::milliseconds> BusyTimeout{};
+  // Only takes effect before the database has content.
+  std::optional<int> PageSize{};
+  bool ExclusiveLocking{false};
+  JournalMode Journal{JournalMode::Default};
+  Synchronous Sync{Synchronous::Default};
+  TempStore Temp{TempStore::Default};
+  // Page cache budget; maps to a negative PRAGMA cache_size.
+  std::optional<std::int64_t> CacheSizeKiB{};
+  // Capped by SQLITE_MAX_MMAP_SIZE, so a smaller read-back is accepted.
+  std::optional<std::int64_t> MmapSize{};
+  // WAL pages between automatic checkpoints; 0 disables them.
+  std::optional<int> WalAutoCheckpoint{};
+};
+
+// Presets list every member, so each reads as a complete configuration.
+
+// Many concurrent readers, occasional writes.
+inline constexpr OpenOptions ReadHeavy = {
+    .Flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+    .Mutex = Threading::MultiThread,
+    .BusyTimeout = std::chrono::milliseconds(5000),
+    .PageSize = std::nullopt,
+    .ExclusiveLocking = false,
+    .Journal = JournalMode::Wal,
+    .Sync = Synchronous::Normal,
+    .Temp = TempStore::Memory,
+    .CacheSizeKiB = 64 << 10,
+    .MmapSize = std::int64_t(256) << 20,
+    .WalAutoCheckpoint = std::nullopt,
+};
+
+// Sustained small write transactions. NORMAL is durable against
+// application crashes in WAL mode; checkpoints run less often.
+inline constexpr OpenOptions WriteHeavy = {
+    .Flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+    .Mutex = Threading::MultiThread,
+    .BusyTimeout = std::chrono::milliseconds(5000),
+    .PageSize = std::nullopt,
+    .ExclusiveLocking = false,
+    .Journal = JournalMode::Wal,
+    .Sync = Synchronous::Normal,
+    .Temp = TempStore::Memory,
+    .CacheSizeKiB = 32 << 10,
+    .MmapSize = std::nullopt,
+    .WalAutoCheckpoint = 4000,
+};
+
+// Scratch databases whose contents need not survive a crash.
+inline constexpr OpenOptions Ephemeral = {
+    .Flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+    .Mutex = Threading::MultiThread,
+    .BusyTimeout = std::nullopt,
+    .PageSize = std::nullopt,
+    .ExclusiveLocking = false,
+    .Journal = JournalMode::Memory,
+    .Sync = Synchronous::Off,
+    .Temp = TempStore::Memory,
+    .CacheSizeKiB = 16 << 10,
+    .MmapSize = std::nullopt,
+    .WalAutoCheckpoint = std::nullopt,
+};
+
+// One-off loads into a database nobody else has open. A crash mid-load can
+// corrupt the file, so load into a fresh file and switch to another
+// profile afterwards.
+inline constexpr OpenOptions BulkLoad = {
+    .Flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+    .Mutex = Threading::MultiThread,
+    .BusyTimeout = std::nullopt,
+    .PageSize = std::nullopt,
+    .ExclusiveLocking = true,
+    .Journal = JournalMode::Off,
+    .Sync = Synchronous::Off,
+    .Temp = TempStore::Memory,
+    .CacheSizeKiB = 256 << 10,
+    .MmapSize = std::nullopt,
+    .WalAutoCheckpoint = std::nullopt,
+};
+
+namespace detail {
+
+// Uncached: these statements run once per connection.
+inline auto readPragma(Connection &Conn, std::string const &Sql) noexcept
+    -> ExpectedT<std::string> {
+  auto Stmt = Conn.prepare(Sql);
+  if (!Stmt) [[unlikely]]
+    return std::unexpected(Stmt.error());
+  std::string Value;
+  for (auto &&Row : Stmt->runReading<std::string_view>()) {
+    if (!Row) [[unlikely]]
+      return std::unexpected(Row.error());
+    Value = std::get<0>(*Row);
+  }
+  return Value;
+}
+
+// Sets the pragma and checks that reading it back yields Expected, or a
+// number no larger than it when AtMost is set.
+inline auto applyPragma(Connection &Conn, std::string_view Name,
+                        std::string const &Value, std::string_view Expected,
+                        std::string_view Error, bool AtMost = false) noexcept
+    -> ExpectedT<void> {
+  auto Pragma = "PRAGMA " + std::string(Name);
+  if (auto E = readPragma(Conn, Pragma + " = " + Value); !E) [[unlikely]]
+    return std::unexpected(E.error());
+  auto Actual = readPragma(Conn, Pragma);
+  if (!Actual) [[unlikely]]
+    return std::unexpected(Actual.error());
+  auto Number = [](std::string_view S) {
+    std::int64_t N = 0;
+    std::from_chars(S.data(), S.data() + S.size(), N);
+    return N;
+  };
+  bool Applied = AtMost ? Number(*Actual) <= Number(Expected)
+                        : *Actual == Expected;
+  if (!Applied) [[unlikely]]
+    return std::unexpected(Error);
+  return {};
+}
+
+inline auto applyOptions(Connection &Conn, OpenOptions const &Options) noexcept
+    -> ExpectedT<void> {
+  auto *Db = Conn.nativeHandle();
+  if (Options.Mutex != Threading::Default &&
+      (sqlite3_db_mutex(Db) != nullptr) !=
+          (Options.Mutex == Threading::Serialized)) [[unlikely]]
+    return std::unexpected("Threading mode was not applied");
+
+  if (Options.BusyTimeout) {
+    sqlite3_busy_timeout(Db, int(Options.BusyTimeout->count()));
+    auto Expected = std::to_string(Options.BusyTimeout->count());
+    auto Actual = readPragma(Conn, "PRAGMA busy_timeout");
+    if (!Actual) [[unlikely]]
+      return std::unexpected(Actual.error());
+    if (*Actual != Expected) [[unlikely]]
+      return std::unexpected("busy_timeout was not applied");
+  }
+
+  // page_size and locking_mode must precede the switch to WAL.
+  if (Options.PageSize) {
+    auto Size = std::to_string(*Options.PageSize);
+    if (auto E = applyPragma(Conn, "page_size", Size, Size,
+                             "page_size was not applied (the database "
+                             "already has content)");
+        !E) [[unlikely]]
+      return E;
+  }
+
+  if (Options.ExclusiveLocking) {
+    if (auto E = applyPragma(Conn, "locking_mode", "EXCLUSIVE", "exclusive",
+                             "locking_mode was not applied");
+        !E) [[unlikely]]
+      return E;
+  }
+
+  if (Options.Journal != JournalMode::Default) {
+    static constexpr std::string_view Modes[] = {
+        "", "delete", "truncate", "persist", "memory", "wal", "off"};
+    auto Mode = std::string(Modes[int(Options.Journal)]);
+    if (auto E = applyPragma(Conn, "journal_mode", Mode, Mode,
+                             "journal_mode was not applied");
+        !E) [[unlikely]]
+      return E;
+  }
+
+  if (Options.Sync != Synchronous::Default) {
+    auto Level = std::to_string(int(Options.Sync) - 1);
+    if (auto E = applyPragma(Conn, "synchronous", Level, Level,
+                             "synchronous was not applied");
+        !E) [[unlikely]]
+      return E;
+  }
+
+  if (Options.Temp != TempStore::Default) {
+    auto Store = std::to_string(int(Options.Temp));
+    if (auto E = applyPragma(Conn, "temp_store", Store, Store,
+                             "temp_store was not applied");
+        !E) [[unlikely]]
+      return E;
+  }
+
+  if (Options.CacheSizeKiB) {
+    auto Size = std::to_string(-*Options.CacheSizeKiB);
+    if (auto E = applyPragma(Conn, "cache_size", Size, Size,
+                             "cache_size was not applied");
+        !E) [[unlikely]]
+      return E;
+  }
+
+  if (Options.MmapSize) {
+    auto Size = std::to_string(*Options.MmapSize);
+    if (auto E = applyPragma(Conn, "mmap_size", Size, Size,
+                             "mmap_size was not applied", /*AtMost=*/true);
+        !E) [[unlikely]]
+      return E;
+  }
+
+  if (Options.WalAutoCheckpoint) {
+    auto Pages = std::to_string(*Options.WalAutoCheckpoint);
+    if (auto E = applyPragma(Conn, "wal_autocheckpoint", Pages, Pages,
+                             "wal_autocheckpoint was not applied");
+        !E) [[unlikely]]
+      return E;
+  }
+  return {};
+}
+
+} // namespace detail
+
+// Opens Path and applies Options as a unit: if any setting fails or does
+// not read back as requested, the connection is closed and the error
+// returned.
+inline auto open(std::string_view Path, OpenOptions const &Options) noexcept
+    -> ExpectedT<Connection> {
+  int Flags = Options.Flags;
+  if (Options.Mutex == Threading::MultiThread)
+    Flags |= SQLITE_OPEN_NOMUTEX;
+  else if (Options.Mutex == Threading::Serialized)
+    Flags |= SQLITE_OPEN_FULLMUTEX;
+
+  auto Conn = open_v2(Path, Flags);
+  if (!Conn) [[unlikely]]
+    return Conn;
+  if (auto E = detail::applyOptions(*Conn, Options); !E) [[unlikely]]
+    return std::unexpected(E.error());
+  return Conn;
+}
+
+} // namespace esqlite
+
+#endif // ESQLITE_OPEN_OPTIONS_H
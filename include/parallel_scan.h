@@ -0,0 +1,237 @@
+#ifndef ESQLITE_PARALLEL_SCAN_H
+#define ESQLITE_PARALLEL_SCAN_H
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "esqlite.h"
+
+namespace esqlite {
+
+struct ScanOptions {
+  // Select list and optional filter, spliced into
+  // "SELECT <Columns> FROM <Table> WHERE <Key> BETWEEN ? AND ? AND
+  // (<Predicate>)".
+  std::string_view Columns{"*"};
+  std::string_view Predicate{};
+  // Integer key the range is split on: rowid or an indexed INTEGER column.
+  std::string_view Key{"rowid"};
+  // 0 uses std::thread::hardware_concurrency().
+  std::size_t Threads{0};
+  // More shards than threads lets idle workers steal from busy ones when
+  // the keys are unevenly distributed.
+  std::size_t ShardsPerThread{8};
+  // mmap_size for the worker connections; 0 reads through the page cache.
+  std::int64_t MmapSize{std::int64_t(256) << 20};
+};
+
+struct ScanStats {
+  std::uint64_t Rows{0};
+  std::size_t Threads{0};
+  std::size_t Shards{0};
+  // Shards a worker took from another worker's queue.
+  std::size_t Steals{0};
+};
+
+namespace detail {
+
+// Key ranges, dealt round-robin to per-worker queues. A worker pops from the
+// front of its own queue and steals from the back of the others'.
+struct ShardQueues {
+  struct Shard {
+    std::int64_t Lo;
+    std::int64_t Hi;
+  };
+
+  struct Queue {
+    std::mutex Mutex;
+    std::deque<Shard> Shards;
+  };
+
+  ShardQueues(std::size_t Workers, std::int64_t Min, std::int64_t Max,
+              std::size_t Count) noexcept
+      : Queues(Workers) {
+    // Keys are walked as unsigned offsets so that no step overflows, even
+    // over the full int64 range; Width is one less than the key count.
+    auto Width = std::uint64_t(Max) - std::uint64_t(Min);
+    Count = std::max<std::size_t>(1, Count);
+    if (Width < Count - 1)
+      Count = Width + 1;
+    auto Step = Width / Count + (Width % Count + 1) / Count;
+    auto Lo = std::uint64_t(Min);
+    for (std::size_t I = 0; I < Count; ++I) {
+      auto Hi = I + 1 == Count ? std::uint64_t(Max) : Lo + Step - 1;
+      Queues[I % Workers].Shards.push_back(
+          {std::int64_t(Lo), std::int64_t(Hi)});
+      Lo = Hi + 1;
+    }
+    Total = Count;
+  }
+
+  auto next(std::size_t Worker, bool &Stolen) noexcept
+      -> std::optional<Shard> {
+    Stolen = false;
+    {
+      auto &Own = Queues[Worker];
+      std::lock_guard Lock(Own.Mutex);
+      if (!Own.Shards.empty()) {
+        auto S = Own.Shards.front();
+        Own.Shards.pop_front();
+        return S;
+      }
+    }
+    for (std::size_t I = 1; I < Queues.size(); ++I) {
+      auto &Victim = Queues[(Worker + I) % Queues.size()];
+      std::lock_guard Lock(Victim.Mutex);
+      if (!Victim.Shards.empty()) {
+        auto S = Victim.Shards.back();
+        Victim.Shards.pop_back();
+        Stolen = true;
+        return S;
+      }
+    }
+    return std::nullopt;
+  }
+
+  std::vector<Queue> Queues;
+  std::size_t Total{0};
+};
+
+} // namespace detail
+
+// Scans Table on Options.Threads threads, each with its own read-only
+// connection to the database behind Conn. The key range [min, max] is cut
+// into equal shards that the workers pull from, stealing when their own
+// queue runs dry. Callback(Worker, Row) runs on the worker thread with
+// Worker in [0, Threads), so per-thread accumulators need no locking. Rows
+// arrive in no particular order, within a shard or across shards.
+// Views in Row are valid only during the call.
+//
+// Every worker reads its own snapshot. Under WAL this never blocks
+// writers, but rows committed while the scan runs may or may not be seen.
+// The first error stops all workers and is returned.
+template <class... ColTs, class CallbackT>
+auto parallelScan(Connection &Conn, std::string_view Table,
+                  ScanOptions const &Options, CallbackT &&Callback) noexcept
+    -> ExpectedT<ScanStats> {
+  static_assert(
+      std::is_invocable_v<CallbackT &, std::size_t, std::tuple<ColTs...> &>,
+      "Callback must accept (std::size_t Worker, std::tuple<ColTs...> &)");
+
+  auto const *Path = sqlite3_db_filename(Conn.nativeHandle(), "main");
+  if (!Path || !*Path) [[unlikely]]
+    return std::unexpected("parallelScan needs an on-disk database");
+
+  auto Key = std::string(Options.Key);
+  auto From = " FROM " + std::string(Table);
+  // Separate subqueries: SQLite only answers a lone min() or max() from the
+  // index, and would scan the table for both at once.
+  auto Bounds = Conn.prepare("SELECT (SELECT min(" + Key + ")" + From +
+                             "), (SELECT max(" + Key + ")" + From + ")");
+  if (!Bounds) [[unlikely]]
+    return std::unexpected(Bounds.error());
+  auto Step = Bounds->step();
+  if (!Step) [[unlikely]]
+    return std::unexpected(Step.error());
+
+  ScanStats Stats;
+  Stats.Threads = Options.Threads ? Options.Threads
+                                  : std::thread::hardware_concurrency();
+  Stats.Threads = std::max<std::size_t>(Stats.Threads, 1);
+  // min() is NULL on an empty table.
+  if (*Step != Statement::StepOk::STEP_ROW ||
+      sqlite3_column_type(Bounds->nativeHandle(), 0) == SQLITE_NULL)
+    return Stats;
+  std::int64_t Min = 0, Max = 0;
+  (void)Bounds->readColumns(0, Min, Max);
+  Bounds = Statement();
+
+  detail::ShardQueues Queues(Stats.Threads, Min, Max,
+                             Stats.Threads * Options.ShardsPerThread);
+  Stats.Shards = Queues.Total;
+
+  auto Sql = "SELECT " + std::string(Options.Columns) + From +
+             " WHERE " + Key + " BETWEEN ? AND ?";
+  if (!Options.Predicate.empty())
+    Sql += " AND (" + std::string(Options.Predicate) + ")";
+
+  std::atomic<bool> Failed{false};
+  std::atomic<std::uint64_t> Rows{0};
+  std::atomic<std::size_t> Steals{0};
+  std::mutex ErrorMutex;
+  std::string_view Error;
+  auto Fail = [&](std::string_view E) {
+    std::lock_guard Lock(ErrorMutex);
+    if (!Failed.exchange(true))
+      Error = E;
+  };
+
+  auto Work = [&](std::size_t Worker) {
+    auto Reader = open_v2(Path, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX);
+    if (!Reader) [[unlikely]]
+      return Fail(Reader.error());
+    // A fresh connection starts with a cold page cache; mapping the file
+    // lets the workers share the OS cache instead of each copying pages.
+    if (Options.MmapSize) {
+      auto Pragma = "PRAGMA mmap_size = " + std::to_string(Options.MmapSize);
+      if (auto E = Reader->prepare(Pragma); E) [[likely]]
+        (void)E->step();
+    }
+    auto Stmt = Reader->prepare(Sql);
+    if (!Stmt) [[unlikely]]
+      return Fail(Stmt.error());
+
+    std::uint64_t Seen = 0;
+    bool Stolen = false;
+    while (!Failed.load(std::memory_order_relaxed)) {
+      auto Shard = Queues.next(Worker, Stolen);
+      if (!Shard)
+        break;
+      Steals.fetch_add(Stolen, std::memory_order_relaxed);
+      if (auto E = Stmt->bindParams(1, Shard->Lo, Shard->Hi); !E)
+          [[unlikely]]
+        return Fail(E.error());
+      for (auto &&Row : Stmt->template runReading<ColTs...>()) {
+        if (!Row) [[unlikely]]
+          return Fail(Row.error());
+        Callback(Worker, *Row);
+        ++Seen;
+      }
+      (void)Stmt->reset();
+    }
+    Rows.fetch_add(Seen, std::memory_order_relaxed);
+  };
+
+  {
+    std::vector<std::jthread> Workers;
+    Workers.reserve(Stats.Threads);
+    for (std::size_t I = 0; I < Stats.Threads; ++I)
+      Workers.emplace_back(Work, I);
+  }
+
+  if (Failed) [[unlikely]]
+    return std::unexpected(Error);
+  Stats.Rows = Rows;
+  Stats.Steals = Steals;
+  return Stats;
+}
+
+} // namespace esqlite
+
+#endif // ESQLITE_PARALLEL_SCAN_H
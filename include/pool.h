@@ -0,0 +1,303 @@
+#ifndef ESQLITE_POOL_H
+#define ESQLITE_POOL_H
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "esqlite.h"
+
+namespace esqlite {
+
+struct PoolOptions {
+  std::size_t Readers{4};
+  // Applied to every connection through PRAGMA busy_timeout.
+  std::chrono::milliseconds BusyTimeout{5000};
+};
+
+struct PoolStats {
+  std::size_t Readers{0};
+  std::size_t InUse{0};
+  std::uint64_t Acquisitions{0};
+  // Blocking acquisitions that found the pool exhausted and had to wait.
+  std::uint64_t Waits{0};
+  // tryAcquireRead() calls that failed because the pool was exhausted.
+  std::uint64_t Rejections{0};
+  std::chrono::nanoseconds TotalWait{0};
+  std::chrono::nanoseconds MaxWait{0};
+  // Sum of reader lease lifetimes.
+  std::chrono::nanoseconds BusyTime{0};
+  std::chrono::nanoseconds Uptime{0};
+
+  // Fraction of reader capacity that was leased out since the pool opened.
+  auto utilisation() const noexcept -> double {
+    if (!Readers || !Uptime.count())
+      return 0;
+    return double(BusyTime.count()) / (double(Uptime.count()) * Readers);
+  }
+};
+
+// N read-only connections plus one writer over the same database, all in WAL
+// mode so readers never block the writer. Readers are kept on a lock-free
+// free list; the writer is serialized by a mutex. Every lease gives its
+// holder exclusive use of one Connection and must not outlive the Pool.
+// Pools come only from openPool(); a moved-from Pool may only be assigned
+// to or destroyed.
+struct Pool final {
+  struct Lease;
+
+  Pool() = delete;
+
+  Pool(Pool const &) = delete;
+  Pool &operator=(Pool const &) = delete;
+
+  Pool(Pool &&) noexcept = default;
+  Pool &operator=(Pool &&) noexcept = default;
+
+  // Blocks until a reader is free.
+  auto acquireRead() noexcept -> Lease;
+
+  // Fails fast with an error when every reader is leased out.
+  auto tryAcquireRead() noexcept -> ExpectedT<Lease>;
+
+  // Blocks until the writer is free.
+  auto acquireWrite() noexcept -> Lease;
+
+  auto stats() const noexcept -> PoolStats;
+
+private:
+  static constexpr std::uint32_t Nil = 0;
+
+  struct Shared {
+    std::vector<Connection> Readers;
+    // Treiber stack over reader indices. Links and the head store index + 1
+    // so that 0 means "empty"; the head's upper half is an ABA tag.
+    std::unique_ptr<std::atomic<std::uint32_t>[]> Next;
+    std::atomic<std::uint64_t> Head{Nil};
+
+    Connection Writer;
+    std::mutex WriterMutex;
+
+    std::atomic<std::size_t> InUse{0};
+    std::atomic<std::uint64_t> Acquisitions{0};
+    std::atomic<std::uint64_t> Waits{0};
+    std::atomic<std::uint64_t> Rejections{0};
+    std::atomic<std::int64_t> TotalWaitNs{0};
+    std::atomic<std::int64_t> MaxWaitNs{0};
+    std::atomic<std::int64_t> BusyNs{0};
+    std::chrono::steady_clock::time_point Opened{
+        std::chrono::steady_clock::now()};
+
+    auto pop() noexcept -> std::uint32_t {
+      auto Old = Head.load(std::memory_order_acquire);
+      while (true) {
+        auto Top = static_cast<std::uint32_t>(Old);
+        if (Top == Nil)
+          return Nil;
+        auto Tag = (Old >> 32) + 1;
+        auto New = (Tag << 32) | Next[Top - 1].load(std::memory_order_relaxed);
+        if (Head.compare_exchange_weak(Old, New, std::memory_order_acquire,
+                                       std::memory_order_acquire))
+          return Top;
+      }
+    }
+
+    void push(std::uint32_t Slot) noexcept {
+      auto Old = Head.load(std::memory_order_relaxed);
+      while (true) {
+        Next[Slot - 1].store(static_cast<std::uint32_t>(Old),
+                             std::memory_order_relaxed);
+        auto New = (((Old >> 32) + 1) << 32) | Slot;
+        if (Head.compare_exchange_weak(Old, New, std::memory_order_release,
+                                       std::memory_order_relaxed))
+          break;
+      }
+      Head.notify_one();
+    }
+
+    void recordWait(std::chrono::nanoseconds Waited) noexcept {
+      Waits.fetch_add(1, std::memory_order_relaxed);
+      TotalWaitNs.fetch_add(Waited.count(), std::memory_order_relaxed);
+      auto Max = MaxWaitNs.load(std::memory_order_relaxed);
+      while (Max < Waited.count() &&
+             !MaxWaitNs.compare_exchange_weak(Max, Waited.count(),
+                                              std::memory_order_relaxed))
+        ;
+    }
+  };
+
+  explicit Pool(std::unique_ptr<Shared> S) noexcept : S(std::move(S)) {}
+
+  friend auto openPool(std::string_view Path, PoolOptions Options) noexcept
+      -> ExpectedT<Pool>;
+
+private:
+  std::unique_ptr<Shared> S;
+};
+
+struct Pool::Lease final {
+  Lease() noexcept = default;
+
+  Lease(Lease const &) = delete;
+  Lease &operator=(Lease const &) = delete;
+
+  Lease(Lease &&Other) noexcept
+      : S(std::exchange(Other.S, nullptr)), Slot(Other.Slot),
+        Since(Other.Since) {}
+
+  Lease &operator=(Lease &&Other) noexcept {
+    if (this == &Other) [[unlikely]]
+      return *this;
+    release();
+    S = std::exchange(Other.S, nullptr);
+    Slot = Other.Slot;
+    Since = Other.Since;
+    return *this;
+  }
+
+  ~Lease() noexcept { release(); }
+
+  auto operator*() const noexcept -> Connection & {
+    return Slot == Nil ? S->Writer : S->Readers[Slot - 1];
+  }
+  auto operator->() const noexcept -> Connection * { return &**this; }
+
+  void release() noexcept {
+    if (!S)
+      return;
+    if (Slot == Nil) {
+      S->WriterMutex.unlock();
+    } else {
+      auto Held = std::chrono::steady_clock::now() - Since;
+      S->BusyNs.fetch_add(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(Held).count(),
+          std::memory_order_relaxed);
+      S->InUse.fetch_sub(1, std::memory_order_relaxed);
+      S->push(Slot);
+    }
+    S = nullptr;
+  }
+
+private:
+  Lease(Shared *S, std::uint32_t Slot) noexcept
+      : S(S), Slot(Slot), Since(std::chrono::steady_clock::now()) {
+    S->Acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (Slot != Nil)
+      S->InUse.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  friend struct Pool;
+
+private:
+  Shared *S{nullptr};
+  // Reader index + 1, or Nil for the writer.
+  std::uint32_t Slot{Nil};
+  std::chrono::steady_clock::time_point Since;
+};
+
+inline auto Pool::acquireRead() noexcept -> Lease {
+  if (auto Slot = S->pop(); Slot != Nil) [[likely]]
+    return {S.get(), Slot};
+
+  auto Start = std::chrono::steady_clock::now();
+  while (true) {
+    auto Observed = S->Head.load(std::memory_order_acquire);
+    if (static_cast<std::uint32_t>(Observed) == Nil)
+      S->Head.wait(Observed, std::memory_order_acquire);
+    if (auto Slot = S->pop(); Slot != Nil) {
+      S->recordWait(std::chrono::steady_clock::now() - Start);
+      return {S.get(), Slot};
+    }
+  }
+}
+
+inline auto Pool::tryAcquireRead() noexcept -> ExpectedT<Lease> {
+  if (auto Slot = S->pop(); Slot != Nil) [[likely]]
+    return {Lease(S.get(), Slot)};
+  S->Rejections.fetch_add(1, std::memory_order_relaxed);
+  return std::unexpected("Pool is exhausted");
+}
+
+inline auto Pool::acquireWrite() noexcept -> Lease {
+  if (!S->WriterMutex.try_lock()) {
+    auto Start = std::chrono::steady_clock::now();
+    S->WriterMutex.lock();
+    S->recordWait(std::chrono::steady_clock::now() - Start);
+  }
+  return {S.get(), Nil};
+}
+
+inline auto Pool::stats() const noexcept -> PoolStats {
+  PoolStats Stats;
+  Stats.Readers = S->Readers.size();
+  Stats.InUse = S->InUse.load(std::memory_order_relaxed);
+  Stats.Acquisitions = S->Acquisitions.load(std::memory_order_relaxed);
+  Stats.Waits = S->Waits.load(std::memory_order_relaxed);
+  Stats.Rejections = S->Rejections.load(std::memory_order_relaxed);
+  Stats.TotalWait = std::chrono::nanoseconds(
+      S->TotalWaitNs.load(std::memory_order_relaxed));
+  Stats.MaxWait =
+      std::chrono::nanoseconds(S->MaxWaitNs.load(std::memory_order_relaxed));
+  Stats.BusyTime =
+      std::chrono::nanoseconds(S->BusyNs.load(std::memory_order_relaxed));
+  Stats.Uptime = std::chrono::steady_clock::now() - S->Opened;
+  return Stats;
+}
+
+inline auto openPool(std::string_view Path, PoolOptions Options) noexcept
+    -> ExpectedT<Pool> {
+  if (!Options.Readers) [[unlikely]]
+    return std::unexpected("Pool needs at least one reader");
+
+  auto S = std::make_unique<Pool::Shared>();
+  auto BusyTimeout =
+      "PRAGMA busy_timeout = " + std::to_string(Options.BusyTimeout.count());
+
+  auto Writer = open_v2(Path, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                                  SQLITE_OPEN_NOMUTEX);
+  if (!Writer) [[unlikely]]
+    return std::unexpected(Writer.error());
+  if (auto E = Writer->run(BusyTimeout); !E) [[unlikely]]
+    return std::unexpected(E.error());
+
+  // journal_mode is persistent, so setting it once on the writer is enough,
+  // but it has to be read back: in-memory databases silently stay in
+  // "memory" mode.
+  bool IsWal = false;
+  for (auto &&Row :
+       Writer->runReading<std::string_view>("PRAGMA journal_mode = WAL")) {
+    if (!Row) [[unlikely]]
+      return std::unexpected(Row.error());
+    IsWal = std::get<0>(*Row) == "wal";
+  }
+  if (!IsWal) [[unlikely]]
+    return std::unexpected("Could not switch database to WAL mode");
+  S->Writer = std::move(*Writer);
+
+  S->Readers.reserve(Options.Readers);
+  S->Next = std::make_unique<std::atomic<std::uint32_t>[]>(Options.Readers);
+  for (std::size_t I = 0; I < Options.Readers; ++I) {
+    auto Reader = open_v2(Path, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX);
+    if (!Reader) [[unlikely]]
+      return std::unexpected(Reader.error());
+    if (auto E = Reader->run(BusyTimeout); !E) [[unlikely]]
+      return std::unexpected(E.error());
+    S->Readers.push_back(std::move(*Reader));
+    S->push(static_cast<std::uint32_t>(I + 1));
+  }
+
+  return {Pool(std::move(S))};
+}
+
+} // namespace esqlite
+
+#endif // ESQLITE_POOL_H
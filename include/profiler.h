@@ -0,0 +1,385 @@
+#ifndef ESQLITE_PROFILER_H
+#define ESQLITE_PROFILER_H
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "esqlite.h"
+
+// Set ESQLITE_PROFILING to 0 to compile the tracing out: Profiler::attach()
+// becomes a no-op and no trace callback is ever installed.
+#ifndef ESQLITE_PROFILING
+#define ESQLITE_PROFILING 1
+#endif
+
+namespace esqlite {
+
+// Log-linear latency histogram: four sub-buckets per power of two, which
+// bounds percentile error to ~19% without storing samples.
+struct LatencyHistogram {
+  static constexpr std::size_t SubBuckets = 4;
+  static constexpr std::size_t Buckets = 64 * SubBuckets;
+
+  void record(std::chrono::nanoseconds Elapsed) noexcept {
+    ++Counts[bucketOf(static_cast<std::uint64_t>(Elapsed.count()))];
+    ++Total;
+  }
+
+  // Upper bound of the bucket holding the given quantile (0 < Q <= 1).
+  auto percentile(double Q) const noexcept -> std::chrono::nanoseconds {
+    if (!Total)
+      return {};
+    auto Rank = static_cast<std::uint64_t>(Q * Total);
+    Rank = std::clamp<std::uint64_t>(Rank, 1, Total);
+    std::uint64_t Seen = 0;
+    for (std::size_t B = 0; B < Buckets; ++B) {
+      Seen += Counts[B];
+      if (Seen >= Rank)
+        return std::chrono::nanoseconds(upperBoundOf(B));
+    }
+    return std::chrono::nanoseconds(upperBoundOf(Buckets - 1));
+  }
+
+  auto count() const noexcept -> std::uint64_t { return Total; }
+
+private:
+  static auto bucketOf(std::uint64_t Ns) noexcept -> std::size_t {
+    if (Ns < SubBuckets)
+      return Ns;
+    auto Octave = std::bit_width(Ns) - 1;
+    auto Sub = (Ns >> (Octave - 2)) & (SubBuckets - 1);
+    return (Octave - 1) * SubBuckets + Sub;
+  }
+
+  static auto upperBoundOf(std::size_t Bucket) noexcept -> std::int64_t {
+    if (Bucket < SubBuckets)
+      return Bucket;
+    auto Octave = Bucket / SubBuckets + 1;
+    auto Sub = Bucket % SubBuckets;
+    if (Octave >= 62)
+      return INT64_MAX;
+    return std::int64_t((SubBuckets + Sub + 1) << (Octave - 2)) - 1;
+  }
+
+  std::array<std::uint64_t, Buckets> Counts{};
+  std::uint64_t Total{0};
+};
+
+// Aggregate over every execution of one normalized SQL text.
+struct QueryProfile {
+  std::string Sql;
+  std::uint64_t Count{0};
+  std::uint64_t Rows{0};
+  std::chrono::nanoseconds TotalTime{0};
+  std::chrono::nanoseconds MaxTime{0};
+  std::uint64_t FullscanSteps{0};
+  std::uint64_t Sorts{0};
+  std::uint64_t AutoIndex{0};
+  std::uint64_t VmSteps{0};
+  std::uint64_t Reprepares{0};
+  int MaxMemUsed{0};
+  LatencyHistogram Latency;
+};
+
+struct SlowQuery {
+  std::string_view Sql;
+  std::chrono::nanoseconds Elapsed;
+  // EXPLAIN QUERY PLAN output, one "detail" column per line.
+  std::vector<std::string> Plan;
+};
+
+// Registry of per-query statistics fed by sqlite3_trace_v2() on every
+// attached connection. One Profiler may serve connections on any number of
+// threads; it must outlive all of them (or detach() them first).
+// attach() and detach() must not race with statements running on the
+// connection they are given.
+struct Profiler final {
+  using SlowQueryHook = std::function<void(SlowQuery const &)>;
+
+  Profiler() noexcept = default;
+
+  Profiler(Profiler const &) = delete;
+  Profiler &operator=(Profiler const &) = delete;
+
+  void attach(Connection &Conn) noexcept {
+#if ESQLITE_PROFILING
+    std::lock_guard Lock(Mutex);
+    auto *Db = Conn.nativeHandle();
+    auto It = std::ranges::find(Taps, Db, &Tap::Db);
+    auto &T = It != Taps.end() ? *It : Taps.emplace_back();
+    T.Owner = this;
+    T.Db = Db;
+    sqlite3_trace_v2(Db, SQLITE_TRACE_PROFILE | SQLITE_TRACE_ROW, &onTrace,
+                     &T);
+#else
+    (void)Conn;
+#endif
+  }
+
+  void detach(Connection &Conn) noexcept {
+#if ESQLITE_PROFILING
+    auto *Db = Conn.nativeHandle();
+    sqlite3_trace_v2(Db, 0, nullptr, nullptr);
+    std::lock_guard Lock(Mutex);
+    std::erase_if(Taps, [Db](Tap const &T) { return T.Db == Db; });
+#else
+    (void)Conn;
+#endif
+  }
+
+  // Hook runs on the executing thread for every statement slower than
+  // Threshold, after the plan has been captured.
+  void setSlowQueryHook(std::chrono::nanoseconds Threshold,
+                        SlowQueryHook Hook) noexcept {
+    std::lock_guard Lock(Mutex);
+    SlowThreshold = Threshold;
+    OnSlow = std::move(Hook);
+  }
+
+  auto snapshot() const noexcept -> std::vector<QueryProfile> {
+    std::lock_guard Lock(Mutex);
+    std::vector<QueryProfile> Result;
+    Result.reserve(Profiles.size());
+    for (auto const &[_, Profile] : Profiles)
+      Result.push_back(Profile);
+    return Result;
+  }
+
+  void reset() noexcept {
+    std::lock_guard Lock(Mutex);
+    for (auto &[_, Profile] : Profiles) {
+      auto Sql = std::move(Profile.Sql);
+      Profile = QueryProfile();
+      Profile.Sql = std::move(Sql);
+    }
+  }
+
+  // Replaces numeric and string literals with '?' and collapses whitespace,
+  // so queries differing only in inlined constants share one entry.
+  static auto normalize(std::string_view Sql) noexcept -> std::string {
+    std::string Out;
+    Out.reserve(Sql.size());
+    auto IsIdent = [](char C) {
+      return std::isalnum(static_cast<unsigned char>(C)) || C == '_';
+    };
+    auto IsSpace = [](char C) {
+      return std::isspace(static_cast<unsigned char>(C));
+    };
+    for (std::size_t I = 0; I < Sql.size();) {
+      char C = Sql[I];
+      if (IsSpace(C)) {
+        while (I < Sql.size() && IsSpace(Sql[I]))
+          ++I;
+        if (!Out.empty() && I < Sql.size())
+          Out.push_back(' ');
+      } else if (C == '\'') {
+        // Skip the literal, honouring '' escapes.
+        for (++I; I < Sql.size(); ++I) {
+          if (Sql[I] != '\'')
+            continue;
+          if (I + 1 < Sql.size() && Sql[I + 1] == '\'') {
+            ++I;
+            continue;
+          }
+          ++I;
+          break;
+        }
+        Out.push_back('?');
+      } else if (std::isdigit(static_cast<unsigned char>(C)) &&
+                 (Out.empty() || !IsIdent(Out.back()))) {
+        while (I < Sql.size() && (IsIdent(Sql[I]) || Sql[I] == '.'))
+          ++I;
+        Out.push_back('?');
+      } else {
+        Out.push_back(C);
+        ++I;
+      }
+    }
+    return Out;
+  }
+
+private:
+  struct StringHash {
+    using is_transparent = void;
+    auto operator()(std::string_view S) const noexcept -> std::size_t {
+      return std::hash<std::string_view>()(S);
+    }
+  };
+
+  // Per-connection trace state. A connection is used by one thread at a
+  // time, so only the shared registry needs the mutex.
+  struct Tap {
+    Profiler *Owner{nullptr};
+    sqlite3 *Db{nullptr};
+    // Set while explain() runs its own statement on the connection.
+    bool Explaining{false};
+    std::unordered_map<sqlite3_stmt *, std::uint64_t> RowsInFlight;
+    // Counters of each statement at its previous execution. A finalized
+    // statement's entry stays until its address is reused or the map is
+    // full.
+    std::unordered_map<sqlite3_stmt *, std::array<int, 5>> Baselines;
+    // Raw SQL already mapped to its normalized profile. Queries with
+    // inlined literals each add an entry, so the map is capped.
+    std::unordered_map<std::string, QueryProfile *, StringHash,
+                       std::equal_to<>>
+        Resolved;
+  };
+
+  // Entries kept per connection in Tap::Baselines and Tap::Resolved; a full
+  // map is emptied and refilled.
+  static constexpr std::size_t MaxTracked = 4096;
+
+  static auto onTrace(unsigned Type, void *Ctx, void *P, void *X) noexcept
+      -> int {
+    auto &T = *static_cast<Tap *>(Ctx);
+    if (T.Explaining)
+      return 0;
+    auto *Stmt = static_cast<sqlite3_stmt *>(P);
+    if (Type == SQLITE_TRACE_ROW) {
+      ++T.RowsInFlight[Stmt];
+      return 0;
+    }
+
+    std::chrono::nanoseconds Elapsed(*static_cast<std::int64_t *>(X));
+    std::uint64_t Rows = 0;
+    if (auto It = T.RowsInFlight.find(Stmt); It != T.RowsInFlight.end()) {
+      Rows = It->second;
+      T.RowsInFlight.erase(It);
+    }
+    std::string_view Sql = sqlite3_sql(Stmt);
+    T.Owner->record(T, Stmt, Sql, Elapsed, Rows);
+    return 0;
+  }
+
+  void record(Tap &T, sqlite3_stmt *Stmt, std::string_view Sql,
+              std::chrono::nanoseconds Elapsed, std::uint64_t Rows) noexcept {
+    // Deltas since the previous execution of this statement. The counters
+    // are read without resetting them, so Statement::counters() still sees
+    // the totals; a lower value means they were reset since, or that the
+    // address now belongs to another statement.
+    static constexpr std::array<int, 5> Ops{
+        SQLITE_STMTSTATUS_FULLSCAN_STEP, SQLITE_STMTSTATUS_SORT,
+        SQLITE_STMTSTATUS_AUTOINDEX, SQLITE_STMTSTATUS_VM_STEP,
+        SQLITE_STMTSTATUS_REPREPARE};
+    if (T.Baselines.size() >= MaxTracked && !T.Baselines.contains(Stmt))
+      T.Baselines.clear();
+    auto &Before = T.Baselines[Stmt];
+    std::array<int, 5> Delta;
+    for (std::size_t I = 0; I < Ops.size(); ++I) {
+      int Now = sqlite3_stmt_status(Stmt, Ops[I], 0);
+      Delta[I] = Now >= Before[I] ? Now - Before[I] : Now;
+      Before[I] = Now;
+    }
+    auto [Fullscan, Sorts, AutoIndex, VmSteps, Reprepares] = Delta;
+    auto MemUsed = sqlite3_stmt_status(Stmt, SQLITE_STMTSTATUS_MEMUSED, 0);
+
+    SlowQueryHook Hook;
+    {
+      std::lock_guard Lock(Mutex);
+      auto It = T.Resolved.find(Sql);
+      if (It == T.Resolved.end()) {
+        if (T.Resolved.size() >= MaxTracked)
+          T.Resolved.clear();
+        auto Key = normalize(Sql);
+        auto &Profile = Profiles[Key];
+        Profile.Sql = std::move(Key);
+        It = T.Resolved.emplace(std::string(Sql), &Profile).first;
+      }
+
+      auto &Profile = *It->second;
+      ++Profile.Count;
+      Profile.Rows += Rows;
+      Profile.TotalTime += Elapsed;
+      Profile.MaxTime = std::max(Profile.MaxTime, Elapsed);
+      Profile.FullscanSteps += Fullscan;
+      Profile.Sorts += Sorts;
+      Profile.AutoIndex += AutoIndex;
+      Profile.VmSteps += VmSteps;
+      Profile.Reprepares += Reprepares;
+      Profile.MaxMemUsed = std::max(Profile.MaxMemUsed, MemUsed);
+      Profile.Latency.record(Elapsed);
+
+      if (OnSlow && Elapsed >= SlowThreshold)
+        Hook = OnSlow;
+    }
+
+    if (Hook)
+      Hook(SlowQuery{Sql, Elapsed, explain(T, Stmt, Sql)});
+  }
+
+  // Only DML and queries have a plan; DDL, PRAGMA and transaction control
+  // either fail to prepare under EXPLAIN or describe nothing useful.
+  static auto explainable(sqlite3_stmt *Stmt, std::string_view Sql) noexcept
+      -> bool {
+    if (sqlite3_stmt_isexplain(Stmt) != 0)
+      return false;
+    auto Begin = std::ranges::find_if_not(Sql, [](char C) {
+      return std::isspace(static_cast<unsigned char>(C));
+    });
+    auto End = std::find_if_not(Begin, Sql.end(), [](char C) {
+      return std::isalpha(static_cast<unsigned char>(C));
+    });
+    std::string Keyword(Begin, End);
+    std::ranges::transform(Keyword, Keyword.begin(), [](char C) {
+      return static_cast<char>(std::toupper(static_cast<unsigned char>(C)));
+    });
+    static constexpr std::array<std::string_view, 6> Explainable{
+        "SELECT", "INSERT", "UPDATE", "DELETE", "REPLACE", "WITH"};
+    return std::ranges::find(Explainable, Keyword) != Explainable.end();
+  }
+
+  // The EXPLAIN statement runs on the traced connection, so its own trace
+  // events are ignored rather than recorded as a query.
+  static auto explain(Tap &T, sqlite3_stmt *Traced,
+                      std::string_view Sql) noexcept
+      -> std::vector<std::string> {
+    std::vector<std::string> Plan;
+    if (!explainable(Traced, Sql))
+      return Plan;
+
+    struct Muted {
+      explicit Muted(Tap &Target) noexcept : Target(Target) {
+        Target.Explaining = true;
+      }
+      ~Muted() { Target.Explaining = false; }
+      Tap &Target;
+    } Mute(T);
+
+    auto Explain = "EXPLAIN QUERY PLAN " + std::string(Sql);
+    sqlite3_stmt *Stmt = nullptr;
+    if (sqlite3_prepare_v2(T.Db, Explain.c_str(), Explain.size(), &Stmt,
+                           nullptr) != SQLITE_OK)
+      return Plan;
+    // Columns: id, parent, notused, detail.
+    while (sqlite3_step(Stmt) == SQLITE_ROW)
+      if (auto const *Detail = sqlite3_column_text(Stmt, 3))
+        Plan.emplace_back(reinterpret_cast<char const *>(Detail));
+    sqlite3_finalize(Stmt);
+    return Plan;
+  }
+
+private:
+  mutable std::mutex Mutex;
+  std::unordered_map<std::string, QueryProfile> Profiles;
+  std::list<Tap> Taps;
+  std::chrono::nanoseconds SlowThreshold{std::chrono::nanoseconds::max()};
+  SlowQueryHook OnSlow;
+};
+
+} // namespace esqlite
+
+#endif // ESQLITE_PROFILER_H
@@ -0,0 +1,391 @@
+#ifndef ESQLITE_QUERY_H
+#define ESQLITE_QUERY_H
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "esqlite.h"
+
+namespace esqlite {
+
+// String literal usable as a template argument.
+template <std::size_t N> struct FixedString {
+  constexpr FixedString(char const (&S)[N]) noexcept {
+    std::copy_n(S, N, Data);
+  }
+
+  constexpr auto view() const noexcept -> std::string_view {
+    return {Data, N - 1};
+  }
+
+  char Data[N];
+};
+
+template <class... Ts> struct Result {};
+template <class... Ts> struct Params {};
+
+// Number of anonymous '?' placeholders in Sql, skipping string literals,
+// quoted identifiers and comments. Returns -1 if the statement uses
+// numbered (?NNN) or named (:a, @a, $a) parameters, which Query does not
+// support.
+constexpr auto countPlaceholders(std::string_view Sql) noexcept -> int {
+  auto IsIdent = [](char C) {
+    return (C >= 'a' && C <= 'z') || (C >= 'A' && C <= 'Z') ||
+           (C >= '0' && C <= '9') || C == '_' || C == '$';
+  };
+  int Count = 0;
+  for (std::size_t I = 0; I < Sql.size(); ++I) {
+    char C = Sql[I];
+    if (C == '\'' || C == '"' || C == '`' || C == '[') {
+      char Close = C == '[' ? ']' : C;
+      for (++I; I < Sql.size() && Sql[I] != Close; ++I)
+        ;
+    } else if (C == '-' && I + 1 < Sql.size() && Sql[I + 1] == '-') {
+      for (; I < Sql.size() && Sql[I] != '\n'; ++I)
+        ;
+    } else if (C == '/' && I + 1 < Sql.size() && Sql[I + 1] == '*') {
+      for (I += 2; I + 1 < Sql.size() && !(Sql[I] == '*' && Sql[I + 1] == '/');
+           ++I)
+        ;
+      ++I;
+    } else if (C == '?') {
+      if (I + 1 < Sql.size() && Sql[I + 1] >= '0' && Sql[I + 1] <= '9')
+        return -1;
+      ++Count;
+    } else if ((C == ':' || C == '@' || C == '$') &&
+               (I == 0 || !IsIdent(Sql[I - 1])) && I + 1 < Sql.size() &&
+               IsIdent(Sql[I + 1])) {
+      return -1;
+    }
+  }
+  return Count;
+}
+
+static_assert(countPlaceholders("SELECT a FROM t WHERE b = ? AND c = ?") == 2);
+static_assert(countPlaceholders("SELECT '?', \"?\" -- ?\n/* ? */ , ?") == 1);
+static_assert(countPlaceholders("SELECT a$b FROM t WHERE c = :c") == -1);
+
+template <class T>
+inline constexpr bool is_query_param_v =
+    is_sqlite_numeric_v<T> ||
+    is_any_of_v<T, std::nullptr_t, std::string_view, std::string,
+                std::span<std::uint8_t const>, std::vector<std::uint8_t>>;
+
+// An empty optional binds NULL.
+template <class T>
+inline constexpr bool is_query_param_v<std::optional<T>> = is_query_param_v<T>;
+
+template <class T>
+inline constexpr bool is_query_column_v =
+    is_sqlite_numeric_v<T> ||
+    is_any_of_v<T, std::string_view, std::string,
+                std::span<std::uint8_t const>, std::vector<std::uint8_t>>;
+
+template <class T>
+inline constexpr bool is_query_column_v<std::optional<T>> =
+    is_query_column_v<T>;
+
+// The owning counterpart of a column type, for rows that must outlive the
+// statement step they were read from.
+template <class T> struct owned_column {
+  using type = T;
+};
+template <> struct owned_column<std::string_view> {
+  using type = std::string;
+};
+template <> struct owned_column<std::span<std::uint8_t const>> {
+  using type = std::vector<std::uint8_t>;
+};
+template <class T> struct owned_column<std::optional<T>> {
+  using type = std::optional<typename owned_column<T>::type>;
+};
+template <class T> using owned_column_t = typename owned_column<T>::type;
+
+template <FixedString Sql, class ResultT = Result<>, class ParamsT = Params<>>
+struct Query;
+
+// A statement whose parameter and column types are fixed at compile time.
+// Binding and reading are generated per type, with no runtime dispatch and
+// no per-call null-handle checks. Columns read as views (std::string_view,
+// std::span) are only valid until the statement is stepped again.
+template <FixedString Sql, class... ColTs, class... ParamTs>
+struct Query<Sql, Result<ColTs...>, Params<ParamTs...>> {
+  static_assert(countPlaceholders(Sql.view()) >= 0,
+                "Query supports anonymous '?' placeholders only");
+  static_assert(countPlaceholders(Sql.view()) == sizeof...(ParamTs),
+                "Params<> must list one type per '?' placeholder");
+  static_assert((is_query_param_v<ParamTs> && ...),
+                "Unsupported parameter type: use int, int64_t, double, "
+                "nullptr_t, string(_view), span<const uint8_t>, "
+                "vector<uint8_t> or an optional of those");
+  static_assert((is_query_column_v<ColTs> && ...),
+                "Unsupported column type: use int, int64_t, double, "
+                "string(_view), span<const uint8_t>, vector<uint8_t> or an "
+                "optional of those");
+
+  using RowT = std::tuple<ColTs...>;
+  using OwnedRowT = std::tuple<owned_column_t<ColTs>...>;
+
+  static constexpr auto sql() noexcept -> std::string_view {
+    return Sql.view();
+  }
+
+  static constexpr std::size_t ParamCount = sizeof...(ParamTs);
+  static constexpr std::size_t ColumnCount = sizeof...(ColTs);
+
+  // IsStatic binds text and blobs without a copy; the arguments must then
+  // outlive the last step.
+  template <bool IsStatic = false>
+  static auto bind(sqlite3_stmt *Stmt,
+                   std::type_identity_t<ParamTs> const &...Args) noexcept
+      -> int {
+    return bindAll<IsStatic>(Stmt, std::index_sequence_for<ParamTs...>(),
+                             Args...);
+  }
+
+  // Binds without copying, steps once and resets. Arguments converted to
+  // ParamTs are temporaries of this call, so they outlive the step.
+  static auto execute(sqlite3_stmt *Stmt,
+                      std::type_identity_t<ParamTs> const &...Args) noexcept
+      -> int {
+    int E = bindAll<true>(Stmt, std::index_sequence_for<ParamTs...>(),
+                          Args...);
+    if (E == SQLITE_OK) [[likely]]
+      E = sqlite3_step(Stmt);
+    sqlite3_reset(Stmt);
+    sqlite3_clear_bindings(Stmt);
+    return E;
+  }
+
+  static auto read(sqlite3_stmt *Stmt) noexcept -> RowT {
+    return readAll(Stmt, std::index_sequence_for<ColTs...>());
+  }
+
+  static auto readOwned(sqlite3_stmt *Stmt) noexcept -> OwnedRowT {
+    return readAllOwned(Stmt, std::index_sequence_for<ColTs...>());
+  }
+
+private:
+  template <bool IsStatic, std::size_t... Is>
+  static auto bindAll(sqlite3_stmt *Stmt, std::index_sequence<Is...>,
+                      ParamTs const &...Args) noexcept -> int {
+    int E = SQLITE_OK;
+    (void)(... && ((E = bindOne<IsStatic>(Stmt, Is + 1, Args)) == SQLITE_OK));
+    return E;
+  }
+
+  template <bool IsStatic, class T>
+  static auto bindOne(sqlite3_stmt *Stmt, int Ind, T const &Arg) noexcept
+      -> int {
+    auto *Destructor = IsStatic ? SQLITE_STATIC : SQLITE_TRANSIENT;
+    if constexpr (std::is_same_v<T, int>)
+      return sqlite3_bind_int(Stmt, Ind, Arg);
+    else if constexpr (std::is_same_v<T, std::int64_t>)
+      return sqlite3_bind_int64(Stmt, Ind, Arg);
+    else if constexpr (std::is_same_v<T, double>)
+      return sqlite3_bind_double(Stmt, Ind, Arg);
+    else if constexpr (std::is_same_v<T, std::nullptr_t>)
+      return sqlite3_bind_null(Stmt, Ind);
+    else if constexpr (is_any_of_v<T, std::string_view, std::string>)
+      return sqlite3_bind_text64(Stmt, Ind, Arg.data(), Arg.size(),
+                                 Destructor, SQLITE_UTF8);
+    else if constexpr (is_any_of_v<T, std::span<std::uint8_t const>,
+                                   std::vector<std::uint8_t>>)
+      return sqlite3_bind_blob64(Stmt, Ind, Arg.data(), Arg.size(),
+                                 Destructor);
+    else
+      return Arg ? bindOne<IsStatic>(Stmt, Ind, *Arg)
+                 : sqlite3_bind_null(Stmt, Ind);
+  }
+
+  template <std::size_t... Is>
+  static auto readAll(sqlite3_stmt *Stmt, std::index_sequence<Is...>) noexcept
+      -> RowT {
+    return RowT{readOne<ColTs>(Stmt, Is)...};
+  }
+
+  template <std::size_t... Is>
+  static auto readAllOwned(sqlite3_stmt *Stmt,
+                           std::index_sequence<Is...>) noexcept -> OwnedRowT {
+    return OwnedRowT{readOne<owned_column_t<ColTs>>(Stmt, Is)...};
+  }
+
+  template <class T>
+  static auto readOne(sqlite3_stmt *Stmt, int Idx) noexcept -> T {
+    if constexpr (std::is_same_v<T, int>) {
+      return sqlite3_column_int(Stmt, Idx);
+    } else if constexpr (std::is_same_v<T, std::int64_t>) {
+      return sqlite3_column_int64(Stmt, Idx);
+    } else if constexpr (std::is_same_v<T, double>) {
+      return sqlite3_column_double(Stmt, Idx);
+    } else if constexpr (is_any_of_v<T, std::string_view, std::string>) {
+      auto const *Text = sqlite3_column_text(Stmt, Idx);
+      return T(reinterpret_cast<char const *>(Text),
+               Text ? sqlite3_column_bytes(Stmt, Idx) : 0);
+    } else if constexpr (is_any_of_v<T, std::span<std::uint8_t const>,
+                                     std::vector<std::uint8_t>>) {
+      auto const *Data =
+          static_cast<std::uint8_t const *>(sqlite3_column_blob(Stmt, Idx));
+      return T(Data, Data + (Data ? sqlite3_column_bytes(Stmt, Idx) : 0));
+    } else {
+      if (sqlite3_column_type(Stmt, Idx) == SQLITE_NULL)
+        return std::nullopt;
+      return readOne<typename T::value_type>(Stmt, Idx);
+    }
+  }
+};
+
+// Prepares every query in Qs... once, when the registry is created, and
+// keeps the statements for the lifetime of the connection so the hot path
+// never parses SQL. Each query is checked against the prepared statement's
+// parameter and column counts. The registry owns the Connection; like it,
+// it must be used by one thread at a time.
+template <class... Qs> struct QueryRegistry final {
+  QueryRegistry() noexcept = default;
+
+  QueryRegistry(QueryRegistry const &) = delete;
+  QueryRegistry &operator=(QueryRegistry const &) = delete;
+
+  QueryRegistry(QueryRegistry &&) noexcept = default;
+
+  QueryRegistry &operator=(QueryRegistry &&Other) noexcept {
+    if (this == &Other) [[unlikely]]
+      return *this;
+    // Statements must be finalized before their connection closes.
+    Statements = std::move(Other.Statements);
+    Conn = std::move(Other.Conn);
+    return *this;
+  }
+
+  auto connection() noexcept -> Connection & { return Conn; }
+
+  template <class Q> auto statement() noexcept -> Statement & {
+    static_assert((std::is_same_v<Q, Qs> || ...),
+                  "Query is not in this registry");
+    return Statements[IndexOf<Q>];
+  }
+
+  // Runs a statement that returns no rows.
+  template <class Q, class... Ts>
+  auto execute(Ts &&...Args) noexcept -> ExpectedT<void> {
+    int E = Q::execute(statement<Q>().nativeHandle(),
+                       std::forward<Ts>(Args)...);
+    if (E != SQLITE_DONE && E != SQLITE_ROW) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return {};
+  }
+
+  // First row, if any. Text and blob columns are copied out (views become
+  // std::string and std::vector), so the statement is reset before
+  // returning and holds no read transaction afterwards.
+  template <class Q, class... Ts>
+  auto fetchOne(Ts &&...Args) noexcept
+      -> ExpectedT<std::optional<typename Q::OwnedRowT>> {
+    auto *Stmt = statement<Q>().nativeHandle();
+    sqlite3_reset(Stmt);
+    int E = Q::template bind<false>(Stmt, std::forward<Ts>(Args)...);
+    if (E == SQLITE_OK) [[likely]]
+      E = sqlite3_step(Stmt);
+    std::optional<typename Q::OwnedRowT> Row;
+    if (E == SQLITE_ROW) [[likely]]
+      Row = Q::readOwned(Stmt);
+    sqlite3_reset(Stmt);
+    sqlite3_clear_bindings(Stmt);
+    if (E != SQLITE_DONE && E != SQLITE_ROW) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return Row;
+  }
+
+  // Parameters are bound eagerly (copied), so temporaries need not outlive
+  // the generator. At most one generator per query may be live at a time.
+  template <class Q, class... Ts>
+  auto fetch(Ts &&...Args) noexcept
+      -> Generator<ExpectedT<typename Q::RowT>> {
+    auto *Stmt = statement<Q>().nativeHandle();
+    sqlite3_reset(Stmt);
+    int E = Q::template bind<false>(Stmt, std::forward<Ts>(Args)...);
+    return readAll<Q>(Stmt, E);
+  }
+
+  template <class... Rs>
+  friend auto prepareAll(Connection &&Conn) noexcept
+      -> ExpectedT<QueryRegistry<Rs...>>;
+
+private:
+  template <class Q>
+  static constexpr std::size_t IndexOf = [] {
+    std::size_t I = 0;
+    (void)(... && (!std::is_same_v<Q, Qs> && ++I));
+    return I;
+  }();
+
+  template <class Q>
+  static auto readAll(sqlite3_stmt *Stmt, int E)
+      -> Generator<ExpectedT<typename Q::RowT>> {
+    while (E == SQLITE_OK || E == SQLITE_ROW) {
+      E = sqlite3_step(Stmt);
+      if (E == SQLITE_ROW) [[likely]]
+        co_yield Q::read(Stmt);
+    }
+    sqlite3_reset(Stmt);
+    if (E != SQLITE_DONE) [[unlikely]]
+      co_yield std::unexpected(sqlite3_errstr(E));
+  }
+
+  template <class Q>
+  static auto check(Statement &Stmt) noexcept -> ExpectedT<void> {
+    auto *Handle = Stmt.nativeHandle();
+    if (std::size_t(sqlite3_bind_parameter_count(Handle)) != Q::ParamCount)
+      [[unlikely]]
+      return std::unexpected("Query parameter count does not match the SQL");
+    if (std::size_t(sqlite3_column_count(Handle)) != Q::ColumnCount)
+      [[unlikely]]
+      return std::unexpected("Query result columns do not match the SQL");
+    return {};
+  }
+
+  Connection Conn;
+  // Declared after Conn so the statements are destroyed first.
+  std::array<Statement, sizeof...(Qs)> Statements;
+};
+
+template <class... Qs>
+auto prepareAll(Connection &&Conn) noexcept -> ExpectedT<QueryRegistry<Qs...>> {
+  QueryRegistry<Qs...> Registry;
+  Registry.Conn = std::move(Conn);
+  ExpectedT<void> E;
+  auto PrepareOne = [&]<class Q>(Statement &Slot) {
+    auto Stmt = Registry.Conn.prepare(Q::sql());
+    if (!Stmt) [[unlikely]] {
+      E = std::unexpected(Stmt.error());
+      return false;
+    }
+    Slot = std::move(*Stmt);
+    E = QueryRegistry<Qs...>::template check<Q>(Slot);
+    return E.has_value();
+  };
+  [&]<std::size_t... Is>(std::index_sequence<Is...>) {
+    (void)(... && PrepareOne.template operator()<Qs>(Registry.Statements[Is]));
+  }(std::index_sequence_for<Qs...>());
+  if (!E) [[unlikely]]
+    return std::unexpected(E.error());
+  return Registry;
+}
+
+} // namespace esqlite
+
+#endif // ESQLITE_QUERY_H
@@ -0,0 +1,278 @@
+#ifndef ESQLITE_SNAPSHOT_H
+#define ESQLITE_SNAPSHOT_H
+
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <sqlite3.h>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ESQLITE_HAS_MMAP 1
+#endif
+
+#include "esqlite.h"
+
+namespace esqlite {
+
+namespace detail {
+
+// Read-only view of a whole file: a private mapping where mmap is
+// available, a heap copy otherwise.
+struct MappedFile {
+  MappedFile() noexcept = default;
+  MappedFile(MappedFile const &) = delete;
+  auto operator=(MappedFile const &) -> MappedFile & = delete;
+
+  ~MappedFile() noexcept {
+#ifdef ESQLITE_HAS_MMAP
+    if (Mapped)
+      munmap(Data, Size);
+#endif
+  }
+
+  static auto open(std::string const &Path) noexcept
+      -> ExpectedT<std::shared_ptr<MappedFile>> {
+    auto File = std::make_shared<MappedFile>();
+#ifdef ESQLITE_HAS_MMAP
+    int Fd = ::open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (Fd < 0) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(SQLITE_CANTOPEN));
+    struct stat St;
+    if (fstat(Fd, &St) != 0) [[unlikely]] {
+      ::close(Fd);
+      return std::unexpected(sqlite3_errstr(SQLITE_IOERR));
+    }
+    File->Size = static_cast<std::size_t>(St.st_size);
+    if (File->Size) {
+      // Writable but private: patching the header touches one page of
+      // process memory and never the file.
+      void *P = mmap(nullptr, File->Size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE, Fd, 0);
+      if (P == MAP_FAILED) [[unlikely]] {
+        ::close(Fd);
+        return std::unexpected(sqlite3_errstr(SQLITE_IOERR_MMAP));
+      }
+      File->Data = static_cast<std::byte *>(P);
+      File->Mapped = true;
+    }
+    ::close(Fd);
+#else
+    std::ifstream In(Path, std::ios::binary | std::ios::ate);
+    if (!In) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(SQLITE_CANTOPEN));
+    File->Copy.resize(static_cast<std::size_t>(In.tellg()));
+    In.seekg(0);
+    if (!In.read(reinterpret_cast<char *>(File->Copy.data()),
+                 File->Copy.size())) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(SQLITE_IOERR_READ));
+    File->Data = File->Copy.data();
+    File->Size = File->Copy.size();
+#endif
+    return File;
+  }
+
+  auto bytes() noexcept -> std::span<std::byte> { return {Data, Size}; }
+
+  std::byte *Data{nullptr};
+  std::size_t Size{0};
+  bool Mapped{false};
+  std::vector<std::byte> Copy;
+};
+
+// Bytes 18 and 19 of the header are the file format write/read versions;
+// 2 means WAL. The in-memory VFS has no shared memory for a WAL index, so
+// an image marked WAL would fail to open.
+inline void clearWalMarker(std::span<std::byte> Image) noexcept {
+  if (Image.size() < 100)
+    return;
+  for (auto I : {18, 19})
+    if (Image[I] == std::byte{2})
+      Image[I] = std::byte{1};
+}
+
+// Writes Bytes to a new file at Path and flushes it to stable storage.
+inline auto writeDurably(std::filesystem::path const &Path,
+                         std::span<std::byte const> Bytes) noexcept -> bool {
+#ifdef ESQLITE_HAS_MMAP
+  int Fd = ::open(Path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (Fd < 0) [[unlikely]]
+    return false;
+  auto const *Data = reinterpret_cast<char const *>(Bytes.data());
+  auto Left = Bytes.size();
+  while (Left) {
+    auto Written = ::write(Fd, Data, Left);
+    if (Written < 0) [[unlikely]] {
+      if (errno == EINTR)
+        continue;
+      ::close(Fd);
+      return false;
+    }
+    Data += Written;
+    Left -= static_cast<std::size_t>(Written);
+  }
+  bool Synced = ::fsync(Fd) == 0;
+  return ::close(Fd) == 0 && Synced;
+#else
+  std::ofstream Out(Path, std::ios::binary | std::ios::trunc);
+  return Out.write(reinterpret_cast<char const *>(Bytes.data()),
+                   static_cast<std::streamsize>(Bytes.size())) &&
+         Out.flush();
+#endif
+}
+
+// Makes a rename within Directory durable. A no-op where directories
+// cannot be opened.
+inline auto syncDirectory(std::filesystem::path const &Directory) noexcept
+    -> bool {
+#ifdef ESQLITE_HAS_MMAP
+  auto Name = Directory.empty() ? std::filesystem::path(".") : Directory;
+  int Fd = ::open(Name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (Fd < 0) [[unlikely]]
+    return false;
+  bool Synced = ::fsync(Fd) == 0;
+  ::close(Fd);
+  return Synced;
+#else
+  (void)Directory;
+  return true;
+#endif
+}
+
+} // namespace detail
+
+// Opens a private in-memory copy of the database file at Path. Nothing is
+// read through the pager at query time and the file is not kept open, so
+// startup is one mapping and first queries do not wait on disk.
+//
+// With ReadOnly the image is used in place: SQLite reads straight from the
+// mapped file and pages are faulted in on first touch. Otherwise the file
+// is copied once into SQLite's heap and can be modified freely; changes
+// are never written back (use writeSnapshot() for that).
+//
+// The file must be a consistent image: a WAL-mode database with frames not
+// yet checkpointed into the main file is rejected.
+inline auto openInMemoryFrom(std::string_view Path,
+                             bool ReadOnly = true) noexcept
+    -> ExpectedT<Connection> {
+  std::error_code Ec;
+  auto Wal = std::filesystem::path(Path).concat("-wal");
+  if (std::filesystem::file_size(Wal, Ec) > 0 && !Ec) [[unlikely]]
+    return std::unexpected("The database has an unfinished WAL; checkpoint "
+                           "it before opening a snapshot");
+
+  auto File = detail::MappedFile::open(std::string(Path));
+  if (!File) [[unlikely]]
+    return std::unexpected(File.error());
+  auto Image = (*File)->bytes();
+  detail::clearWalMarker(Image);
+
+  int Flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+  auto Conn = open_v2(":memory:", Flags);
+  if (!Conn) [[unlikely]]
+    return Conn;
+  if (Image.empty())
+    return Conn;
+
+  auto E = ReadOnly ? Conn->deserializeBorrowed(Image, std::move(*File))
+                    : Conn->deserialize(Image);
+  if (!E) [[unlikely]]
+    return std::unexpected(E.error());
+  return Conn;
+}
+
+// Writes Conn's main database to Path as a standalone rollback-journal
+// file. The image is written and synced to a temporary file first, then
+// renamed over Path and the directory synced, so neither a reader nor a
+// crash ever leaves a partial snapshot at Path.
+inline auto writeSnapshot(Connection const &Conn,
+                          std::string_view Path) noexcept -> ExpectedT<void> {
+  auto Image = Conn.serialize();
+  if (!Image) [[unlikely]]
+    return std::unexpected(Image.error());
+  detail::clearWalMarker(
+      {reinterpret_cast<std::byte *>(Image->Data.get()), Image->Size});
+
+  auto Target = std::filesystem::path(Path);
+  auto Temporary = std::filesystem::path(Target).concat(".tmp");
+  auto Directory = Target.parent_path();
+  std::error_code Ec;
+  auto Fail = [&] {
+    std::filesystem::remove(Temporary, Ec);
+    return std::unexpected(sqlite3_errstr(SQLITE_IOERR_WRITE));
+  };
+
+  if (!detail::writeDurably(Temporary, Image->bytes())) [[unlikely]]
+    return Fail();
+  // The temporary's directory entry must be durable before it replaces
+  // Path, and the rename itself afterwards.
+  if (!detail::syncDirectory(Directory)) [[unlikely]]
+    return Fail();
+  std::filesystem::rename(Temporary, Target, Ec);
+  if (Ec) [[unlikely]]
+    return Fail();
+  if (!detail::syncDirectory(Directory)) [[unlikely]]
+    return std::unexpected(sqlite3_errstr(SQLITE_IOERR_FSYNC));
+  return {};
+}
+
+// A read-only snapshot that can be replaced while readers use it. Readers
+// take a reference with current() and keep it for as long as they query;
+// replace() publishes a new connection and the old image is released when
+// its last reader lets go.
+//
+// A Connection is not safe for concurrent use unless SQLite runs in
+// serialized mode, so readers sharing one snapshot must take turns or each
+// open their own.
+struct SnapshotHandle {
+  SnapshotHandle() noexcept = default;
+  explicit SnapshotHandle(Connection &&Conn) noexcept
+      : Current(std::make_shared<Connection>(std::move(Conn))) {}
+
+  auto current() const noexcept -> std::shared_ptr<Connection> {
+    std::lock_guard Lock(Mutex);
+    return Current;
+  }
+
+  void replace(Connection &&Conn) noexcept {
+    auto Next = std::make_shared<Connection>(std::move(Conn));
+    std::lock_guard Lock(Mutex);
+    Current.swap(Next);
+    // The previous connection is closed outside the lock, by whoever
+    // drops the last reference.
+  }
+
+  // Loads Path with openInMemoryFrom() and publishes it. On failure the
+  // current snapshot stays in place.
+  auto reload(std::string_view Path) noexcept -> ExpectedT<void> {
+    auto Conn = openInMemoryFrom(Path);
+    if (!Conn) [[unlikely]]
+      return std::unexpected(Conn.error());
+    replace(std::move(*Conn));
+    return {};
+  }
+
+private:
+  mutable std::mutex Mutex;
+  std::shared_ptr<Connection> Current;
+};
+
+} // namespace esqlite
+
+#endif // ESQLITE_SNAPSHOT_H
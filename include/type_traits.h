@@ -4,7 +4,13 @@
 #pragma once
 
 #include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
 #include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace esqlite {
 template <class T, class... Args>
@@ -15,6 +21,13 @@ struct any_type {
   template <typename T> constexpr operator T() { std::unreachable(); }
 };
 
+template <class T>
+inline constexpr bool is_tuple_like_v =
+    requires { std::tuple_size<std::remove_cvref_t<T>>::value; };
+
+// Dependent false for static_assert in discarded if-constexpr branches.
+template <class...> inline constexpr bool always_false_v = false;
+
 template <typename T, typename... Ts>
 inline constexpr bool is_any_of_v = (std::is_same_v<T, Ts> || ...);
 
@@ -93,14 +106,14 @@ static_assert(!is_any_of_v<int32_t, double, int64_t>);
 template <typename F, std::size_t... S>
 constexpr void staticFor(F &&Function, std::index_sequence<S...>) {
   int Unpack[] = {
-      0, void(Function(std::integral_constant<std::size_t, S>{}), 0)...};
+      0, (void(Function(std::integral_constant<std::size_t, S>{})), 0)...};
 
   (void)Unpack;
 }
 
 template <std::size_t iterations, typename F>
 constexpr void staticFor(F &&Function) {
-  static_for(std::forward<F>(Function), std::make_index_sequence<iterations>());
+  staticFor(std::forward<F>(Function), std::make_index_sequence<iterations>());
 }
 
 } // namespace esqlite
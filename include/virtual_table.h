@@ -0,0 +1,398 @@
+#ifndef ESQLITE_VIRTUAL_TABLE_H
+#define ESQLITE_VIRTUAL_TABLE_H
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "esqlite.h"
+
+namespace esqlite {
+
+struct VirtualTableOptions {
+  // Column names in field order; missing ones are named c0, c1, ...
+  std::vector<std::string> Columns;
+  // Column the rows are sorted on in ascending order, or -1. Equality and
+  // range constraints on it become a binary search, and ORDER BY on it
+  // needs no sort.
+  int SortedKey{-1};
+};
+
+// Exposes a contiguous range of T to SQL without copying, in the style of
+// the carray extension. T is either a single column (number or text) or an
+// aggregate whose fields, as seen by asRefTuple(), become the columns.
+//
+// The table is eponymous: after create(), Name can be queried directly and
+// shows the DefaultRows given at registration, or used as a table-valued
+// function over rows bound per statement:
+//
+//   SELECT * FROM Name(?)       -- with VirtualTable<T>::rows(Span)
+//
+// Rows are read in place on every step, so the memory must stay alive and
+// unchanged while a statement over it runs.
+template <class T> struct VirtualTable final {
+  static constexpr bool IsScalar = is_sqlite_numeric_v<T> || is_sqlite_text<T>;
+
+  static auto fields(T const &Row) noexcept {
+    if constexpr (IsScalar)
+      return std::tie(Row);
+    else
+      return asRefTuple(Row);
+  }
+
+  using FieldsT = decltype(fields(std::declval<T const &>()));
+  static constexpr int ColumnCount = int(std::tuple_size_v<FieldsT>);
+  static constexpr int SourceColumn = ColumnCount;
+
+  template <std::size_t I>
+  using ColumnT = std::remove_cvref_t<std::tuple_element_t<I, FieldsT>>;
+
+  // sqlite3_bind_pointer() type tag; unique per T.
+  static auto pointerType() noexcept -> char const * {
+    static std::string const Type =
+        std::string("esqlite::VirtualTable:") + typeid(T).name();
+    return Type.c_str();
+  }
+
+  // A parameter for the hidden table argument. Rows itself (not only the
+  // elements) must outlive the statement.
+  static auto rows(std::span<T const> &Rows) noexcept
+      -> NativePointer<std::span<T const>> {
+    return {&Rows, pointerType()};
+  }
+
+  static auto create(Connection &Conn, std::string_view Name,
+                     std::span<T const> DefaultRows = {},
+                     VirtualTableOptions Options = {}) noexcept
+      -> ExpectedT<void> {
+    if (Options.SortedKey >= ColumnCount) [[unlikely]]
+      return std::unexpected("SortedKey is not a column");
+
+    auto *Aux = new Module{DefaultRows, std::move(Options)};
+    auto ModuleName = std::string(Name);
+    // Frees Aux on failure too.
+    int E = sqlite3_create_module_v2(Conn.nativeHandle(), ModuleName.c_str(),
+                                     &methods(), Aux, &Module::destroy);
+    if (E != SQLITE_OK) [[unlikely]]
+      return std::unexpected(sqlite3_errstr(E));
+    return {};
+  }
+
+private:
+  struct Module {
+    std::span<T const> DefaultRows;
+    VirtualTableOptions Options;
+
+    static void destroy(void *P) noexcept { delete static_cast<Module *>(P); }
+  };
+
+  struct Table {
+    sqlite3_vtab Base;
+    Module *Aux;
+  };
+
+  struct Cursor {
+    sqlite3_vtab_cursor Base;
+    std::span<T const> Rows;
+    std::size_t Next{0};
+    std::size_t End{0};
+  };
+
+  // idxNum bits: which constraints xFilter receives, in argv order.
+  enum Plan : int {
+    HasSource = 1,
+    KeyEq = 2,
+    KeyLower = 4,
+    KeyUpper = 8,
+    LowerStrict = 16,
+    UpperStrict = 32,
+  };
+
+  static auto methods() noexcept -> sqlite3_module const & {
+    static sqlite3_module const Methods = [] {
+      sqlite3_module M{};
+      M.iVersion = 0;
+      // No xCreate: the table is eponymous-only.
+      M.xConnect = &connect;
+      M.xBestIndex = &bestIndex;
+      M.xDisconnect = &disconnect;
+      M.xOpen = &open;
+      M.xClose = &close;
+      M.xFilter = &filter;
+      M.xNext = &next;
+      M.xEof = &eof;
+      M.xColumn = &column;
+      M.xRowid = &rowid;
+      return M;
+    }();
+    return Methods;
+  }
+
+  template <std::size_t I> static constexpr auto declaredType() noexcept {
+    using C = ColumnT<I>;
+    if constexpr (std::is_same_v<C, double>)
+      return "REAL";
+    else if constexpr (is_sqlite_numeric_v<C>)
+      return "INTEGER";
+    else if constexpr (is_sqlite_text<C>)
+      return "TEXT";
+    else
+      return "BLOB";
+  }
+
+  static auto connect(sqlite3 *Db, void *Aux, int, char const *const *,
+                      sqlite3_vtab **Out, char **) noexcept -> int {
+    auto &M = *static_cast<Module *>(Aux);
+    std::string Schema = "CREATE TABLE x(";
+    staticFor<ColumnCount>([&](auto I) {
+      if (I < M.Options.Columns.size())
+        Schema += '"' + M.Options.Columns[I] + '"';
+      else
+        Schema += 'c' + std::to_string(I);
+      Schema += ' ';
+      Schema += declaredType<I>();
+      Schema += ", ";
+    });
+    Schema += "source HIDDEN)";
+
+    int E = sqlite3_declare_vtab(Db, Schema.c_str());
+    if (E != SQLITE_OK) [[unlikely]]
+      return E;
+    sqlite3_vtab_config(Db, SQLITE_VTAB_INNOCUOUS);
+    auto *Vtab = static_cast<Table *>(sqlite3_malloc(sizeof(Table)));
+    if (!Vtab) [[unlikely]]
+      return SQLITE_NOMEM;
+    *Vtab = {{}, &M};
+    *Out = &Vtab->Base;
+    return SQLITE_OK;
+  }
+
+  static auto disconnect(sqlite3_vtab *Vtab) noexcept -> int {
+    sqlite3_free(Vtab);
+    return SQLITE_OK;
+  }
+
+  static auto bestIndex(sqlite3_vtab *Vtab, sqlite3_index_info *Info) noexcept
+      -> int {
+    auto &M = *reinterpret_cast<Table *>(Vtab)->Aux;
+    int Key = M.Options.SortedKey;
+    int Source = -1, Eq = -1, Lower = -1, Upper = -1, Plan = 0;
+    for (int I = 0; I < Info->nConstraint; ++I) {
+      auto const &C = Info->aConstraint[I];
+      if (C.iColumn == SourceColumn && C.op == SQLITE_INDEX_CONSTRAINT_EQ) {
+        // Without the argument there is no table to read.
+        if (!C.usable)
+          return SQLITE_CONSTRAINT;
+        Source = I;
+      }
+      if (!C.usable || Key < 0 || C.iColumn != Key)
+        continue;
+      switch (C.op) {
+      case SQLITE_INDEX_CONSTRAINT_EQ:
+        Eq = I;
+        break;
+      case SQLITE_INDEX_CONSTRAINT_GT:
+      case SQLITE_INDEX_CONSTRAINT_GE:
+        Lower = I;
+        break;
+      case SQLITE_INDEX_CONSTRAINT_LT:
+      case SQLITE_INDEX_CONSTRAINT_LE:
+        Upper = I;
+        break;
+      }
+    }
+
+    // Key constraints are only used to narrow the scan; SQLite still
+    // checks them (omit stays 0), which keeps mixed-type comparisons right.
+    int Arg = 0;
+    auto Use = [&](int I, int Bit) {
+      Info->aConstraintUsage[I].argvIndex = ++Arg;
+      Plan |= Bit;
+    };
+    if (Source >= 0) {
+      Use(Source, HasSource);
+      Info->aConstraintUsage[Source].omit = 1;
+    }
+    double Rows = Source >= 0 ? 1000 : double(M.DefaultRows.size());
+    if (Eq >= 0) {
+      Use(Eq, KeyEq);
+      Info->estimatedRows = 1;
+      Info->estimatedCost = std::log2(Rows + 1) + 1;
+    } else {
+      double Estimate = Rows;
+      if (Lower >= 0) {
+        Use(Lower, KeyLower);
+        if (Info->aConstraint[Lower].op == SQLITE_INDEX_CONSTRAINT_GT)
+          Plan |= LowerStrict;
+        Estimate /= 2;
+      }
+      if (Upper >= 0) {
+        Use(Upper, KeyUpper);
+        if (Info->aConstraint[Upper].op == SQLITE_INDEX_CONSTRAINT_LT)
+          Plan |= UpperStrict;
+        Estimate /= 2;
+      }
+      Info->estimatedRows = std::int64_t(Estimate) + 1;
+      Info->estimatedCost = Estimate + 1;
+    }
+    Info->idxNum = Plan;
+
+    if (Key >= 0 && Info->nOrderBy == 1 &&
+        Info->aOrderBy[0].iColumn == Key && !Info->aOrderBy[0].desc)
+      Info->orderByConsumed = 1;
+    return SQLITE_OK;
+  }
+
+  static auto open(sqlite3_vtab *, sqlite3_vtab_cursor **Out) noexcept
+      -> int {
+    auto *C = static_cast<Cursor *>(sqlite3_malloc(sizeof(Cursor)));
+    if (!C) [[unlikely]]
+      return SQLITE_NOMEM;
+    *Out = &(new (C) Cursor{})->Base;
+    return SQLITE_OK;
+  }
+
+  static auto close(sqlite3_vtab_cursor *Cur) noexcept -> int {
+    sqlite3_free(Cur);
+    return SQLITE_OK;
+  }
+
+  // Reads V as the key type, or fails if a conversion could change the
+  // result of the comparison.
+  template <class K>
+  static auto keyValue(sqlite3_value *V, K &Out) noexcept -> bool {
+    int Type = sqlite3_value_numeric_type(V);
+    if constexpr (std::is_same_v<K, double>) {
+      if (Type != SQLITE_INTEGER && Type != SQLITE_FLOAT)
+        return false;
+    } else if constexpr (is_sqlite_numeric_v<K>) {
+      if (Type != SQLITE_INTEGER)
+        return false;
+      auto N = sqlite3_value_int64(V);
+      if (N != std::int64_t(K(N)))
+        return false;
+    } else if constexpr (is_sqlite_text<K>) {
+      if (Type != SQLITE_TEXT)
+        return false;
+    } else {
+      return false;
+    }
+    if constexpr (is_sqlite_text<K>)
+      Out = K(detail::readValue<std::string_view>(V));
+    else
+      Out = detail::readValue<K>(V);
+    return true;
+  }
+
+  template <std::size_t Key>
+  static void narrow(Cursor &C, int Plan, sqlite3_value **Argv) noexcept {
+    using K = ColumnT<Key>;
+    auto KeyOf = [](T const &Row) -> decltype(auto) {
+      return std::get<Key>(fields(Row));
+    };
+    auto First = C.Rows.begin(), Last = C.Rows.end();
+    int Arg = Plan & HasSource ? 1 : 0;
+    K Value{};
+    if (Plan & KeyEq) {
+      if (keyValue(Argv[Arg], Value)) {
+        First = std::ranges::lower_bound(First, Last, Value, {}, KeyOf);
+        Last = std::ranges::upper_bound(First, Last, Value, {}, KeyOf);
+      }
+    } else {
+      if (Plan & KeyLower) {
+        if (keyValue(Argv[Arg], Value))
+          First = Plan & LowerStrict
+                      ? std::ranges::upper_bound(First, Last, Value, {}, KeyOf)
+                      : std::ranges::lower_bound(First, Last, Value, {}, KeyOf);
+        ++Arg;
+      }
+      if (Plan & KeyUpper && keyValue(Argv[Arg], Value))
+        Last = Plan & UpperStrict
+                   ? std::ranges::lower_bound(First, Last, Value, {}, KeyOf)
+                   : std::ranges::upper_bound(First, Last, Value, {}, KeyOf);
+    }
+    C.Next = std::size_t(First - C.Rows.begin());
+    C.End = std::max(C.Next, std::size_t(Last - C.Rows.begin()));
+  }
+
+  static auto filter(sqlite3_vtab_cursor *Cur, int Plan, char const *, int,
+                     sqlite3_value **Argv) noexcept -> int {
+    auto &C = *reinterpret_cast<Cursor *>(Cur);
+    auto &M = *reinterpret_cast<Table *>(Cur->pVtab)->Aux;
+    C.Rows = M.DefaultRows;
+    if (Plan & HasSource) {
+      auto *Rows = static_cast<std::span<T const> *>(
+          sqlite3_value_pointer(Argv[0], pointerType()));
+      C.Rows = Rows ? *Rows : std::span<T const>();
+    }
+    C.Next = 0;
+    C.End = C.Rows.size();
+
+    if (Plan & (KeyEq | KeyLower | KeyUpper))
+      staticFor<ColumnCount>([&](auto Key) {
+        if (int(Key) == M.Options.SortedKey)
+          narrow<Key>(C, Plan, Argv);
+      });
+    return SQLITE_OK;
+  }
+
+  static auto next(sqlite3_vtab_cursor *Cur) noexcept -> int {
+    ++reinterpret_cast<Cursor *>(Cur)->Next;
+    return SQLITE_OK;
+  }
+
+  static auto eof(sqlite3_vtab_cursor *Cur) noexcept -> int {
+    auto &C = *reinterpret_cast<Cursor *>(Cur);
+    return C.Next >= C.End;
+  }
+
+  // Text and blobs are handed to SQLite as SQLITE_STATIC: no copy.
+  static auto column(sqlite3_vtab_cursor *Cur, sqlite3_context *Ctx,
+                     int Column) noexcept -> int {
+    auto &C = *reinterpret_cast<Cursor *>(Cur);
+    if (Column == SourceColumn) {
+      sqlite3_result_null(Ctx);
+      return SQLITE_OK;
+    }
+    auto Row = fields(C.Rows[C.Next]);
+    staticFor<ColumnCount>([&](auto I) {
+      if (int(I) != Column)
+        return;
+      auto const &Value = std::get<I>(Row);
+      using V = ColumnT<I>;
+      if constexpr (is_sqlite_text<V>)
+        sqlite3_result_text64(Ctx, Value.data(), Value.size(), SQLITE_STATIC,
+                              SQLITE_UTF8);
+      else if constexpr (is_sqlite_blob<V>)
+        sqlite3_result_blob64(Ctx, Value.data(), Value.size(), SQLITE_STATIC);
+      else
+        detail::setResult(Ctx, Value);
+    });
+    return SQLITE_OK;
+  }
+
+  static auto rowid(sqlite3_vtab_cursor *Cur, sqlite3_int64 *Out) noexcept
+      -> int {
+    *Out = sqlite3_int64(reinterpret_cast<Cursor *>(Cur)->Next);
+    return SQLITE_OK;
+  }
+};
+
+} // namespace esqlite
+
+#endif // ESQLITE_VIRTUAL_TABLE_H
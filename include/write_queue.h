@@ -0,0 +1,212 @@
+#ifndef ESQLITE_WRITE_QUEUE_H
+#define ESQLITE_WRITE_QUEUE_H
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "esqlite.h"
+
+namespace esqlite {
+
+struct WriteQueueOptions {
+  // A batch is committed once it holds MaxBatch writes or its oldest write
+  // has waited MaxLatency, whichever comes first.
+  std::size_t MaxBatch{256};
+  std::chrono::microseconds MaxLatency{2000};
+};
+
+struct WriteQueueStats {
+  std::uint64_t Batches{0};
+  std::uint64_t Writes{0};
+  std::uint64_t Failures{0};
+};
+
+// Group commit: owns the writer Connection and a background thread that
+// coalesces writes submitted from any thread into one transaction per batch.
+// Every write runs inside its own savepoint, so a failing write is rolled
+// back alone and only its submitter sees the error. A moved-from WriteQueue
+// may only be assigned to or destroyed.
+struct WriteQueue final {
+  WriteQueue() = delete;
+
+  explicit WriteQueue(Connection &&Writer,
+                      WriteQueueOptions Options = {}) noexcept
+      : S(std::make_unique<Shared>(std::move(Writer), Options)) {}
+
+  WriteQueue(WriteQueue const &) = delete;
+  WriteQueue &operator=(WriteQueue const &) = delete;
+
+  WriteQueue(WriteQueue &&) noexcept = default;
+  WriteQueue &operator=(WriteQueue &&) noexcept = default;
+
+  // Bind parameters are copied, so they need not outlive the call, and each
+  // work item runs once, so strings and vectors are then moved into the
+  // statement rather than copied again. Views (std::string_view, std::span)
+  // must stay valid until the future is ready.
+  template <class... Ts>
+  auto submit(std::string_view Sql, Ts &&...BindParams) noexcept
+      -> std::future<ExpectedT<void>> {
+    return S->push([Sql = std::string(Sql),
+                    Params = std::tuple<std::decay_t<Ts>...>(
+                        std::forward<Ts>(BindParams)...)](Connection &Conn) {
+      return std::apply(
+          [&](auto &...Ps) { return Conn.run(Sql, std::move(Ps)...); },
+          Params);
+    });
+  }
+
+  auto stats() const noexcept -> WriteQueueStats {
+    std::lock_guard Lock(S->Mutex);
+    return S->Stats;
+  }
+
+private:
+  using WorkT = std::move_only_function<ExpectedT<void>(Connection &)>;
+
+  struct Write {
+    WorkT Work;
+    std::promise<ExpectedT<void>> Done;
+    std::chrono::steady_clock::time_point Enqueued;
+  };
+
+  struct Shared {
+    Shared(Connection &&Writer, WriteQueueOptions Options) noexcept
+        : Conn(std::move(Writer)), Options(Options),
+          Thread([this] { loop(); }) {}
+
+    ~Shared() noexcept {
+      {
+        std::lock_guard Lock(Mutex);
+        Stopping = true;
+      }
+      Ready.notify_one();
+      Thread.join();
+    }
+
+    auto push(WorkT Work) noexcept -> std::future<ExpectedT<void>> {
+      std::promise<ExpectedT<void>> Done;
+      auto Result = Done.get_future();
+      bool Full;
+      {
+        std::lock_guard Lock(Mutex);
+        Pending.push_back({std::move(Work), std::move(Done),
+                           std::chrono::steady_clock::now()});
+        Full = Pending.size() == 1 || Pending.size() >= Options.MaxBatch;
+      }
+      if (Full)
+        Ready.notify_one();
+      return Result;
+    }
+
+    // Flushes everything still queued before exiting.
+    void loop() noexcept {
+      std::vector<Write> Batch;
+      std::unique_lock Lock(Mutex);
+      while (true) {
+        Ready.wait(Lock, [this] { return Stopping || !Pending.empty(); });
+        if (Pending.empty())
+          return;
+
+        auto Deadline = Pending.front().Enqueued + Options.MaxLatency;
+        Ready.wait_until(Lock, Deadline, [this] {
+          return Stopping || Pending.size() >= Options.MaxBatch;
+        });
+
+        auto Take = std::min(Pending.size(), std::max<std::size_t>(
+                                                 Options.MaxBatch, 1));
+        Batch.assign(std::make_move_iterator(Pending.begin()),
+                     std::make_move_iterator(Pending.begin() + Take));
+        Pending.erase(Pending.begin(), Pending.begin() + Take);
+
+        Lock.unlock();
+        auto Results = commit(Batch);
+        Lock.lock();
+
+        // Account for the batch before any submitter can observe it.
+        ++Stats.Batches;
+        Stats.Writes += Take;
+        Stats.Failures +=
+            std::ranges::count_if(Results, [](auto const &R) { return !R; });
+
+        Lock.unlock();
+        for (std::size_t I = 0; I < Batch.size(); ++I)
+          Batch[I].Done.set_value(Results[I]);
+        Batch.clear();
+        Lock.lock();
+      }
+    }
+
+    auto commit(std::vector<Write> &Batch) noexcept
+        -> std::vector<ExpectedT<void>> {
+      std::vector<ExpectedT<void>> Results;
+      Results.reserve(Batch.size());
+
+      auto FailAll = [&](std::string_view Error) {
+        Results.assign(Batch.size(), std::unexpected(Error));
+        return Results;
+      };
+
+      if (auto E = Conn.run("BEGIN IMMEDIATE"); !E) [[unlikely]]
+        return FailAll(E.error());
+
+      for (auto &W : Batch) {
+        auto Mark = Conn.changesMark();
+        if (auto E = Conn.run("SAVEPOINT esqlite_write"); !E) [[unlikely]] {
+          Results.push_back(std::unexpected(E.error()));
+          continue;
+        }
+        auto E = W.Work(Conn);
+        // SQLITE_FULL, SQLITE_IOERR and friends roll back the whole
+        // transaction, taking the earlier writes of the batch with it; the
+        // rest must not run in autocommit mode.
+        if (!E && sqlite3_get_autocommit(Conn.nativeHandle())) [[unlikely]]
+          return FailAll(E.error());
+        if (!E) [[unlikely]] {
+          (void)Conn.run("ROLLBACK TO esqlite_write");
+          Conn.discardChangesSince(Mark);
+        }
+        (void)Conn.run("RELEASE esqlite_write");
+        Results.push_back(E);
+      }
+
+      if (auto E = Conn.run("COMMIT"); !E) [[unlikely]] {
+        (void)Conn.run("ROLLBACK");
+        return FailAll(E.error());
+      }
+      return Results;
+    }
+
+    Connection Conn;
+    WriteQueueOptions Options;
+    mutable std::mutex Mutex;
+    std::condition_variable Ready;
+    std::deque<Write> Pending;
+    WriteQueueStats Stats;
+    bool Stopping{false};
+    std::thread Thread;
+  };
+
+private:
+  std::unique_ptr<Shared> S;
+};
+
+} // namespace esqlite
+
+#endif // ESQLITE_WRITE_QUEUE_H
@@ -1,8 +1,25 @@
+#include "async.h"
+#include "bulk_io.h"
+#include "checkpointer.h"
 #include "esqlite.h"
+#include "memory_config.h"
+#include "open_options.h"
+#include "parallel_scan.h"
+#include "pool.h"
+#include "profiler.h"
+#include "query.h"
+#include "snapshot.h"
+#include "virtual_table.h"
+#include "write_queue.h"
 
 #include <gtest/gtest.h>
 
+#include <chrono>
 #include <filesystem>
+#include <fstream>
+#include <future>
+#include <numeric>
+#include <thread>
 
 using namespace esqlite;
 
@@ -94,3 +111,1566 @@ TEST(correctness_simple, read_generator_iterable) {
 
   ASSERT_EQ(First, End);
 }
+
+TEST(correctness_simple, statement_cache_reuse) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (n1 INT)"));
+  for (int I = 0; I < 10; ++I)
+    ASSERT_EXPECTED(Conn->run("INSERT INTO KEK (n1) VALUES (?)", I));
+
+  auto Stats = Conn->statementCacheStats();
+  ASSERT_EQ(Stats.Misses, 2u);
+  ASSERT_EQ(Stats.Hits, 9u);
+  ASSERT_EQ(Stats.Evictions, 0u);
+
+  int Sum = 0;
+  for (int I = 0; I < 3; ++I)
+    for (auto &&Row : Conn->runReading<int>("SELECT n1 FROM KEK WHERE n1 >= ?",
+                                            5)) {
+      ASSERT_EXPECTED(Row);
+      Sum += std::get<0>(*Row);
+    }
+  ASSERT_EQ(Sum, 3 * (5 + 6 + 7 + 8 + 9));
+  ASSERT_EQ(Conn->statementCacheStats().Hits, 11u);
+}
+
+TEST(correctness_simple, statement_cache_eviction) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_EXPECTED(Conn);
+  Conn->setStatementCacheCapacity(1);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (n1 INT)"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK (n1) VALUES (1), (2)"));
+
+  // Nested reads of the same SQL must not share one statement.
+  int Pairs = 0;
+  for (auto &&Outer : Conn->runReading<int>("SELECT n1 FROM KEK")) {
+    ASSERT_EXPECTED(Outer);
+    for (auto &&Inner : Conn->runReading<int>("SELECT n1 FROM KEK")) {
+      ASSERT_EXPECTED(Inner);
+      ++Pairs;
+    }
+  }
+  ASSERT_EQ(Pairs, 4);
+  for (auto &&Row : Conn->runReading<int>("SELECT n1 FROM KEK"))
+    ASSERT_EXPECTED(Row);
+
+  auto Stats = Conn->statementCacheStats();
+  ASSERT_EQ(Stats.Evictions, 2u);
+  ASSERT_EQ(Stats.Hits, 1u);
+}
+
+TEST(correctness_simple, statement_cache_lease_outlives_connection) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_EXPECTED(Conn);
+  auto Lease = Conn->prepareCached("SELECT 1");
+  ASSERT_EXPECTED(Lease);
+
+  // The lease survives the connection moving, and then closing: the
+  // database is closed once the lease is gone.
+  {
+    auto Moved = std::move(*Conn);
+    ASSERT_EQ(*(*Lease)->step(), Statement::StepOk::STEP_ROW);
+    ASSERT_EXPECTED((*Lease)->reset());
+    ASSERT_EQ(Moved.statementCacheStats().Misses, 1u);
+  }
+  ASSERT_EQ(*(*Lease)->step(), Statement::StepOk::STEP_ROW);
+  *Lease = CachedStatement();
+  ASSERT_FALSE(Conn->prepareCached("SELECT 1"));
+}
+
+struct IdName {
+  int Id;
+  std::string Name;
+};
+
+TEST(correctness_simple, insert_many) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(
+      Conn->run("CREATE TABLE KEK (id INT PRIMARY KEY, name TEXT NOT NULL)"));
+
+  std::vector<IdName> Pods;
+  for (int I = 0; I < 100; ++I)
+    Pods.push_back({I, "pod" + std::to_string(I)});
+  auto Result = Conn->insertMany("INSERT INTO KEK VALUES (?, ?)", Pods, 16);
+  ASSERT_TRUE(Result) << Result.Error;
+  ASSERT_EQ(Result.Written, 100u);
+
+  std::vector<std::tuple<int, std::string_view>> Tuples = {
+      {100, "a"}, {101, "b"}, {5, "duplicate"}, {102, "c"}};
+  Result = Conn->insertMany("INSERT INTO KEK VALUES (?, ?)", Tuples, 2);
+  ASSERT_FALSE(Result);
+  ASSERT_EQ(Result.Written, 2u);
+  ASSERT_EQ(Result.FailedAt, 2u);
+
+  for (auto &&Row : Conn->runReading<int>("SELECT count(*) FROM KEK")) {
+    ASSERT_EXPECTED(Row);
+    ASSERT_EQ(std::get<0>(*Row), 102);
+  }
+}
+
+TEST(correctness_pool, concurrent_reads) {
+  for (auto const *Suffix : {"", "-wal", "-shm"})
+    std::filesystem::remove(std::string("pool.sqlite") + Suffix);
+
+  auto Threads = std::max(2u, std::thread::hardware_concurrency());
+  auto P = openPool("pool.sqlite", {.Readers = Threads});
+  ASSERT_EXPECTED(P);
+  {
+    auto Writer = P->acquireWrite();
+    ASSERT_EXPECTED(Writer->run("CREATE TABLE KEK (n1 INT)"));
+    std::vector<std::tuple<int>> Rows;
+    for (int I = 0; I < 1000; ++I)
+      Rows.emplace_back(I);
+    ASSERT_TRUE(Writer->insertMany("INSERT INTO KEK VALUES (?)", Rows));
+  }
+
+  // Reads per second with 1 and with Threads workers. The ratio is reported
+  // rather than asserted, since it depends on the machine running the test.
+  auto Measure = [&](unsigned Workers) {
+    std::atomic<bool> Ok = true;
+    std::vector<std::jthread> Jobs;
+    auto Start = std::chrono::steady_clock::now();
+    for (unsigned W = 0; W < Workers; ++W)
+      Jobs.emplace_back([&] {
+        for (int I = 0; I < 200; ++I) {
+          auto Reader = P->acquireRead();
+          for (auto &&Row :
+               Reader->runReading<int>("SELECT sum(n1) FROM KEK"))
+            if (!Row || std::get<0>(*Row) != 499500)
+              Ok = false;
+        }
+      });
+    Jobs.clear();
+    EXPECT_TRUE(Ok);
+    std::chrono::duration<double> Took =
+        std::chrono::steady_clock::now() - Start;
+    return Workers * 200 / Took.count();
+  };
+  auto Single = Measure(1);
+  auto Multi = Measure(Threads);
+  RecordProperty("read_scaling", std::to_string(Multi / Single));
+
+  auto Stats = P->stats();
+  ASSERT_EQ(Stats.InUse, 0u);
+  ASSERT_EQ(Stats.Acquisitions, 1 + 200 * (1 + Threads));
+  ASSERT_GT(Stats.utilisation(), 0.0);
+}
+
+TEST(correctness_pool, fail_fast_when_exhausted) {
+  auto P = openPool("pool.sqlite", {.Readers = 1});
+  ASSERT_EXPECTED(P);
+  auto Held = P->tryAcquireRead();
+  ASSERT_EXPECTED(Held);
+  ASSERT_FALSE(P->tryAcquireRead());
+  ASSERT_EQ(P->stats().Rejections, 1u);
+
+  std::jthread Waiter([&] { auto Reader = P->acquireRead(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  Held->release();
+  Waiter.join();
+  ASSERT_EQ(P->stats().InUse, 0u);
+
+  ASSERT_FALSE(openPool(":memory:", {}));
+}
+
+TEST(correctness_simple, read_batched_columns) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (n1 INT, n2 REAL, str TEXT)"));
+  std::vector<std::tuple<int, double, std::string>> Rows;
+  for (int I = 0; I < 10; ++I)
+    Rows.emplace_back(I, I * 0.5, std::string(I, 'x'));
+  ASSERT_TRUE(Conn->insertMany("INSERT INTO KEK VALUES (?, ?, ?)", Rows));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (NULL, NULL, NULL)"));
+
+  std::size_t Seen = 0;
+  std::vector<std::size_t> Sizes;
+  for (auto &&Batch :
+       Conn->runReadingBatched<std::int64_t, double, std::string_view>(
+           "SELECT * FROM KEK ORDER BY rowid", 4)) {
+    ASSERT_EXPECTED(Batch);
+    Sizes.push_back(Batch->Rows);
+    auto N1 = Batch->column<0>();
+    auto N2 = Batch->column<1>();
+    auto Str = Batch->column<2>();
+    ASSERT_EQ(N1.Values.size(), Batch->Rows);
+    for (std::size_t R = 0; R < Batch->Rows; ++R, ++Seen) {
+      if (Seen == Rows.size()) {
+        ASSERT_TRUE(N1.Nulls.isNull(R));
+        ASSERT_TRUE(N2.Nulls.isNull(R));
+        ASSERT_TRUE(Str.Nulls.isNull(R));
+        continue;
+      }
+      ASSERT_FALSE(N1.Nulls.isNull(R));
+      ASSERT_EQ(N1[R], std::get<0>(Rows[Seen]));
+      ASSERT_EQ(N2[R], std::get<1>(Rows[Seen]));
+      ASSERT_EQ(Str[R], std::get<2>(Rows[Seen]));
+    }
+  }
+  ASSERT_EQ(Seen, 11u);
+  ASSERT_EQ(Sizes, (std::vector<std::size_t>{4, 4, 3}));
+
+  int Batches = 0;
+  for (auto &&Batch : Conn->runReadingBatched<int>("SELECT n1 FROM KEK", 0)) {
+    ASSERT_FALSE(Batch);
+    ++Batches;
+  }
+  ASSERT_EQ(Batches, 1);
+}
+
+TEST(correctness_simple, statement_counters) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (n1 INT)"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (3), (1), (2)"));
+  auto Stmt = Conn->prepare("SELECT n1 FROM KEK ORDER BY n1");
+  ASSERT_EXPECTED(Stmt);
+  while (*Stmt->step() == Statement::StepOk::STEP_ROW)
+    ;
+  auto Counters = Stmt->counters(/*Reset=*/true);
+  ASSERT_EQ(Counters.FullscanSteps, 2);
+  ASSERT_EQ(Counters.Sorts, 1);
+  ASSERT_GT(Counters.VmSteps, 0);
+  ASSERT_EQ(Stmt->counters().Sorts, 0);
+}
+
+TEST(correctness_simple, profiler_aggregates_normalized_sql) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_EXPECTED(Conn);
+  Profiler Prof;
+  Prof.attach(*Conn);
+  Prof.attach(*Conn);
+  std::vector<SlowQuery> Slow;
+  Prof.setSlowQueryHook(std::chrono::nanoseconds(0), [&](SlowQuery const &Q) {
+    if (Q.Sql.starts_with("SELECT"))
+      Slow.push_back({{}, Q.Elapsed, Q.Plan});
+  });
+
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (n1 INT, str TEXT)"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (1, 'a'), (2, 'b')"));
+  for (int I = 0; I < 3; ++I)
+    for (auto &&Row :
+         Conn->runReading<int>("SELECT n1 FROM KEK WHERE n1 > ?", I))
+      ASSERT_EXPECTED(Row);
+  for (auto &&Row : Conn->runReading<int>("SELECT  n1 FROM KEK WHERE n1 > 0"))
+    ASSERT_EXPECTED(Row);
+
+  ASSERT_EQ(Profiler::normalize("SELECT  n1 FROM t1 WHERE s = 'it''s' AND "
+                                "n > 1.5"),
+            "SELECT n1 FROM t1 WHERE s = ? AND n > ?");
+
+  auto Profiles = Prof.snapshot();
+  auto It = std::ranges::find(Profiles, "SELECT n1 FROM KEK WHERE n1 > ?",
+                              &QueryProfile::Sql);
+  ASSERT_NE(It, Profiles.end());
+  ASSERT_EQ(It->Count, 4u);
+  ASSERT_EQ(It->Rows, 2u + 1u + 0u + 2u);
+  ASSERT_GT(It->FullscanSteps, 0u);
+  ASSERT_EQ(It->Latency.count(), 4u);
+  ASSERT_LE(It->Latency.percentile(0.5), It->Latency.percentile(0.99));
+
+  // Profiling leaves the statement's own counters running.
+  auto Cached = Conn->prepareCached("SELECT n1 FROM KEK WHERE n1 > ?");
+  ASSERT_EXPECTED(Cached);
+  auto Counters = (*Cached)->counters();
+  ASSERT_EQ(Counters.Runs, 3);
+  ASSERT_GT(Counters.FullscanSteps, 0);
+
+  ASSERT_EQ(Slow.size(), 4u);
+  ASSERT_FALSE(Slow.front().Plan.empty());
+  ASSERT_TRUE(Slow.front().Plan.front().starts_with("SCAN"));
+  ASSERT_TRUE(std::ranges::none_of(Profiles, [](QueryProfile const &P) {
+    return P.Sql.starts_with("EXPLAIN");
+  }));
+
+  Prof.detach(*Conn);
+  ASSERT_EXPECTED(Conn->run("DELETE FROM KEK"));
+  ASSERT_EQ(Prof.snapshot().size(), Profiles.size());
+}
+
+TEST(correctness_simple, memory_configuration) {
+  // Process-wide settings: applied between sqlite3_shutdown() calls and
+  // restored afterwards so other tests keep the default allocator.
+  ASSERT_EQ(sqlite3_initialize(), SQLITE_OK);
+  ASSERT_FALSE(configure({.UsePoolAllocator = true}));
+  ASSERT_EQ(sqlite3_shutdown(), SQLITE_OK);
+  sqlite3_mem_methods Default;
+  ASSERT_EQ(sqlite3_config(SQLITE_CONFIG_GETMALLOC, &Default), SQLITE_OK);
+  ASSERT_EXPECTED(configure({.UsePoolAllocator = true,
+                             .PageCacheSlots = 64}));
+  {
+    auto Conn =
+        open_v2(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    ASSERT_EXPECTED(Conn);
+    ASSERT_EXPECTED(Conn->setLookaside(128, 64));
+    ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (n1 INT, str TEXT)"));
+    std::vector<std::tuple<int, std::string>> Rows;
+    for (int I = 0; I < 1000; ++I)
+      Rows.emplace_back(I, std::string(I % 100, 'x'));
+    ASSERT_TRUE(Conn->insertMany("INSERT INTO KEK VALUES (?, ?)", Rows));
+
+    ASSERT_GT(memoryUsed(), 0);
+    auto Stats = Conn->memoryStats();
+    ASSERT_GT(Stats.CacheUsed, 0);
+    if (!sqlite3_compileoption_used("OMIT_LOOKASIDE")) {
+      ASSERT_GT(Stats.LookasideHit, 0);
+    }
+    ASSERT_EXPECTED(Conn->releaseMemory());
+  }
+  auto Pool = PoolAllocator::stats();
+  ASSERT_GT(Pool.Mallocs, 0u);
+  ASSERT_GT(Pool.ArenaBytes, 0u);
+
+  // Turning the pool off reinstalls the allocator it replaced.
+  ASSERT_EQ(sqlite3_shutdown(), SQLITE_OK);
+  ASSERT_EXPECTED(configure({}));
+  sqlite3_mem_methods Restored;
+  ASSERT_EQ(sqlite3_config(SQLITE_CONFIG_GETMALLOC, &Restored), SQLITE_OK);
+  ASSERT_EQ(Restored.xMalloc, Default.xMalloc);
+  ASSERT_EQ(Restored.xFree, Default.xFree);
+}
+
+TEST(correctness_simple, incremental_blob_io) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (id INTEGER PRIMARY KEY, b)"));
+
+  constexpr std::size_t Size = 1 << 20;
+  {
+    std::ofstream Out("blob.bin", std::ios::binary);
+    for (std::size_t I = 0; I < Size; ++I)
+      Out.put(static_cast<char>(I * 7));
+  }
+
+  for (int Id = 1; Id <= 3; ++Id) {
+    auto Insert = Conn->prepareCached("INSERT INTO KEK VALUES (?, ?)");
+    ASSERT_EXPECTED(Insert);
+    ASSERT_EXPECTED((*Insert)->bindParam(1, Id));
+    ASSERT_EXPECTED((*Insert)->bindZeroBlob(2, Size));
+    ASSERT_EXPECTED_V((*Insert)->step(), Statement::StepOk::STEP_DONE);
+  }
+
+  std::vector<std::uint8_t> Buffer(64 << 10);
+  auto B = Conn->openBlob("KEK", "b", 1, /*Writable=*/true);
+  ASSERT_EXPECTED(B);
+  ASSERT_EQ(B->size(), Size);
+  for (int Id = 1; Id <= 3; ++Id) {
+    if (Id > 1)
+      ASSERT_EXPECTED(B->reopen(Id));
+    std::ifstream In("blob.bin", std::ios::binary);
+    auto Written = B->writeChunks(Buffer, [&](std::span<std::uint8_t> Chunk) {
+      In.read(reinterpret_cast<char *>(Chunk.data()), Chunk.size());
+      return static_cast<std::size_t>(In.gcount());
+    });
+    ASSERT_EXPECTED_V(Written, Size);
+  }
+
+  std::size_t Offset = 0;
+  bool Matches = true;
+  ASSERT_EXPECTED(B->readChunks(Buffer, [&](std::span<std::uint8_t const> C) {
+    for (auto Byte : C)
+      Matches &= Byte == static_cast<std::uint8_t>(Offset++ * 7);
+  }));
+  ASSERT_EQ(Offset, Size);
+  ASSERT_TRUE(Matches);
+  ASSERT_FALSE(B->write(std::vector<std::uint8_t>(16), Size - 8));
+  ASSERT_FALSE(Conn->openBlob("KEK", "b", 42, false));
+  std::filesystem::remove("blob.bin");
+}
+
+struct Tracked {
+  static inline int Alive = 0;
+  int Value;
+  explicit Tracked(int V) : Value(V) { ++Alive; }
+  ~Tracked() { --Alive; }
+};
+
+TEST(correctness_simple, zero_copy_binding) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (t TEXT, b BLOB)"));
+
+  std::string Big(1 << 20, 'x');
+  std::vector<std::uint8_t> Bytes(4096, 0xAB);
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (?, ?)", std::move(Big),
+                            std::move(Bytes)));
+
+  std::string Caller = "borrowed";
+  std::vector<char> CallerBytes = {'a', 'b'};
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (?, ?)",
+                            borrowed(Caller), borrowed(CallerBytes)));
+
+  std::vector<std::pair<std::int64_t, std::int64_t>> Sizes;
+  for (auto &&Row : Conn->runReading<std::int64_t, std::int64_t>(
+           "SELECT length(t), length(b) FROM KEK ORDER BY rowid")) {
+    ASSERT_EXPECTED(Row);
+    Sizes.emplace_back(std::get<0>(*Row), std::get<1>(*Row));
+  }
+  ASSERT_EQ(Sizes.size(), 2);
+  ASSERT_EQ(Sizes[0], std::make_pair(std::int64_t(1 << 20), 4096l));
+  ASSERT_EQ(Sizes[1], std::make_pair(8l, 2l));
+
+  // A native object only visible to functions asking for its type name.
+  sqlite3_create_function(
+      Conn->nativeHandle(), "tracked_value", 1, SQLITE_UTF8, nullptr,
+      [](sqlite3_context *Ctx, int, sqlite3_value **Args) {
+        auto *T = static_cast<Tracked *>(
+            sqlite3_value_pointer(Args[0], "esqlite_tracked"));
+        sqlite3_result_int(Ctx, T ? T->Value : -1);
+      },
+      nullptr, nullptr);
+  {
+    auto Stmt = Conn->prepare("SELECT tracked_value(?)");
+    ASSERT_EXPECTED(Stmt);
+    ASSERT_EXPECTED(Stmt->bindPointer(1, std::make_unique<Tracked>(42),
+                                      "esqlite_tracked"));
+    ASSERT_EQ(Tracked::Alive, 1);
+    ASSERT_EXPECTED_V(Stmt->step(), Statement::StepOk::STEP_ROW);
+    int Value = 0;
+    ASSERT_EXPECTED(Stmt->readNumeric(0, Value));
+    ASSERT_EQ(Value, 42);
+    ASSERT_EXPECTED(Stmt->reset());
+    ASSERT_EXPECTED(Stmt->clearBindings());
+    ASSERT_EQ(Tracked::Alive, 0);
+  }
+}
+
+using AddUser = Query<"INSERT INTO users VALUES (?, ?)", Result<>,
+                      Params<std::int64_t, std::optional<std::string_view>>>;
+// Owning parameter: a string literal is converted to a temporary.
+using AddUserCopy = Query<"INSERT INTO users VALUES (?, ?)", Result<>,
+                          Params<std::int64_t, std::string>>;
+using UserName = Query<"SELECT name FROM users WHERE id = ?",
+                       Result<std::optional<std::string>>,
+                       Params<std::int64_t>>;
+using UsersAbove = Query<"SELECT id, name FROM users WHERE id > ? ORDER BY id",
+                         Result<std::int64_t, std::string_view>,
+                         Params<std::int64_t>>;
+
+static_assert(AddUser::ParamCount == 2 && UsersAbove::ColumnCount == 2);
+
+TEST(correctness_simple, typed_queries) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE users (id INTEGER, name TEXT)"));
+
+  auto Db = prepareAll<AddUser, AddUserCopy, UserName, UsersAbove>(
+      std::move(*Conn));
+  ASSERT_EXPECTED(Db);
+  ASSERT_EXPECTED(Db->execute<AddUser>(1, "alice"));
+  ASSERT_EXPECTED(Db->execute<AddUser>(2, std::string("bob")));
+  ASSERT_EXPECTED(Db->execute<AddUser>(3, std::nullopt));
+
+  auto Name = Db->fetchOne<UserName>(2);
+  ASSERT_EXPECTED(Name);
+  ASSERT_TRUE(*Name);
+  ASSERT_EQ(std::get<0>(**Name), "bob");
+  auto Missing = Db->fetchOne<UserName>(3);
+  ASSERT_EXPECTED(Missing);
+  ASSERT_EQ(std::get<0>(**Missing), std::nullopt);
+  auto None = Db->fetchOne<UserName>(42);
+  ASSERT_EXPECTED(None);
+  ASSERT_FALSE(*None);
+
+  ASSERT_EXPECTED(Db->execute<AddUserCopy>(
+      5, "a name long enough to live on the heap, not inline"));
+  auto Long = Db->fetchOne<UserName>(5);
+  ASSERT_EXPECTED(Long);
+  ASSERT_EQ(std::get<0>(**Long),
+            "a name long enough to live on the heap, not inline");
+  // The row is owned, so the statement no longer holds a read transaction.
+  ASSERT_EQ(sqlite3_stmt_busy(Db->statement<UserName>().nativeHandle()), 0);
+
+  std::vector<std::int64_t> Ids;
+  for (auto &&Row : Db->fetch<UsersAbove>(1)) {
+    ASSERT_EXPECTED(Row);
+    Ids.push_back(std::get<0>(*Row));
+  }
+  ASSERT_EQ(Ids, (std::vector<std::int64_t>{2, 3, 5}));
+
+  // Column count is checked against the prepared statement.
+  using Mismatch = Query<"SELECT id, name FROM users", Result<std::int64_t>>;
+  auto Other = open_v2(":memory:", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_EXPECTED(Other);
+  ASSERT_EXPECTED(Other->run("CREATE TABLE users (id INTEGER, name TEXT)"));
+  ASSERT_FALSE(prepareAll<Mismatch>(std::move(*Other)));
+}
+
+TEST(correctness_simple, open_options_profiles) {
+  std::filesystem::remove("options.sqlite");
+  std::filesystem::remove("options.sqlite-wal");
+  std::filesystem::remove("options.sqlite-shm");
+
+  auto Pragma = [](Connection &Conn, std::string_view Sql) {
+    std::string Value;
+    for (auto &&Row : Conn.runReading<std::string_view>(Sql))
+      Value = std::get<0>(*Row);
+    return Value;
+  };
+
+  {
+    auto Conn = open("options.sqlite", ReadHeavy);
+    ASSERT_EXPECTED(Conn);
+    ASSERT_EQ(Pragma(*Conn, "PRAGMA journal_mode"), "wal");
+    ASSERT_EQ(Pragma(*Conn, "PRAGMA synchronous"), "1");
+    ASSERT_EQ(Pragma(*Conn, "PRAGMA busy_timeout"), "5000");
+    ASSERT_EQ(sqlite3_db_mutex(Conn->nativeHandle()), nullptr);
+    ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (a)"));
+  }
+
+  OpenOptions Serialized{.Mutex = Threading::Serialized,
+                         .Sync = Synchronous::Full};
+  auto Conn = open("options.sqlite", Serialized);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_NE(sqlite3_db_mutex(Conn->nativeHandle()), nullptr);
+  ASSERT_EQ(Pragma(*Conn, "PRAGMA synchronous"), "2");
+
+  // Settings SQLite ignores fail the open instead of being dropped.
+  ASSERT_FALSE(open("options.sqlite", OpenOptions{.PageSize = 8192}));
+  ASSERT_FALSE(open(":memory:", WriteHeavy));
+  ASSERT_EXPECTED(open(":memory:", Ephemeral));
+  ASSERT_EXPECTED(open(":memory:", BulkLoad));
+}
+
+TEST(correctness_simple, parallel_scan) {
+  std::filesystem::remove("scan.sqlite");
+  auto Conn = open("scan.sqlite", WriteHeavy);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (id INTEGER PRIMARY KEY, v)"));
+  // Skewed keys: a dense block plus a few far-away outliers.
+  ASSERT_EXPECTED(Conn->run(
+      "WITH RECURSIVE Seq(n) AS (SELECT 1 UNION ALL SELECT n + 1 FROM Seq "
+      "WHERE n < 20000) INSERT INTO KEK SELECT n, n % 7 FROM Seq"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (1000000, 3), "
+                            "(5000000, 3), (9000000, 3)"));
+
+  std::int64_t Expected = 0;
+  for (auto &&Row : Conn->runReading<std::int64_t>(
+           "SELECT sum(id) FROM KEK WHERE v = 3"))
+    Expected = std::get<0>(*Row);
+
+  constexpr std::size_t Threads = 4;
+  std::array<std::int64_t, Threads> Sums{};
+  auto Stats = parallelScan<std::int64_t>(
+      *Conn, "KEK",
+      {.Columns = "id", .Predicate = "v = 3", .Threads = Threads},
+      [&](std::size_t Worker, std::tuple<std::int64_t> &Row) {
+        Sums[Worker] += std::get<0>(Row);
+      });
+  ASSERT_EXPECTED(Stats);
+  ASSERT_EQ(Stats->Threads, Threads);
+  ASSERT_EQ(Stats->Shards, Threads * ScanOptions().ShardsPerThread);
+  ASSERT_EQ(Stats->Rows, 20000 / 7 + 3);
+  ASSERT_EQ(std::accumulate(Sums.begin(), Sums.end(), std::int64_t(0)),
+            Expected);
+
+  ASSERT_EXPECTED(Conn->run("DELETE FROM KEK"));
+  auto Empty = parallelScan<std::int64_t>(*Conn, "KEK", {.Columns = "id"},
+                                          [](std::size_t, auto &) {});
+  ASSERT_EXPECTED(Empty);
+  ASSERT_EQ(Empty->Rows, 0);
+
+  // Keys at both ends of the int64 range.
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (-9223372036854775808, "
+                            "0), (0, 0), (9223372036854775807, 0)"));
+  auto Extremes = parallelScan<std::int64_t>(
+      *Conn, "KEK", {.Columns = "id", .Threads = Threads},
+      [](std::size_t, auto &) {});
+  ASSERT_EXPECTED(Extremes);
+  ASSERT_EQ(Extremes->Rows, 3);
+
+  auto Memory = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Memory);
+  ASSERT_FALSE(parallelScan<std::int64_t>(*Memory, "KEK", {},
+                                          [](std::size_t, auto &) {}));
+}
+
+TEST(correctness_simple, result_cache) {
+  std::filesystem::remove("results.sqlite");
+  auto Conn = open_v2("results.sqlite",
+                      SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE A (id INTEGER PRIMARY KEY, s)"));
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE B (id INTEGER PRIMARY KEY)"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO A VALUES (1, 'one'), (2, 'two')"));
+  Conn->enableResultCache();
+
+  auto Names = [&](std::int64_t MinId) {
+    std::vector<std::string> Result;
+    for (auto &&Row : Conn->runReadingCached<std::int64_t, std::string_view>(
+             "SELECT id, s FROM A WHERE id >= ? ORDER BY id", MinId)) {
+      EXPECT_TRUE(Row.has_value());
+      Result.emplace_back(std::get<1>(*Row));
+    }
+    return Result;
+  };
+
+  using Strings = std::vector<std::string>;
+  ASSERT_EQ(Names(1), (Strings{"one", "two"}));
+  ASSERT_EQ(Names(1), (Strings{"one", "two"}));
+  ASSERT_EQ(Names(2), (Strings{"two"}));
+  auto Stats = Conn->resultCacheStats();
+  ASSERT_EQ(Stats.Hits, 1);
+  ASSERT_EQ(Stats.Misses, 2);
+  ASSERT_EQ(Stats.Entries, 2);
+
+  // Writes to an unrelated table keep the entries.
+  ASSERT_EXPECTED(Conn->run("INSERT INTO B VALUES (1)"));
+  ASSERT_EQ(Names(2), (Strings{"two"}));
+  ASSERT_EQ(Conn->resultCacheStats().Hits, 2);
+
+  ASSERT_EXPECTED(Conn->run("UPDATE A SET s = 'TWO' WHERE id = 2"));
+  ASSERT_EQ(Names(2), (Strings{"TWO"}));
+  ASSERT_EQ(Conn->resultCacheStats().Invalidations, 1);
+
+  // Commits by another connection are seen through data_version.
+  auto Other = open_v2("results.sqlite", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Other);
+  ASSERT_EXPECTED(Other->run("INSERT INTO A VALUES (3, 'three')"));
+  ASSERT_EQ(Names(2), (Strings{"TWO", "three"}));
+
+  // Results read inside a transaction are not cached.
+  ASSERT_EXPECTED(Conn->run("BEGIN"));
+  ASSERT_EXPECTED(Conn->run("DELETE FROM A WHERE id = 3"));
+  ASSERT_EQ(Names(2), (Strings{"TWO"}));
+  ASSERT_EXPECTED(Conn->run("ROLLBACK"));
+  ASSERT_EQ(Names(2), (Strings{"TWO", "three"}));
+
+  ResultCacheOptions Tiny{.MaxBytes = 256};
+  Conn->enableResultCache(Tiny);
+  (void)Names(1);
+  (void)Names(2);
+  ASSERT_LE(Conn->resultCacheStats().Bytes, Tiny.MaxBytes);
+  ASSERT_GE(Conn->resultCacheStats().Evictions, 1);
+
+  // The application's authorizer is left alone while tables are captured.
+  sqlite3_set_authorizer(
+      Conn->nativeHandle(),
+      [](void *, int Action, char const *Table, char const *, char const *,
+         char const *) {
+        return Action == SQLITE_READ && Table && Table == std::string_view("B")
+                   ? SQLITE_DENY
+                   : SQLITE_OK;
+      },
+      nullptr);
+  ASSERT_EQ(Names(3), (Strings{"three"}));
+  ASSERT_FALSE(Conn->prepare("SELECT id FROM B"));
+  sqlite3_set_authorizer(Conn->nativeHandle(), nullptr, nullptr);
+}
+
+TEST(correctness_simple, in_memory_snapshot) {
+  std::filesystem::remove("snapshot.sqlite");
+  std::filesystem::remove("snapshot.sqlite-wal");
+  {
+    auto Conn = open("snapshot.sqlite", WriteHeavy);
+    ASSERT_EXPECTED(Conn);
+    ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (id INTEGER PRIMARY KEY, s)"));
+    ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (1, 'a'), (2, 'b')"));
+
+    // Uncheckpointed WAL frames are not in the main file yet.
+    ASSERT_FALSE(openInMemoryFrom("snapshot.sqlite"));
+
+    auto Image = Conn->serialize();
+    ASSERT_EXPECTED(Image);
+    auto Copy = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+    ASSERT_EXPECTED(Copy);
+    ASSERT_EXPECTED(Copy->deserialize(Image->bytes()));
+    std::int64_t Count = 0;
+    for (auto &&Row :
+         Copy->runReading<std::int64_t>("SELECT count(*) FROM KEK"))
+      Count = std::get<0>(*Row);
+    ASSERT_EQ(Count, 2);
+
+    // Replacing a borrowed schema releases the image it held.
+    auto Shared = std::make_shared<DatabaseImage>(std::move(*Image));
+    ASSERT_EXPECTED(Copy->deserializeBorrowed(Shared->bytes(), Shared));
+    ASSERT_EXPECTED(Copy->deserializeBorrowed(Shared->bytes(), Shared));
+    ASSERT_EQ(Shared.use_count(), 2);
+    ASSERT_EXPECTED(Copy->deserialize({}));
+    ASSERT_EQ(Shared.use_count(), 1);
+  }
+
+  auto ReadOnly = openInMemoryFrom("snapshot.sqlite");
+  ASSERT_EXPECTED(ReadOnly);
+  std::string Names;
+  for (auto &&Row :
+       ReadOnly->runReading<std::string_view>("SELECT s FROM KEK ORDER BY id"))
+    Names += std::get<0>(*Row);
+  ASSERT_EQ(Names, "ab");
+  ASSERT_FALSE(ReadOnly->run("INSERT INTO KEK VALUES (3, 'c')"));
+
+  auto Writable = openInMemoryFrom("snapshot.sqlite", /*ReadOnly=*/false);
+  ASSERT_EXPECTED(Writable);
+  ASSERT_EXPECTED(Writable->run("INSERT INTO KEK VALUES (3, 'c')"));
+  ASSERT_EXPECTED(writeSnapshot(*Writable, "snapshot.sqlite"));
+  ASSERT_FALSE(std::filesystem::exists("snapshot.sqlite.tmp"));
+  ASSERT_FALSE(writeSnapshot(*Writable, "missing_dir/snapshot.sqlite"));
+  ASSERT_FALSE(std::filesystem::exists("missing_dir/snapshot.sqlite.tmp"));
+
+  SnapshotHandle Handle(std::move(*ReadOnly));
+  auto Reader = Handle.current();
+  ASSERT_EXPECTED(Handle.reload("snapshot.sqlite"));
+  auto Rows = [](Connection &Conn) {
+    std::int64_t Count = 0;
+    for (auto &&Row : Conn.runReading<std::int64_t>("SELECT count(*) FROM KEK"))
+      Count = std::get<0>(*Row);
+    return Count;
+  };
+  // The old snapshot stays usable until its last reader drops it.
+  ASSERT_EQ(Rows(*Reader), 2);
+  ASSERT_EQ(Rows(*Handle.current()), 3);
+}
+
+TEST(correctness_simple, online_backup) {
+  for (auto const *File : {"backup_src.sqlite", "backup_src.sqlite-wal",
+                           "backup_dst.sqlite", "backup_vacuum.sqlite"})
+    std::filesystem::remove(File);
+  auto Conn = open("backup_src.sqlite", WriteHeavy);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (id INTEGER PRIMARY KEY, b)"));
+  ASSERT_EXPECTED(Conn->run(
+      "WITH RECURSIVE Seq(n) AS (SELECT 1 UNION ALL SELECT n + 1 FROM Seq "
+      "WHERE n < 4000) INSERT INTO KEK SELECT n, randomblob(1000) FROM Seq"));
+
+  auto Count = [](std::string_view Path) {
+    std::int64_t N = -1;
+    auto Db = open_v2(Path, SQLITE_OPEN_READONLY);
+    if (Db)
+      for (auto &&Row :
+           Db->runReading<std::int64_t>("SELECT count(*) FROM KEK"))
+        if (Row)
+          N = std::get<0>(*Row);
+    return N;
+  };
+
+  // p99 of single-row autocommit inserts, optionally while a backup runs.
+  std::int64_t NextId = 100000;
+  auto WriteP99 = [&](BackupJob *Job) {
+    std::vector<std::chrono::nanoseconds> Latencies;
+    while (Latencies.size() < 200 || (Job && !Job->finished())) {
+      auto Start = std::chrono::steady_clock::now();
+      EXPECT_TRUE(Conn->run("INSERT INTO KEK VALUES (?, 'x')", NextId++));
+      Latencies.push_back(std::chrono::steady_clock::now() - Start);
+    }
+    std::ranges::sort(Latencies);
+    return Latencies[Latencies.size() * 99 / 100];
+  };
+
+  auto Baseline = WriteP99(nullptr);
+  auto Rows = Count("backup_src.sqlite");
+  std::size_t Reports = 0;
+  auto Job = Conn->backupTo(
+      "backup_dst.sqlite",
+      {.PagesPerStep = 16,
+       .Pause = std::chrono::microseconds(200),
+       .OnProgress = [&](BackupProgress const &) { ++Reports; }});
+  ASSERT_EXPECTED(Job);
+  auto During = WriteP99(&*Job);
+  auto Progress = Job->wait();
+  ASSERT_EXPECTED(Progress);
+  ASSERT_TRUE(Job->finished());
+  ASSERT_FALSE(Job->wait());
+  ASSERT_TRUE(BackupJob().finished());
+  // The pinned WAL snapshot never restarts and holds the rows as of the
+  // start of the backup.
+  ASSERT_EQ(Progress->Restarts, 0);
+  ASSERT_EQ(Progress->Remaining, 0);
+  ASSERT_EQ(Reports, Progress->Steps);
+  ASSERT_GT(Progress->Steps, 1);
+  ASSERT_EQ(Count("backup_dst.sqlite"), Rows);
+  std::cerr << "write p99: " << Baseline.count() << "ns idle, "
+            << During.count() << "ns during backup\n";
+  // Loose: the backup thread may share a single CPU with the writer.
+  ASSERT_LT(During, std::max<std::chrono::nanoseconds>(
+                        Baseline * 20, std::chrono::milliseconds(50)));
+
+  // Cancelling leaves the destination as it was.
+  auto Cancelled = Conn->backupTo("backup_dst.sqlite",
+                                  {.PagesPerStep = 1, .PinSnapshot = false});
+  ASSERT_EXPECTED(Cancelled);
+  Cancelled->cancel();
+  ASSERT_FALSE(Cancelled->wait());
+  ASSERT_EQ(Count("backup_dst.sqlite"), Rows);
+
+  // Unpinned, a write between steps restarts the copy; after MaxRestarts
+  // the rest goes in one step and the result is current.
+  auto Writer = open_v2("backup_src.sqlite", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Writer);
+  auto Restarting = Conn->backupTo(
+      "backup_dst.sqlite",
+      {.PagesPerStep = 64,
+       .Pause = std::chrono::microseconds(0),
+       .PinSnapshot = false,
+       .MaxRestarts = 3,
+       .OnProgress = [&](BackupProgress const &P) {
+         if (P.Remaining)
+           (void)Writer->run("INSERT INTO KEK VALUES (?, 'y')", NextId++);
+       }});
+  ASSERT_EXPECTED(Restarting);
+  auto Restarted = Restarting->wait();
+  ASSERT_EXPECTED(Restarted);
+  ASSERT_EQ(Restarted->Restarts, 3);
+  ASSERT_EQ(Count("backup_dst.sqlite"), Count("backup_src.sqlite"));
+
+  auto Vacuum = Conn->backupTo("backup_vacuum.sqlite",
+                               {.Method = BackupMethod::VacuumInto});
+  ASSERT_EXPECTED(Vacuum);
+  ASSERT_EXPECTED(Vacuum->wait());
+  ASSERT_EQ(Count("backup_vacuum.sqlite"), Count("backup_src.sqlite"));
+
+  auto Memory = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Memory);
+  ASSERT_FALSE(Memory->backupTo("backup_dst.sqlite"));
+}
+
+TEST(correctness_simple, user_functions) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (g INT, n INT, s TEXT)"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (1, 1, 'ab'), "
+                            "(1, 2, NULL), (2, 3, 'cde'), (2, 4, 'f')"));
+
+  ASSERT_EXPECTED(Conn->defineFunction(
+      "twice", [](std::int64_t N) { return N * 2; }));
+  ASSERT_EXPECTED(Conn->defineFunction(
+      "len_or", [](std::optional<std::string_view> S, int Default) {
+        return S ? int(S->size()) : Default;
+      }));
+  ASSERT_EXPECTED(Conn->defineFunction(
+      "checked", [](int N) -> std::expected<std::string, std::string_view> {
+        if (N > 3)
+          return std::unexpected("too big");
+        return std::string(N, '*');
+      }));
+
+  auto Scalar = [&](std::string_view Sql) {
+    std::string Result;
+    for (auto &&Row : Conn->runReading<std::string_view>(Sql)) {
+      if (!Row)
+        return std::string("error");
+      Result += std::get<0>(*Row);
+      Result += ',';
+    }
+    return Result;
+  };
+  ASSERT_EQ(Scalar("SELECT twice(n) FROM KEK"), "2,4,6,8,");
+  ASSERT_EQ(Scalar("SELECT len_or(s, -1) FROM KEK"), "2,-1,3,1,");
+  ASSERT_EQ(Scalar("SELECT checked(n) FROM KEK WHERE n < 4"), "*,**,***,");
+  ASSERT_EQ(Scalar("SELECT checked(n) FROM KEK"), "error");
+  // Deterministic functions may appear in index expressions.
+  ASSERT_EXPECTED(Conn->run("CREATE INDEX KekTwice ON KEK (twice(n))"));
+
+  struct Product {
+    std::int64_t Value{1};
+    void step(std::int64_t N) { Value *= N; }
+    auto value() const { return Value; }
+  };
+  ASSERT_EXPECTED(Conn->defineAggregate<Product>("product"));
+  ASSERT_EQ(Scalar("SELECT product(n) FROM KEK GROUP BY g"), "2,12,");
+  // An empty group yields the initial state.
+  ASSERT_EXPECTED(Conn->defineAggregate("product_from", Product{10}));
+  ASSERT_EQ(Scalar("SELECT product_from(n) FROM KEK WHERE n > 9"), "10,");
+
+  struct Concat {
+    std::string Joined;
+    void step(std::string_view S) { Joined += S; }
+    void inverse(std::string_view S) { Joined.erase(0, S.size()); }
+    auto value() const -> std::string_view { return Joined; }
+  };
+  ASSERT_EXPECTED(Conn->defineWindow<Concat>("concat"));
+  ASSERT_EQ(Scalar("SELECT concat(coalesce(s, '-')) OVER (ORDER BY n ROWS "
+                   "BETWEEN 1 PRECEDING AND CURRENT ROW) FROM KEK"),
+            "ab,ab-,-cde,cdef,");
+}
+
+TEST(correctness_simple, virtual_table) {
+  struct Person {
+    std::int64_t Id;
+    std::string Name;
+    double Score;
+  };
+  std::vector<Person> People;
+  for (std::int64_t I = 1; I <= 100; ++I)
+    People.push_back({I * 10, "p" + std::to_string(I), I * 0.5});
+
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(VirtualTable<Person>::create(
+      *Conn, "people", People,
+      {.Columns = {"id", "name", "score"}, .SortedKey = 0}));
+  ASSERT_EXPECTED(VirtualTable<std::int64_t>::create(
+      *Conn, "ids", {}, {.Columns = {"value"}}));
+
+  auto Ints = [&](std::string_view Sql, auto &&...Params) {
+    std::vector<std::int64_t> Result;
+    for (auto &&Row : Conn->runReading<std::int64_t>(Sql, Params...)) {
+      EXPECT_TRUE(Row.has_value());
+      if (Row)
+        Result.push_back(std::get<0>(*Row));
+    }
+    return Result;
+  };
+  using Ints64 = std::vector<std::int64_t>;
+  ASSERT_EQ(Ints("SELECT count(*) FROM people"), Ints64{100});
+  ASSERT_EQ(Ints("SELECT id FROM people WHERE id = 500"), Ints64{500});
+  ASSERT_EQ(Ints("SELECT id FROM people WHERE id = 505"), Ints64{});
+  ASSERT_EQ(Ints("SELECT id FROM people WHERE id > 960 AND id <= 990"),
+            (Ints64{970, 980, 990}));
+  ASSERT_EQ(Ints("SELECT id FROM people WHERE id < 25.5"), (Ints64{10, 20}));
+  ASSERT_EQ(Ints("SELECT id FROM people WHERE id >= ? ORDER BY id LIMIT 2",
+                 995),
+            Ints64{1000});
+  ASSERT_EQ(Ints("SELECT id FROM people WHERE id IN (30, 31, 40)"),
+            (Ints64{30, 40}));
+
+  std::string Name;
+  for (auto &&Row : Conn->runReading<std::string_view, double>(
+           "SELECT name, score FROM people WHERE id = 70")) {
+    Name = std::get<0>(*Row);
+    ASSERT_EQ(std::get<1>(*Row), 3.5);
+  }
+  ASSERT_EQ(Name, "p7");
+
+  // A table-valued function over caller memory bound per statement.
+  std::vector<std::int64_t> Wanted = {20, 40, 41, 60};
+  std::span<std::int64_t const> WantedRows = Wanted;
+  ASSERT_EQ(Ints("SELECT p.id FROM people p JOIN ids(?) i ON p.id = i.value",
+                 VirtualTable<std::int64_t>::rows(WantedRows)),
+            (Ints64{20, 40, 60}));
+  std::span<Person const> Few(People.data(), 3);
+  ASSERT_EQ(Ints("SELECT sum(id) FROM people(?)",
+                 VirtualTable<Person>::rows(Few)),
+            Ints64{60});
+  // Without an argument the table has no rows to show.
+  ASSERT_EQ(Ints("SELECT count(*) FROM ids"), Ints64{0});
+}
+
+TEST(correctness_simple, row_range) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (n INT, s TEXT)"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (1, 'a'), (2, 'b'), "
+                            "(3, 'c'), (4, 'd')"));
+
+  using RangeT = RowRange<std::int64_t, std::string_view>;
+  static_assert(std::ranges::input_range<RangeT>);
+  static_assert(std::ranges::viewable_range<RangeT>);
+
+  std::string Text;
+  for (auto &&Row : Conn->runReadingRange<std::int64_t, std::string_view>(
+           "SELECT n, s FROM KEK WHERE n > ?", 1)) {
+    ASSERT_EXPECTED(Row);
+    Text += std::get<1>(*Row);
+  }
+  ASSERT_EQ(Text, "bcd");
+
+  // Pipelines own the range.
+  auto Value = [](auto &&Row) { return std::get<0>(*Row); };
+  auto IsEven = [](std::int64_t N) { return N % 2 == 0; };
+  std::vector<std::int64_t> Evens;
+  for (auto N : Conn->runReadingRange<std::int64_t>("SELECT n FROM KEK") |
+                    std::views::transform(Value) | std::views::filter(IsEven))
+    Evens.push_back(N);
+  ASSERT_EQ(Evens, (std::vector<std::int64_t>{2, 4}));
+
+  std::int64_t Taken = 0;
+  for (auto &&Row :
+       Conn->runReadingRange<std::int64_t>("SELECT n FROM KEK ORDER BY n") |
+           std::views::take(2))
+    Taken += std::get<0>(*Row);
+  ASSERT_EQ(Taken, 3);
+
+  // The statement goes back to the cache once the range is gone, so the
+  // same SQL can run again right away.
+  std::size_t Count = 0;
+  for (auto &&Row : Conn->runReadingRange<std::int64_t>("SELECT n FROM KEK"))
+    Count += Row.has_value();
+  ASSERT_EQ(Count, 4);
+
+  auto Stmt = Conn->prepare("SELECT s FROM KEK ORDER BY n DESC LIMIT 1");
+  ASSERT_EXPECTED(Stmt);
+  for (auto &&Row : Stmt->runReadingRange<std::string>())
+    ASSERT_EQ(std::get<0>(*Row), "d");
+
+  // Errors come out as a single unexpected row.
+  std::size_t Errors = 0;
+  for (auto &&Row : Conn->runReadingRange<std::int64_t>("SELECT nope"))
+    Errors += !Row.has_value();
+  ASSERT_EQ(Errors, 1);
+}
+
+TEST(correctness_simple, collect_into_arena) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (id INT, name TEXT, b BLOB)"));
+  ASSERT_EXPECTED(Conn->run(
+      "WITH RECURSIVE Seq(n) AS (SELECT 1 UNION ALL SELECT n + 1 FROM Seq "
+      "WHERE n < 2000) INSERT INTO KEK SELECT n, 'name ' || n, "
+      "CASE WHEN n % 2 THEN zeroblob(n % 5) END FROM Seq"));
+
+  struct Row {
+    std::int64_t Id;
+    std::string_view Name;
+    std::span<std::uint8_t const> Bytes;
+  };
+  auto Rows = Conn->queryAll<Row>("SELECT * FROM KEK WHERE id > ?", 1000);
+  ASSERT_EXPECTED(Rows);
+  // Churn SQLite's row buffers; the views must not care.
+  ASSERT_EXPECTED(Conn->run("UPDATE KEK SET name = 'x'"));
+  auto Moved = std::move(*Rows);
+
+  ASSERT_EQ(Moved.size(), 1000);
+  for (auto const &R : Moved) {
+    ASSERT_EQ(R.Name, "name " + std::to_string(R.Id));
+    ASSERT_EQ(R.Bytes.size(), R.Id % 2 ? std::size_t(R.Id % 5) : 0);
+  }
+  // One allocation per chunk, not per cell.
+  ASSERT_LE(Moved.arena().chunks(), 4);
+  ASSERT_GE(Moved.arena().reserved(), Moved.arena().used());
+
+  auto Stmt = Conn->prepare("SELECT id, name FROM KEK WHERE id <= 2");
+  ASSERT_EXPECTED(Stmt);
+  struct Named {
+    int Id;
+    std::string Name;
+  };
+  auto Small = Stmt->collect<Named>();
+  ASSERT_EXPECTED(Small);
+  ASSERT_EQ(Small->size(), 2);
+  ASSERT_EQ((*Small)[1].Name, "x");
+  ASSERT_EQ(Small->arena().used(), 0);
+
+  ASSERT_FALSE(Conn->queryAll<Row>("SELECT nope"));
+}
+
+TEST(correctness_simple, bulk_import_export) {
+  {
+    std::ofstream Csv("bulk.csv", std::ios::binary);
+    Csv << "id,name,note\r\n";
+    for (int I = 0; I < 5000; ++I)
+      Csv << I << ",n" << I << ","
+          << (I % 3 == 0   ? "\"say \"\"hi\"\",\nthen go\""
+              : I % 3 == 1 ? ""
+                           : "plain")
+          << "\r\n";
+    Csv << "\n";
+    std::ofstream Json("bulk.ndjson", std::ios::binary);
+    Json << R"({"id": 1, "x": 0.5, "s": "a\"\u00e9\ud83d\ude00", )"
+         << R"("j": [1, "]"]})" << "\n\n"
+         << R"({"s": null, "id": 2, "extra": true})" << "\n";
+  }
+
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Conn);
+  ImportOptions Options;
+  // Small chunks and queue: many quoted line breaks straddle chunk ends,
+  // and parsers must wait for the inserter.
+  Options.ChunkSize = 1000;
+  Options.QueueDepth = 2;
+  Options.ParserThreads = 3;
+  Options.CommitEvery = 700;
+  auto Imported = importFile(*Conn, "bulk.csv", "Csv", Options);
+  ASSERT_EXPECTED(Imported);
+  ASSERT_EQ(Imported->Rows, 5000);
+  auto Check = Conn->prepare(
+      "SELECT count(*), sum(id), sum(note = 'say \"hi\",' || char(10) || "
+      "'then go'), sum(name = 'n' || id) FROM Csv");
+  ASSERT_EXPECTED(Check);
+  for (auto &&Row : Check->runReading<int, std::int64_t, int, int>()) {
+    ASSERT_EXPECTED(Row);
+    ASSERT_EQ(*Row, std::make_tuple(5000, 4999 * 5000 / 2, 1667, 5000));
+  }
+
+  auto Exported = exportQuery(*Conn, "SELECT * FROM Csv", "bulk.out.csv");
+  ASSERT_EXPECTED(Exported);
+  ASSERT_EQ(Exported->Rows, 5000);
+  Options.ParserThreads = 1;
+  ASSERT_EXPECTED(importFile(*Conn, "bulk.out.csv", "Copy", Options));
+  auto Diff = Conn->prepare(
+      "SELECT count(*) FROM (SELECT * FROM Csv EXCEPT SELECT * FROM Copy)");
+  ASSERT_EXPECTED(Diff);
+  for (auto &&Row : Diff->runReading<int>()) {
+    ASSERT_EXPECTED(Row);
+    ASSERT_EQ(std::get<0>(*Row), 0);
+  }
+
+  Options.Format = BulkFormat::Ndjson;
+  ASSERT_EXPECTED(importFile(*Conn, "bulk.ndjson", "Json", Options));
+  auto Json = exportQuery(
+      *Conn, "SELECT id, x, s, j FROM Json ORDER BY id", "bulk.out.ndjson",
+      {.Format = BulkFormat::Ndjson});
+  ASSERT_EXPECTED(Json);
+  std::ifstream In("bulk.out.ndjson");
+  std::string Line;
+  std::getline(In, Line);
+  ASSERT_EQ(Line, "{\"id\":1,\"x\":0.5,\"s\":\"a\\\"\u00e9\U0001F600\","
+                  "\"j\":\"[1, \\\"]\\\"]\"}");
+  std::getline(In, Line);
+  ASSERT_EQ(Line, "{\"id\":2,\"x\":null,\"s\":null,\"j\":null}");
+
+  std::ofstream("bulk.ndjson") << "{\"id\": 1\n";
+  ASSERT_FALSE(importFile(*Conn, "bulk.ndjson", "Json", Options));
+  // A nested string cut off right after a backslash.
+  std::ofstream("bulk.ndjson") << "{\"id\": 1, \"j\": [\"x\\\n";
+  ASSERT_FALSE(importFile(*Conn, "bulk.ndjson", "Json", Options));
+  std::ofstream("bulk.ndjson", std::ios::binary) << "{\"j\": [\"x\\";
+  ASSERT_FALSE(importFile(*Conn, "bulk.ndjson", "Json", Options));
+  ASSERT_FALSE(importFile(*Conn, "missing.csv", "Json"));
+  for (auto const *File :
+       {"bulk.csv", "bulk.ndjson", "bulk.out.csv", "bulk.out.ndjson"})
+    std::filesystem::remove(File);
+}
+
+TEST(correctness_simple, query_limits) {
+  using namespace std::chrono_literals;
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Conn);
+  // Runs for minutes unless stopped.
+  constexpr char const *Endless =
+      "WITH RECURSIVE Seq(n) AS (SELECT 1 UNION ALL SELECT n + 1 FROM Seq) "
+      "SELECT count(*) FROM Seq";
+
+  auto Start = std::chrono::steady_clock::now();
+  for (auto &&Row : Conn->runReading<int>(QueryLimits::after(50ms), Endless))
+    ASSERT_EQ(Row.error(), DeadlineExceeded);
+  ASSERT_LT(std::chrono::steady_clock::now() - Start, 5s);
+
+  // The connection is usable afterwards, and generous limits change
+  // nothing.
+  int Rows = 0;
+  for (auto &&Row : Conn->runReading<int>(QueryLimits::after(1h),
+                                          "SELECT value FROM "
+                                          "json_each('[1, 2, 3]') WHERE "
+                                          "value > ?",
+                                          1)) {
+    ASSERT_EXPECTED(Row);
+    ++Rows;
+  }
+  ASSERT_EQ(Rows, 2);
+
+  CancellationToken Token;
+  std::promise<void> Started;
+  std::jthread Canceller([&, Ready = Started.get_future()]() mutable {
+    Ready.wait();
+    std::this_thread::sleep_for(20ms);
+    Token.cancel();
+  });
+  auto Stmt = Conn->prepare(Endless);
+  ASSERT_EXPECTED(Stmt);
+  Started.set_value();
+  auto Step = Stmt->step({.Token = &Token});
+  ASSERT_FALSE(Step);
+  ASSERT_EQ(Step.error(), QueryCancelled);
+  Canceller.join();
+
+  // A cancelled token stops queries before they start, until reset. The
+  // statement's reset() reports the interrupted step.
+  ASSERT_FALSE(Stmt->reset());
+  ASSERT_EQ(Stmt->step({.Token = &Token}).error(), QueryCancelled);
+  Token.reset();
+  auto Quick = Conn->prepare("SELECT 1");
+  ASSERT_EXPECTED(Quick);
+  ASSERT_EQ(*Quick->step({.Token = &Token}), Statement::StepOk::STEP_ROW);
+  ASSERT_EQ(Quick->step(std::chrono::steady_clock::now()).error(),
+            DeadlineExceeded);
+
+  // Ordinary errors are not reported as timeouts.
+  auto Bad = Conn->prepare("SELECT abs(-9223372036854775807 - 1)");
+  ASSERT_EXPECTED(Bad);
+  auto Overflow = Bad->step(QueryLimits::after(1h));
+  ASSERT_FALSE(Overflow);
+  ASSERT_NE(Overflow.error(), DeadlineExceeded);
+}
+
+TEST(correctness_simple, change_feed) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run(
+      "CREATE TABLE KEK (id INTEGER PRIMARY KEY, name TEXT, b BLOB)"));
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE Other (x)"));
+
+  std::vector<ChangeBatch> Batches;
+  auto Feed = Conn->changes(
+      [&](ChangeBatch const &Batch) { Batches.push_back(Batch); },
+      {.Tables = {"KEK"}, .QueueCapacity = 2});
+  ASSERT_EXPECTED(Feed);
+
+  ASSERT_EXPECTED(Conn->run("BEGIN"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (1, 'a', NULL)"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (2, 'b', x'0102')"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO Other VALUES (1)"));
+  ASSERT_EXPECTED(Conn->run("COMMIT"));
+  ASSERT_EXPECTED(Conn->run("BEGIN"));
+  ASSERT_EXPECTED(Conn->run("DELETE FROM KEK"));
+  ASSERT_EXPECTED(Conn->run("ROLLBACK"));
+  ASSERT_EXPECTED(Conn->run("UPDATE KEK SET name = 'c' WHERE id = 1"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO Other VALUES (2)"));
+  // More commits than the queue holds: the writer waits for the consumer.
+  for (int I = 10; I < 20; ++I)
+    ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (?, 'n', NULL)", I));
+  ASSERT_EXPECTED(Conn->run("DELETE FROM KEK WHERE id = 2"));
+  Feed->stop();
+
+  ASSERT_EQ(Batches.size(), 13);
+  for (std::size_t I = 0; I < Batches.size(); ++I)
+    ASSERT_EQ(Batches[I].Sequence, I + 1);
+  ASSERT_EQ(Feed->stats().Events, 14);
+
+  auto const &Inserts = Batches[0].Events;
+  ASSERT_EQ(Inserts.size(), 2);
+  ASSERT_EQ(Inserts[1].Op, ChangeOp::Insert);
+  ASSERT_EQ(Inserts[1].Table, "KEK");
+  ASSERT_EQ(Inserts[1].RowId, 2);
+  auto const &Update = Batches[1].Events.at(0);
+  ASSERT_EQ(Update.Op, ChangeOp::Update);
+  ASSERT_EQ(Update.RowId, 1);
+  auto const &Delete = Batches.back().Events.at(0);
+  ASSERT_EQ(Delete.Op, ChangeOp::Delete);
+  ASSERT_EQ(Delete.RowId, 2);
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+  ASSERT_EQ(Inserts[1].New.size(), 3);
+  ASSERT_EQ(std::get<std::vector<std::uint8_t>>(Inserts[1].New[2]),
+            (std::vector<std::uint8_t>{1, 2}));
+  ASSERT_TRUE(std::holds_alternative<std::monostate>(Inserts[0].New[2]));
+  ASSERT_EQ(std::get<std::string>(Update.Old[1]), "a");
+  ASSERT_EQ(std::get<std::string>(Update.New[1]), "c");
+  ASSERT_EQ(std::get<std::int64_t>(Delete.Old[0]), 2);
+  ASSERT_TRUE(Delete.New.empty());
+#endif
+
+  // Stopped feeds capture nothing more.
+  ASSERT_EXPECTED(Conn->run("DELETE FROM KEK"));
+  ASSERT_EQ(Batches.size(), 13);
+
+#ifdef SQLITE_ENABLE_SESSION
+  auto Replica = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Replica);
+  for (auto *C : {&*Conn, &*Replica})
+    ASSERT_EXPECTED(C->run("CREATE TABLE S (id INTEGER PRIMARY KEY, v)"));
+  ASSERT_EXPECTED(Replica->run("INSERT INTO S VALUES (3, 'replica')"));
+  auto Session = Conn->startSession({"S"});
+  ASSERT_EXPECTED(Session);
+  ASSERT_TRUE(Session->empty());
+  // Both need the connection's one preupdate hook.
+  ASSERT_FALSE(Conn->changes([](ChangeBatch const &) {}));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO S VALUES (1, 'x'), (2, 'y'), "
+                            "(3, 'primary')"));
+  ASSERT_EXPECTED(Conn->run("UPDATE S SET v = 'z' WHERE id = 2"));
+  auto Changeset = Session->changeset();
+  ASSERT_EXPECTED(Changeset);
+  ASSERT_FALSE(Replica->applyChangeset(*Changeset));
+  ASSERT_EXPECTED(
+      Replica->applyChangeset(*Changeset, ConflictPolicy::Replace));
+  std::string Rows;
+  for (auto &&Row : Replica->runReading<int, std::string_view>(
+           "SELECT id, v FROM S ORDER BY id")) {
+    ASSERT_EXPECTED(Row);
+    Rows += std::to_string(std::get<0>(*Row)) + std::string(std::get<1>(*Row));
+  }
+  ASSERT_EQ(Rows, "1x2z3primary");
+#endif
+}
+
+TEST(correctness_simple, change_feed_only_sees_surviving_changes) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (id INTEGER PRIMARY KEY)"));
+
+  std::mutex Mutex;
+  std::vector<ChangeBatch> Batches;
+  auto Feed = Conn->changes([&](ChangeBatch const &Batch) {
+    std::lock_guard Lock(Mutex);
+    Batches.push_back(Batch);
+  });
+  ASSERT_EXPECTED(Feed);
+
+  // The result cache shares the update hook instead of taking it over.
+  Conn->enableResultCache();
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (1)"));
+  for (auto &&Row : Conn->runReadingCached<int>("SELECT count(*) FROM KEK"))
+    ASSERT_EQ(std::get<0>(*Row), 1);
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (2)"));
+  for (auto &&Row : Conn->runReadingCached<int>("SELECT count(*) FROM KEK"))
+    ASSERT_EQ(std::get<0>(*Row), 2);
+  Conn->disableResultCache();
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (3)"));
+
+  ASSERT_EXPECTED(Conn->run("BEGIN"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (4)"));
+  auto Mark = Conn->changesMark();
+  ASSERT_EXPECTED(Conn->run("SAVEPOINT s"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (5)"));
+  ASSERT_EXPECTED(Conn->run("ROLLBACK TO s"));
+  Conn->discardChangesSince(Mark);
+  ASSERT_EXPECTED(Conn->run("RELEASE s"));
+  ASSERT_EXPECTED(Conn->run("COMMIT"));
+
+  // The second row of the failing write is a duplicate; its savepoint
+  // undoes the first one, which the feed must not report.
+  {
+    WriteQueue Queue(std::move(*Conn));
+    auto Failed = Queue.submit("INSERT INTO KEK VALUES (6), (1)");
+    auto Written = Queue.submit("INSERT INTO KEK VALUES (7)");
+    ASSERT_FALSE(Failed.get());
+    ASSERT_EXPECTED(Written.get());
+  }
+  Feed->stop();
+
+  std::vector<std::int64_t> RowIds;
+  for (auto const &Batch : Batches)
+    for (auto const &Event : Batch.Events)
+      RowIds.push_back(Event.RowId);
+  ASSERT_EQ(RowIds, (std::vector<std::int64_t>{1, 2, 3, 4, 7}));
+}
+
+TEST(correctness_simple, change_feed_keeps_commits_from_statements) {
+  auto Conn = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (id INTEGER PRIMARY KEY)"));
+
+  std::mutex Mutex;
+  std::vector<ChangeBatch> Batches;
+  auto Feed = Conn->changes([&](ChangeBatch const &Batch) {
+    std::lock_guard Lock(Mutex);
+    Batches.push_back(Batch);
+  });
+  ASSERT_EXPECTED(Feed);
+
+  auto Step = [&](std::string_view Sql) {
+    auto Stmt = Conn->prepare(Sql);
+    ASSERT_EXPECTED(Stmt);
+    ASSERT_EXPECTED(Stmt->step());
+  };
+
+  // A commit made through a Statement is only confirmed later; a rolled
+  // back transaction in between must neither drop it nor merge it with
+  // the next one, whether the transaction is driven by run() or not.
+  Step("INSERT INTO KEK VALUES (1)");
+  ASSERT_EXPECTED(Conn->run("BEGIN"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (2)"));
+  ASSERT_EXPECTED(Conn->run("ROLLBACK"));
+  ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (3)"));
+
+  Step("INSERT INTO KEK VALUES (4)");
+  Step("BEGIN");
+  Step("INSERT INTO KEK VALUES (5)");
+  Step("ROLLBACK");
+  Step("INSERT INTO KEK VALUES (6)");
+  Step("BEGIN");
+  Step("INSERT INTO KEK VALUES (7)");
+  ASSERT_EXPECTED(Conn->run("COMMIT"));
+  Feed->stop();
+
+  std::vector<std::vector<std::int64_t>> RowIds;
+  for (auto const &Batch : Batches) {
+    auto &Ids = RowIds.emplace_back();
+    for (auto const &Event : Batch.Events)
+      Ids.push_back(Event.RowId);
+  }
+  ASSERT_EQ(RowIds,
+            (std::vector<std::vector<std::int64_t>>{{1}, {3}, {4}, {6}, {7}}));
+}
+
+TEST(correctness_simple, background_checkpointer) {
+  using namespace std::chrono_literals;
+  for (auto const *Suffix : {"", "-wal", "-shm"})
+    std::filesystem::remove(std::string("checkpoint.sqlite") + Suffix);
+  auto Conn = open("checkpoint.sqlite", WriteHeavy);
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (a BLOB)"));
+
+  auto Memory = open_v2(":memory:", SQLITE_OPEN_READWRITE);
+  ASSERT_EXPECTED(Memory);
+  ASSERT_FALSE(Checkpointer::start(*Memory));
+
+  {
+    auto Checkpoints = Checkpointer::start(
+        *Conn, {.PassiveFrames = 20,
+                .RestartFrames = 100,
+                .TruncateFrames = 200,
+                .Interval = 10ms});
+    ASSERT_EXPECTED(Checkpoints);
+    std::string Payload(3000, 'x');
+    for (int I = 0; I < 500; ++I)
+      ASSERT_EXPECTED(Conn->run("INSERT INTO KEK VALUES (?)", Payload));
+
+    auto Total = [&] {
+      auto S = Checkpoints->stats();
+      return S.Passive + S.Restart + S.Truncate;
+    };
+    auto Deadline = std::chrono::steady_clock::now() + 5s;
+    while (Total() == 0 && std::chrono::steady_clock::now() < Deadline)
+      std::this_thread::sleep_for(1ms);
+    auto Stats = Checkpoints->stats();
+    ASSERT_GT(Total(), 0u);
+    ASSERT_EQ(Stats.Busy, 0u);
+    // -1 would mean the checkpoint did not see a WAL at all.
+    ASSERT_GE(Stats.LastLogFrames, 0);
+    ASSERT_GT(Stats.WalFrames, 0);
+    ASSERT_GT(Stats.MaxDuration.count(), 0);
+    ASSERT_GE(Stats.TotalDuration, Stats.MaxDuration);
+
+    // An explicit request runs whatever the WAL size.
+    auto Before = Total();
+    Checkpoints->checkpointNow();
+    Deadline = std::chrono::steady_clock::now() + 5s;
+    while (Total() == Before && std::chrono::steady_clock::now() < Deadline)
+      std::this_thread::sleep_for(1ms);
+    ASSERT_GT(Total(), Before);
+    Stats = Checkpoints->stats();
+    ASSERT_EQ(Stats.LastCheckpointedFrames, Stats.LastLogFrames);
+  }
+
+  // Stopping hands checkpointing back with the writer's own threshold.
+  for (auto &&Row : Conn->runReading<int>("PRAGMA wal_autocheckpoint"))
+    ASSERT_EQ(std::get<0>(*Row), 4000);
+  ASSERT_EXPECTED(Conn->run("PRAGMA journal_mode = DELETE"));
+  ASSERT_FALSE(Checkpointer::start(*Conn));
+}
+
+struct DetachedTask {
+  struct promise_type {
+    auto get_return_object() noexcept -> DetachedTask { return {}; }
+    auto initial_suspend() noexcept -> std::suspend_never { return {}; }
+    auto final_suspend() noexcept -> std::suspend_never { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+auto asyncScenario(AsyncConnection &Conn, std::promise<int> &Done)
+    -> DetachedTask {
+  EXPECT_TRUE(co_await Conn.runAsync("CREATE TABLE KEK (n1 INT, str TEXT)"));
+  EXPECT_TRUE(co_await Conn.prepareAsync("INSERT INTO KEK VALUES (?, ?)"));
+  for (int I = 0; I < 100; ++I)
+    EXPECT_TRUE(co_await Conn.runAsync("INSERT INTO KEK VALUES (?, ?)", I,
+                                       std::to_string(I)));
+
+  int Rows = 0;
+  auto Stream = Conn.runReadingAsync<int, std::string>(
+      "SELECT n1, str FROM KEK WHERE n1 >= ?", 10);
+  while (true) {
+    auto Batch = co_await Stream.next(16);
+    if (Batch.empty())
+      break;
+    EXPECT_LE(Batch.size(), 16u);
+    for (auto &Row : Batch) {
+      EXPECT_TRUE(Row);
+      EXPECT_EQ(std::to_string(std::get<0>(*Row)), std::get<1>(*Row));
+      ++Rows;
+    }
+  }
+  Done.set_value(Rows);
+}
+
+TEST(correctness_async, run_and_stream) {
+  auto Conn = openAsync(":memory:");
+  ASSERT_EXPECTED(Conn);
+  std::promise<int> Done;
+  asyncScenario(*Conn, Done);
+  ASSERT_EQ(Done.get_future().get(), 90);
+}
+
+TEST(correctness_async, destroyed_from_inline_resume) {
+  auto Conn = openAsync(":memory:");
+  ASSERT_EXPECTED(Conn);
+  auto Owned = std::make_unique<AsyncConnection>(std::move(*Conn));
+  std::promise<int> Done;
+  [](std::unique_ptr<AsyncConnection> Owned,
+     std::promise<int> &Done) -> DetachedTask {
+    auto Value = co_await Owned->execute([](Connection &) { return 7; });
+    // Resumed on the worker thread, which must not try to join itself.
+    Owned.reset();
+    Done.set_value(Value);
+  }(std::move(Owned), Done);
+  ASSERT_EQ(Done.get_future().get(), 7);
+}
+
+TEST(correctness_async, resumes_on_caller_executor) {
+  // Minimal single-threaded executor: the test thread drains it.
+  std::mutex Mutex;
+  std::condition_variable Ready;
+  std::deque<std::coroutine_handle<>> Queue;
+  auto Conn = openAsync(":memory:",
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+                        [&](std::coroutine_handle<> Handle) {
+                          std::lock_guard Lock(Mutex);
+                          Queue.push_back(Handle);
+                          Ready.notify_one();
+                        });
+  ASSERT_EXPECTED(Conn);
+
+  auto Caller = std::this_thread::get_id();
+  std::promise<int> Done;
+  [](AsyncConnection &Conn, std::thread::id Caller,
+     std::promise<int> &Done) -> DetachedTask {
+    auto Value = co_await Conn.execute([](Connection &C) {
+      int Sum = 0;
+      for (auto &&Row : C.runReading<int>("SELECT 40 + 2"))
+        Sum += Row ? std::get<0>(*Row) : 0;
+      return Sum;
+    });
+    EXPECT_EQ(std::this_thread::get_id(), Caller);
+    Done.set_value(Value);
+  }(*Conn, Caller, Done);
+
+  auto Result = Done.get_future();
+  while (Result.wait_for(std::chrono::seconds(0)) !=
+         std::future_status::ready) {
+    std::unique_lock Lock(Mutex);
+    Ready.wait(Lock, [&] { return !Queue.empty(); });
+    auto Handle = Queue.front();
+    Queue.pop_front();
+    Lock.unlock();
+    Handle.resume();
+  }
+  ASSERT_EQ(Result.get(), 42);
+}
+
+TEST(correctness_write_queue, group_commit) {
+  for (auto const *Suffix : {"", "-wal", "-shm"})
+    std::filesystem::remove(std::string("queue.sqlite") + Suffix);
+  auto Conn = open("queue.sqlite");
+  ASSERT_EXPECTED(Conn);
+  ASSERT_EXPECTED(Conn->run("CREATE TABLE KEK (id INT PRIMARY KEY)"));
+
+  constexpr int Producers = 8;
+  constexpr int PerProducer = 50;
+  std::vector<std::future<ExpectedT<void>>> Results(Producers * PerProducer);
+  {
+    WriteQueue Queue(std::move(*Conn),
+                     {.MaxBatch = 64,
+                      .MaxLatency = std::chrono::milliseconds(5)});
+    {
+      std::vector<std::jthread> Jobs;
+      for (int P = 0; P < Producers; ++P)
+        Jobs.emplace_back([&, P] {
+          for (int I = 0; I < PerProducer; ++I) {
+            // Every producer writes id 0 once more; only the first succeeds.
+            int Id = I ? P * PerProducer + I : 0;
+            Results[P * PerProducer + I] =
+                Queue.submit("INSERT INTO KEK VALUES (?)", Id);
+          }
+        });
+    }
+
+    int Failed = 0;
+    for (auto &R : Results)
+      Failed += !R.get();
+    ASSERT_EQ(Failed, Producers - 1);
+
+    auto Stats = Queue.stats();
+    ASSERT_EQ(Stats.Writes, std::uint64_t(Producers * PerProducer));
+    ASSERT_EQ(Stats.Failures, std::uint64_t(Producers - 1));
+    ASSERT_LT(Stats.Batches, Stats.Writes);
+  }
+
+  auto Check = open("queue.sqlite");
+  ASSERT_EXPECTED(Check);
+  for (auto &&Row : Check->runReading<int>("SELECT count(*) FROM KEK")) {
+    ASSERT_EXPECTED(Row);
+    ASSERT_EQ(std::get<0>(*Row), Producers * (PerProducer - 1) + 1);
+  }
+}
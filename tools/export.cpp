@@ -0,0 +1,71 @@
+// esqlite-export: writes the result of a query as CSV or NDJSON.
+//
+//   esqlite-export [options] DATABASE SQL [FILE]
+//     --ndjson          one JSON object per row (default: CSV)
+//     --no-header       CSV without the column names
+//     --delimiter C     CSV field separator (default ',')
+//
+// Without FILE the rows go to stdout. Prints rows, bytes and throughput to
+// stderr.
+
+#include "bulk_io.h"
+#include "esqlite.h"
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace esqlite;
+
+namespace {
+
+int usage() {
+  std::fputs("usage: esqlite-export [--ndjson] [--no-header] [--delimiter C] "
+             "DATABASE SQL [FILE]\n",
+             stderr);
+  return 2;
+}
+
+} // namespace
+
+int main(int Argc, char **Argv) {
+  ExportOptions Options;
+  std::vector<std::string_view> Positional;
+  for (int I = 1; I < Argc; ++I) {
+    std::string_view Arg = Argv[I];
+    if (Arg == "--ndjson")
+      Options.Format = BulkFormat::Ndjson;
+    else if (Arg == "--no-header")
+      Options.Header = false;
+    else if (Arg == "--delimiter" && I + 1 < Argc)
+      Options.Delimiter = Argv[++I][0];
+    else if (Arg.starts_with("--"))
+      return usage();
+    else
+      Positional.push_back(Arg);
+  }
+  if (Positional.size() != 2 && Positional.size() != 3)
+    return usage();
+
+  auto Conn = open_v2(Positional[0], SQLITE_OPEN_READONLY);
+  if (!Conn) {
+    std::fprintf(stderr, "esqlite-export: %.*s\n", int(Conn.error().size()),
+                 Conn.error().data());
+    return 1;
+  }
+  auto Stats = Positional.size() == 3
+                   ? exportQuery(*Conn, Positional[1], Positional[2], Options)
+                   : exportQuery(*Conn, Positional[1], stdout, Options);
+  if (!Stats) {
+    std::fprintf(stderr, "esqlite-export: %.*s\n", int(Stats.error().size()),
+                 Stats.error().data());
+    return 1;
+  }
+  std::fprintf(stderr, "%llu rows, %.1f MB in %.3f s: %.1f MB/s\n",
+               static_cast<unsigned long long>(Stats->Rows),
+               double(Stats->Bytes) / 1e6,
+               std::chrono::duration<double>(Stats->Elapsed).count(),
+               Stats->megabytesPerSecond());
+  return 0;
+}
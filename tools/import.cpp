@@ -0,0 +1,86 @@
+// esqlite-import: loads a CSV or NDJSON file into a table.
+//
+//   esqlite-import [options] DATABASE FILE TABLE
+//     --ndjson          input is one JSON object per line (default: CSV)
+//     --no-header       CSV has no header row; columns are c1, c2, ...
+//     --delimiter C     CSV field separator (default ',')
+//     --threads N       parser threads (default: all cores)
+//     --commit-every N  rows per transaction (default: one transaction)
+//     --fast            open with the BulkLoad profile: no journal, no
+//                       fsync. Only for a fresh file nothing else uses.
+//
+// Prints rows, bytes and throughput to stderr.
+
+#include "bulk_io.h"
+#include "esqlite.h"
+#include "open_options.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace esqlite;
+
+namespace {
+
+int usage() {
+  std::fputs("usage: esqlite-import [--ndjson] [--no-header] [--delimiter C] "
+             "[--threads N]\n"
+             "                      [--commit-every N] [--fast] DATABASE FILE "
+             "TABLE\n",
+             stderr);
+  return 2;
+}
+
+} // namespace
+
+int main(int Argc, char **Argv) {
+  ImportOptions Options;
+  bool Fast = false;
+  std::vector<std::string_view> Positional;
+  for (int I = 1; I < Argc; ++I) {
+    std::string_view Arg = Argv[I];
+    bool HasValue = I + 1 < Argc;
+    if (Arg == "--ndjson")
+      Options.Format = BulkFormat::Ndjson;
+    else if (Arg == "--no-header")
+      Options.Header = false;
+    else if (Arg == "--fast")
+      Fast = true;
+    else if (Arg == "--delimiter" && HasValue)
+      Options.Delimiter = Argv[++I][0];
+    else if (Arg == "--threads" && HasValue)
+      Options.ParserThreads = std::strtoull(Argv[++I], nullptr, 10);
+    else if (Arg == "--commit-every" && HasValue)
+      Options.CommitEvery = std::strtoull(Argv[++I], nullptr, 10);
+    else if (Arg.starts_with("--"))
+      return usage();
+    else
+      Positional.push_back(Arg);
+  }
+  if (Positional.size() != 3)
+    return usage();
+
+  auto Conn = Fast ? open(Positional[0], BulkLoad)
+                   : open_v2(Positional[0],
+                             SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+  if (!Conn) {
+    std::fprintf(stderr, "esqlite-import: %.*s\n", int(Conn.error().size()),
+                 Conn.error().data());
+    return 1;
+  }
+  auto Stats = importFile(*Conn, Positional[1], Positional[2], Options);
+  if (!Stats) {
+    std::fprintf(stderr, "esqlite-import: %.*s\n", int(Stats.error().size()),
+                 Stats.error().data());
+    return 1;
+  }
+  std::fprintf(stderr, "%llu rows, %.1f MB in %.3f s: %.1f MB/s\n",
+               static_cast<unsigned long long>(Stats->Rows),
+               double(Stats->Bytes) / 1e6,
+               std::chrono::duration<double>(Stats->Elapsed).count(),
+               Stats->megabytesPerSecond());
+  return 0;
+}